@@ -0,0 +1,75 @@
+#include "Generator.h"
+#include <fstream>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+Generator::Generator(const RepoShape& s, const filesystem::path& r) : shape(s), root(r), rng(s.seed) {
+    // directory names come from the index alone, file i always lands in the same directory
+    for (int i = 0; i < shape.files; i++) {
+        int dir = shape.directories > 0 ? i % shape.directories : 0;
+        filesystem::path relative;
+
+        if (shape.directories > 0) {
+            relative = filesystem::path("d" + to_string(dir % 8)) / ("d" + to_string(dir));
+        }
+        files.push_back(relative / ("file" + to_string(i) + ".dat"));
+    }
+}
+
+// log-uniform: as many files between 64B and 1KB as between 64KB and 1MB
+uint64_t Generator::pickSize() {
+    uniform_real_distribution<double> exponent(log((double)shape.minSize), log((double)shape.maxSize));
+    return (uint64_t)exp(exponent(rng));
+}
+
+// text-like content (printable bytes and newlines) so diff and blame have lines to work with
+void Generator::writeFile(const filesystem::path& relative) {
+    filesystem::path full = root / relative;
+    filesystem::create_directories(full.parent_path());
+
+    uint64_t size = pickSize();
+    string contents(size, '\0');
+    for (uint64_t i = 0; i < size; i += 8) {
+        uint64_t word = rng();
+        for (uint64_t b = 0; b < 8 && i + b < size; b++) {
+            contents[i + b] = (b == 7 && (word & 0x3f) == 0) ? '\n' : (char)(' ' + ((word >> (b * 8)) & 0xff) % 94);
+        }
+    }
+
+    ofstream out(full, ios::binary | ios::trunc);
+    out.write(contents.data(), contents.size());
+    if (!out) {
+        throw runtime_error("could not write " + full.string());
+    }
+}
+
+void Generator::createTree() {
+    for (const filesystem::path& file : files) {
+        writeFile(file);
+    }
+}
+
+vector<filesystem::path> Generator::churn() {
+    int count = max(1, (int)llround(shape.churn * shape.files));
+    uniform_int_distribution<int> pick(0, shape.files - 1);
+
+    vector<filesystem::path> changed;
+    for (int i = 0; i < count; i++) {
+        const filesystem::path& file = files[pick(rng)];
+        writeFile(file);
+        changed.push_back(file);
+    }
+    return changed;
+}
+
+uint64_t Generator::treeBytes() const {
+    uint64_t total = 0;
+    for (const filesystem::path& file : files) {
+        error_code ec;
+        uintmax_t size = filesystem::file_size(root / file, ec);
+        total += ec ? 0 : size;
+    }
+    return total;
+}
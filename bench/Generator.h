@@ -0,0 +1,49 @@
+#ifndef BENCH_GENERATOR_H
+#define BENCH_GENERATOR_H
+
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <filesystem>
+
+using namespace std;
+
+/*
+Shape of the synthetic repository. The same config and seed always produce the same files with the same bytes,
+so two minigit versions benchmarked with the same arguments work on identical trees and histories.
+*/
+struct RepoShape {
+    int files = 2000;           // files in the working tree
+    int directories = 50;       // spread over this many directories (nested a few levels deep)
+    uint64_t minSize = 64;      // file sizes are log-uniform between these, so most files are small
+    uint64_t maxSize = 256 * 1024;
+    double churn = 0.05;        // fraction of files rewritten before every commit
+    int commits = 50;           // history length
+    uint64_t seed = 42;
+};
+
+class Generator {
+private:
+    RepoShape shape;
+    filesystem::path root;
+    mt19937_64 rng;
+    vector<filesystem::path> files;    // relative to root
+
+    uint64_t pickSize();
+    void writeFile(const filesystem::path& relative);
+
+public:
+    Generator(const RepoShape& shape, const filesystem::path& root);
+
+    void createTree();
+    //writes the initial working tree under root
+
+    vector<filesystem::path> churn();
+    //rewrites shape.churn * files of the files (at least one) with new contents and returns which ones
+
+    uint64_t treeBytes() const;
+    //current size of the whole tree
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include "Harness.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sys/resource.h>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// STATISTICS
+// Nearest-rank percentiles, good enough for the sample counts we take and they're always a real sample
+//----------------------------------------------------------------------------------------------------------------------------
+
+double OperationResult::percentile(double p) const {
+    if (samples.empty()) {
+        return 0;
+    }
+    vector<double> sorted = samples;
+    sort(sorted.begin(), sorted.end());
+
+    size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.999999);
+    rank = min(max(rank, (size_t)1), sorted.size());
+    return sorted[rank - 1];
+}
+
+double OperationResult::total() const {
+    return accumulate(samples.begin(), samples.end(), 0.0);
+}
+
+double OperationResult::mean() const {
+    return samples.empty() ? 0 : total() / samples.size();
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// PEAK RSS
+// VmHWM from /proc/self/status can be reset by writing 5 to clear_refs, getrusage can't, so it's only the fallback
+//----------------------------------------------------------------------------------------------------------------------------
+
+long Harness::peakRssKb() {
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return stol(line.substr(6));
+        }
+    }
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void Harness::resetPeakRss() {
+    ofstream clear("/proc/self/clear_refs");
+    clear << "5";
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// RUNS
+//----------------------------------------------------------------------------------------------------------------------------
+
+OperationResult& Harness::operation(const string& name) {
+    for (OperationResult& op : results) {
+        if (op.name == name) {
+            return op;
+        }
+    }
+    results.push_back({name, {}, 0, 0});
+    return results.back();
+}
+
+void Harness::run(OperationResult& op, const function<uint64_t()>& body) {
+    resetPeakRss();
+    streambuf* oldOut = cout.rdbuf(nullptr);
+
+    auto start = chrono::steady_clock::now();
+    uint64_t bytes = body();
+    auto stop = chrono::steady_clock::now();
+
+    cout.rdbuf(oldOut);
+    cout.clear();       // writes with no buffer set badbit
+
+    op.samples.push_back(chrono::duration<double, milli>(stop - start).count());
+    op.bytes += bytes;
+    op.peakRssKb = max(op.peakRssKb, peakRssKb());
+}
+
+void Harness::printSummary() const {
+    for (const OperationResult& op : results) {
+        cerr << "  " << op.name << ": " << op.samples.size() << " runs, p50 " << op.percentile(50)
+             << " ms, p99 " << op.percentile(99) << " ms, peak RSS " << op.peakRssKb << " KB" << endl;
+    }
+}
+
+const deque<OperationResult>& Harness::getResults() const {
+    return results;
+}
@@ -0,0 +1,48 @@
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <cstdint>
+
+using namespace std;
+
+struct OperationResult {
+    string name;
+    vector<double> samples;     // milliseconds, one per run
+    uint64_t bytes;             // data the runs moved, for MB/s (0 if it doesn't apply)
+    long peakRssKb;             // highest resident set size seen while this operation ran
+
+    double percentile(double p) const;
+    double mean() const;
+    double total() const;
+};
+
+/*
+Times operations one run at a time. Each run is a separate sample, so the report shows percentiles instead of
+one average that hides the slow outliers. Peak RSS is reset before every run (linux: clear_refs) so each
+operation reports its own peak rather than the highest one so far, even when runs of different operations interleave.
+
+minigit prints as it works, the harness sends cout to nowhere while a run is timed.
+*/
+class Harness {
+private:
+    deque<OperationResult> results;     // deque so references handed out stay valid
+
+public:
+    OperationResult& operation(const string& name);
+    //the result for name, created (in report order) the first time it's asked for
+
+    void run(OperationResult& op, const function<uint64_t()>& body);
+    //times one run; body returns how many bytes it moved
+
+    void printSummary() const;
+    const deque<OperationResult>& getResults() const;
+
+    static long peakRssKb();
+    static void resetPeakRss();
+};
+
+#endif
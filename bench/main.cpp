@@ -0,0 +1,247 @@
+#include "Generator.h"
+#include "Harness.h"
+#include "Commands.h"
+#include "CommitGraph.h"
+#include "Manifest.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+using namespace std;
+
+/*
+minigit_bench: builds a synthetic repository and times the operations that get slow on big histories.
+
+    minigit_bench [--files N] [--dirs N] [--min-size B] [--max-size B] [--churn F] [--commits N]
+                  [--seed N] [--iterations N] [--dir PATH] [--out FILE] [--keep]
+
+Operations, each reported with p50/p90/p99/max latency, throughput and peak RSS:
+    add               addall before every commit
+    commit            addCommit for every commit of the generated history (churn files rewritten in between)
+    open              CommitManager constructor with a current commit-graph snapshot
+    loadListFromDisk  CommitManager constructor without the snapshot, walks every commit folder
+    status            working tree scan against the stat cache
+    checkout          checkout of a pseudo-random commit from the history
+    revert            revert to a pseudo-random commit (adds a commit each time)
+
+Same arguments => same files, same history shape and same sequence of checkout/revert targets,
+so JSON from two builds can be compared directly.
+*/
+
+struct BenchOptions {
+    RepoShape shape;
+    int iterations = 20;
+    filesystem::path dir;
+    string out = "bench-results.json";
+    bool keep = false;
+};
+
+static void printBenchUsage() {
+    cerr << "Usage: minigit_bench [--files N] [--dirs N] [--min-size B] [--max-size B] [--churn F]\n"
+         << "                     [--commits N] [--seed N] [--iterations N] [--dir PATH] [--out FILE] [--keep]\n";
+}
+
+static bool parseOptions(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+
+        if (arg == "--keep") {
+            options.keep = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        string value = argv[++i];
+
+        if (arg == "--files") options.shape.files = stoi(value);
+        else if (arg == "--dirs") options.shape.directories = stoi(value);
+        else if (arg == "--min-size") options.shape.minSize = stoull(value);
+        else if (arg == "--max-size") options.shape.maxSize = stoull(value);
+        else if (arg == "--churn") options.shape.churn = stod(value);
+        else if (arg == "--commits") options.shape.commits = stoi(value);
+        else if (arg == "--seed") options.shape.seed = stoull(value);
+        else if (arg == "--iterations") options.iterations = stoi(value);
+        else if (arg == "--dir") options.dir = value;
+        else if (arg == "--out") options.out = value;
+        else return false;
+    }
+
+    return options.shape.files > 0 && options.shape.commits > 0 && options.iterations > 0 &&
+           options.shape.minSize > 0 && options.shape.minSize <= options.shape.maxSize;
+}
+
+static uint64_t commitBytes(const filesystem::path& commitsDir, const string& commitID) {
+    Manifest manifest = Manifest::forCommit(commitsDir, commitID);
+    uint64_t total = 0;
+    for (auto& entry : manifest.getEntries()) {
+        total += entry.second.size;
+    }
+    return total;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// JSON
+//----------------------------------------------------------------------------------------------------------------------------
+
+static void writeJson(const string& file, const BenchOptions& options, const Harness& harness) {
+    ofstream out(file);
+    out << fixed << setprecision(3);
+
+    const RepoShape& s = options.shape;
+    out << "{\n  \"config\": {\"files\": " << s.files << ", \"directories\": " << s.directories
+        << ", \"min_size\": " << s.minSize << ", \"max_size\": " << s.maxSize << ", \"churn\": " << s.churn
+        << ", \"commits\": " << s.commits << ", \"seed\": " << s.seed << ", \"iterations\": " << options.iterations
+        << "},\n  \"results\": [\n";
+
+    const deque<OperationResult>& results = harness.getResults();
+    for (size_t i = 0; i < results.size(); i++) {
+        const OperationResult& r = results[i];
+        double seconds = r.total() / 1000.0;
+
+        out << "    {\"op\": \"" << r.name << "\", \"runs\": " << r.samples.size()
+            << ", \"p50_ms\": " << r.percentile(50) << ", \"p90_ms\": " << r.percentile(90)
+            << ", \"p99_ms\": " << r.percentile(99) << ", \"max_ms\": " << r.percentile(100)
+            << ", \"mean_ms\": " << r.mean()
+            << ", \"ops_per_sec\": " << (seconds > 0 ? r.samples.size() / seconds : 0)
+            << ", \"mb_per_sec\": " << (seconds > 0 ? r.bytes / 1048576.0 / seconds : 0)
+            << ", \"peak_rss_kb\": " << r.peakRssKb << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// MAIN
+//----------------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            printBenchUsage();
+            return 1;
+        }
+    } catch (const exception&) {
+        printBenchUsage();
+        return 1;
+    }
+
+    if (options.dir.empty()) {
+        options.dir = filesystem::temp_directory_path() / ("minigit-bench-" + to_string(options.shape.seed));
+    }
+    string out = filesystem::absolute(options.out).string();
+    options.dir = filesystem::absolute(options.dir);
+
+    filesystem::remove_all(options.dir);
+    filesystem::create_directories(options.dir);
+
+    // the benchmark process is the only user of this repository, no daemon
+    setenv("MINIGIT_NO_DAEMON", "1", 1);
+
+    {
+        ostringstream quiet;
+        Repository repo(options.dir);
+        repo.setOutput(quiet, quiet);
+        repo.init();
+    }
+
+    Generator generator(options.shape, options.dir);
+    Harness harness;
+    mt19937_64 picks(options.shape.seed + 1);
+
+    cerr << "Generating " << options.shape.files << " files in " << options.dir.string() << endl;
+    generator.createTree();
+
+    Session session(options.dir);
+    session.load();
+    const Repository* repo = &session.repo;
+    filesystem::path commitsDir = session.repo.getCommitsDir();
+
+    // ------------------------------------------------ history ------------------------------------------------
+    OperationResult& add = harness.operation("add");
+    OperationResult& commit = harness.operation("commit");
+    vector<string> history;
+
+    for (int c = 0; c < options.shape.commits; c++) {
+        if (c > 0) {
+            generator.churn();
+        }
+        uint64_t bytes = generator.treeBytes();
+
+        harness.run(add, [&]() {
+            session.repo.addAll();
+            return bytes;
+        });
+        harness.run(commit, [&]() {
+            session.manager->addCommit("generated commit " + to_string(c));
+            session.restore->recordCommit(session.repo.getHead());
+            session.repo.clearStaging();
+            return bytes;
+        });
+        history.push_back(session.repo.getHead());
+    }
+
+    // ------------------------------------------------ loading ------------------------------------------------
+    OperationResult& open = harness.operation("open");
+    for (int i = 0; i < options.iterations; i++) {
+        harness.run(open, [&]() {
+            delete new CommitManager(repo);
+            return (uint64_t)0;
+        });
+    }
+
+    OperationResult& load = harness.operation("loadListFromDisk");
+    for (int i = 0; i < options.iterations; i++) {
+        filesystem::remove(CommitGraph::graphPath(commitsDir));
+        harness.run(load, [&]() {
+            delete new CommitManager(repo);     // no snapshot, so this walks the list (and writes a new snapshot)
+            return (uint64_t)0;
+        });
+    }
+
+    // ------------------------------------------------ working tree ------------------------------------------------
+    OperationResult& status = harness.operation("status");
+    uint64_t treeBytes = generator.treeBytes();
+    for (int i = 0; i < options.iterations; i++) {
+        harness.run(status, [&]() {
+            Manifest::scanWorkingTree(options.dir, *session.statCache);
+            return treeBytes;
+        });
+    }
+
+    uniform_int_distribution<size_t> pick(0, history.size() - 1);
+
+    OperationResult& checkout = harness.operation("checkout");
+    for (int i = 0; i < options.iterations; i++) {
+        string target = history[pick(picks)];
+        uint64_t bytes = commitBytes(commitsDir, target);
+        harness.run(checkout, [&]() {
+            session.repo.checkout(target);
+            return bytes;
+        });
+    }
+
+    OperationResult& revert = harness.operation("revert");
+    for (int i = 0; i < options.iterations; i++) {
+        string target = history[pick(picks)];
+        uint64_t bytes = commitBytes(commitsDir, target);
+        harness.run(revert, [&]() {
+            session.manager->revert(target);
+            session.restore->recordCommit(session.repo.getHead());
+            return bytes;
+        });
+    }
+
+    harness.printSummary();
+    session.unload();
+
+    writeJson(out, options, harness);
+    cerr << "Results written to " << out << endl;
+
+    if (!options.keep) {
+        filesystem::remove_all(options.dir);
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <string>
+#include <filesystem>
+#include <iostream>
+#include <cstdint>
+
+using namespace std;
+
+struct ArchiveResult {
+    int files = 0;
+    uintmax_t bytes = 0;        // file contents, before tar padding / compression
+};
+
+/*
+minigit archive: one commit as a tar (or tar.gz) stream, read straight out of the commit's Data folder.
+The working tree, staging area and HEAD are never touched, so it can run while someone is working in the repo.
+
+    -entries come from the commit's manifest (sorted, so the same commit always gives the same archive),
+     directories get their own entry before the first file inside them
+    -every entry's mtime is the commit's time (its record) and the mode is 0644, or 0755 if the stored file is executable
+    -names that don't fit a ustar header (over 100 characters that can't be split into prefix/name, or files over
+     8 GiB) get a pax extended header, which every current tar reads
+    -plain tar copies file contents with sendfile() on linux, so file bytes go from the page cache to the output
+     (a pipe, a file, a socket) without passing through minigit. It falls back to read/write where sendfile
+     isn't possible
+    -tar.gz needs zlib (MINIGIT_HAVE_ZLIB) and goes through a 256K compression buffer
+
+output "-" is `out`: fd 1 when that's cout, otherwise the bytes are written through the stream. Throws runtime_error for an unknown format, an unreadable file or a failed write.
+*/
+class Archive {
+public:
+    static ArchiveResult write(const filesystem::path& commitsDir, const string& commitID, const string& format,
+                               const string& prefix, const string& output, ostream& out = cout);
+    //prefix is put in front of every name ("project-1.2/"), format is "tar" or "tar.gz"
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <cstddef>
+
+using namespace std;
+
+/*
+Monotonic arena for objects that live exactly as long as a command's CommitManager: the commit nodes, their
+ID/message strings and the hash table's chain nodes.
+
+Loading a long history used to be several small heap allocations per commit (the node, four strings, a chain node).
+From the arena it's a bump of a pointer; memory comes from the heap in chunks that double in size, so a million commits
+take a few dozen allocations, and it all goes back in one go when the arena is destroyed. Nothing is freed before that,
+which is fine because nodes are never removed from a loaded list.
+
+Chunks taken from the heap are counted in --stats (arena_chunks, arena_bytes).
+*/
+class Arena {
+private:
+    class CountingResource : public pmr::memory_resource {
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const pmr::memory_resource& other) const noexcept override;
+    };
+
+    CountingResource upstream;
+    pmr::monotonic_buffer_resource pool;
+
+public:
+    explicit Arena(size_t firstChunk = 64 * 1024) : pool(firstChunk, &upstream) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    pmr::memory_resource* resource() {
+        return &pool;
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        //objects made here are never deleted, their destructors don't run (the arena owns all their memory)
+        void* memory = pool.allocate(sizeof(T), alignof(T));
+        return new (memory) T(std::forward<Args>(args)..., &pool);
+    }
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef BLAME_H
+#define BLAME_H
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "CommitManager.h"
+
+using namespace std;
+
+// A line of the blamed file and the commit that last changed it
+struct BlameLine {
+    string commitID;
+    string text;
+};
+
+/*
+Line level attribution for a file in the HEAD commit.
+
+Only commits whose ChangedPaths filter / manifest say the file changed are visited, and each
+version is diffed against the one before it with the Diff engine so unchanged lines keep their owner.
+
+Every version we attribute is cached in .Minivcs/cache/blame/, keyed by the path and the commit that
+introduced that version. A repeated blame stops walking at the first cached version, so blaming a
+hot file again only has to diff the versions added since last time (usually none).
+*/
+class Blame {
+private:
+    const Repository* repo;
+    CommitManager* manager;
+    filesystem::path cacheDir;
+
+    filesystem::path cacheFile(const string& path, const string& commitID) const;
+    bool loadCached(const string& path, const string& commitID, size_t lineCount, vector<string>& owners) const;
+    void saveCached(const string& path, const string& commitID, const vector<string>& owners) const;
+
+public:
+    Blame(const Repository* repository, CommitManager* commitManager);
+
+    bool annotate(const string& path, vector<BlameLine>& result);
+    void print(const string& path);
+};
+
+#endif
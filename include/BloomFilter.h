@@ -0,0 +1,36 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+using namespace std;
+
+/*
+Bloom filter of the paths a commit changed relative to its parent.
+mightContain() can give false positives but never false negatives, so a "no" lets
+path-limited log skip a commit without loading its manifest.
+Saved next to the commit metadata as ChangedPaths.bloom.
+*/
+class BloomFilter {
+private:
+    vector<uint8_t> bits;
+    int numHashes;
+
+    void positions(const string& key, vector<uint64_t>& out) const;
+
+public:
+    BloomFilter(size_t expectedItems = 0, int bitsPerItem = 10);
+
+    void add(const string& key);
+    bool mightContain(const string& key) const;
+
+    bool load(const filesystem::path& file);
+    void save(const filesystem::path& file) const;
+
+    size_t bitCount() const;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef BULKIO_H
+#define BULKIO_H
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <cstdint>
+
+using namespace std;
+
+class SparseCheckout;
+
+struct CopyJob {
+    filesystem::path source;
+    filesystem::path dest;      // parent directory must exist, an existing file is overwritten
+};
+
+struct FileStat {
+    bool ok;                    // false if the file couldn't be stat'ed (gone, no permission ...)
+    uintmax_t size;
+    filesystem::file_time_type mtime;   // same value filesystem::last_write_time would return
+};
+
+/*
+Bulk file operations for commands that touch many files at once (checkout, add, revert, status).
+
+Going through std::filesystem one file at a time costs several blocking syscalls per file, which is what
+dominates with hundreds of thousands of small files. A backend gets the whole list at once instead:
+
+    UringIO      => linux io_uring: opens, statx, reads, writes and closes for many files are queued on one ring
+                    and submitted together, so one syscall moves dozens of files forward
+    ThreadPoolIO => everywhere else: the list is split between worker threads that use std::filesystem,
+                    so files still make progress while others wait on the disk
+
+BulkIO::get() picks io_uring when the kernel supports it, otherwise the thread pool.
+MINIGIT_IO=threads forces the thread pool (MINIGIT_IO=uring only ever selects io_uring if it works).
+
+Backends aren't thread safe, minigit only calls them from one thread at a time.
+*/
+class BulkIO {
+public:
+    virtual ~BulkIO() {}
+
+    virtual const char* name() const = 0;
+
+    virtual vector<string> copyFiles(const vector<CopyJob>& jobs) = 0;
+    //returns one entry per job: empty if it was copied, the error message otherwise
+
+    virtual vector<FileStat> statFiles(const vector<filesystem::path>& paths) = 0;
+
+    void copyTree(const filesystem::path& source, const filesystem::path& dest, const SparseCheckout* sparse = nullptr);
+    //recreates the source tree under dest (directories named .Minivcs or .git are skipped, and with a sparse
+    //checkout everything outside its cones, without walking into it), throws runtime_error naming the first file that failed
+
+    static BulkIO& get();
+};
+
+class ThreadPoolIO : public BulkIO {
+private:
+    unsigned workers;
+
+public:
+    ThreadPoolIO();
+
+    const char* name() const override;
+    vector<string> copyFiles(const vector<CopyJob>& jobs) override;
+    vector<FileStat> statFiles(const vector<filesystem::path>& paths) override;
+};
+
+BulkIO* createUringIO();
+//io_uring backend, or nullptr if this kernel/build can't provide one (implemented in UringIO.cpp)
+
+filesystem::file_time_type fileTimeFromUnix(int64_t seconds, uint32_t nanoseconds);
+//converts a stat/statx timestamp to the clock std::filesystem uses
+
+#endif
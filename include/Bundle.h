@@ -0,0 +1,53 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <string>
+#include <filesystem>
+#include <cstdint>
+
+using namespace std;
+
+struct BundleResult {
+    string base;            // commit the bundle continues from ("NA" for a bundle of the whole history)
+    string tip;
+    int commits = 0;
+    int blobs = 0;          // distinct file contents carried
+    uintmax_t bytes = 0;    // their size before compression
+};
+
+/*
+A bundle is history in one file, for moving commits between machines that can't see each other (ssh pipes, usb sticks,
+tape). It's written and read front to back in one pass, so "-" (stdout / stdin) works as well as a file, and neither
+side ever holds more than one chunk of file data in memory.
+
+    MINIGIT-BUNDLE 1
+    BASE <id>                       commit the receiver must already have as its newest one, NA for everything
+    COMMITS <n>                     followed by the n commit IDs, oldest first
+    BLOB <hash> <size>              then <size> raw bytes, a file content the commits below use
+    COMMIT <id> <files>             then <files> times "FILE <name> <size>" + raw bytes (commit.bin, Manifest.txt ...)
+    END <commits> <blobs>
+
+Each distinct content (manifest hash + size) is sent once, just before the first commit that needs it, and never
+when the base commit already has it. Data folders aren't stored at all: the receiver rebuilds them from each
+commit's manifest by hardlinking the received contents, so unchanged files cost nothing on either side.
+
+With zlib (MINIGIT_HAVE_ZLIB) the whole stream is gzip compressed. Reading accepts both, a build without zlib can
+only read uncompressed bundles.
+
+Commits in bundles from before commit records (info.txt) get a record as they are unbundled.
+Unbundling verifies every content hash, stages the commits like Transfer (commits/.incoming-<id>) and publishes them
+with the same single atomic write, so a truncated or damaged bundle leaves the repository as it was.
+Errors are thrown as runtime_error. The caller holds the repository lock.
+*/
+class Bundle {
+public:
+    static BundleResult create(const filesystem::path& commitsDir, const string& file, const string& base,
+                               const string& tip);
+    //commits after base up to tip of the repository owning commitsDir, file "-" writes to stdout
+
+    static BundleResult unbundle(const filesystem::path& commitsDir, const string& file);
+    //into the repository owning commitsDir, file "-" reads stdin. Only the commits it doesn't have yet are
+    //added (result.commits), nothing if it already has the bundle's tip
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <string>
+#include <vector>
+#include <istream>
+#include "Repository.h"
+#include "CommitManager.h"
+#include "Restore.h"
+#include "StatCache.h"
+#include "ObjectStore.h"
+
+using namespace std;
+
+/*
+Everything a command works on. The CLI builds one per process, the daemon and the library (MiniGit.h) keep one loaded
+across requests so the commit list, hash table, stat cache and object index stay in memory.
+*/
+class Session {
+public:
+    Repository repo;
+    CommitManager* manager;
+    Restore* restore;
+    StatCache* statCache;
+    ObjectStore* objects;
+
+    explicit Session(const fs::path& root = fs::current_path());
+    ~Session();
+
+    void load();
+    void unload();
+    string stamp();     // changes whenever another process commits, undoes or redoes
+};
+
+void printUsage(ostream& out);
+bool isReadOnlyCommand(const vector<string>& args);
+bool checkRepository(Repository& repo, const string& cmd);
+//false (and why, on repo.err()) when cmd can't run here: not a repository, or an older one outside migrate-layout
+void autoCollect(Session& session);
+//write commands leave garbage behind now and then, gc runs by itself once there's enough of it
+int runCommand(Session& session, const vector<string>& args);
+//args[0] is the command name, like argv[1] in main. Prints to session.repo's streams, returns the process exit code
+int runBatch(Session& session, istream& in);
+//runs one command per input line against the same session, with metadata writes coalesced until the end or a "flush" line
+int runClone(const vector<string>& args);
+//"clone <source> [<dir>]", run from outside any repository (see Transfer.h)
+
+#endif
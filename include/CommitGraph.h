@@ -0,0 +1,37 @@
+#ifndef COMMITGRAPH_H
+#define COMMITGRAPH_H
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "CommitNode.h"
+#include "Arena.h"
+
+using namespace std;
+
+/*
+Snapshot of the whole commit list in one file, .Minivcs/commits/commit-graph.txt:
+
+    MINIGIT-COMMIT-GRAPH 2
+    TIP:<id of the newest commit>
+    COUNT:<number of commits>
+    <id> <previous id> <message>      (one line per commit, oldest first; \\, \n and \r in messages escaped)
+
+Loading it is one file read instead of three per commit. It is never edited, only replaced with an
+atomic rename, so a reader that opened it always sees a complete snapshot.
+
+The snapshot is current as long as commits/TIP.txt still names its TIP. A new commit rewrites that file,
+which makes the graph stale without anyone touching the graph itself. Stale graphs are rebuilt by the next
+process that loads the list the slow way.
+*/
+class CommitGraph {
+public:
+    static filesystem::path graphPath(const filesystem::path& commitsDir);
+
+    static bool isCurrent(const filesystem::path& commitsDir);
+    static bool load(const filesystem::path& commitsDir, vector<CommitNode*>& nodes, Arena& arena);
+    //nodes are made in the arena
+    static void write(const filesystem::path& commitsDir, CommitNode* tail);
+};
+
+#endif
@@ -3,30 +3,42 @@
 
 #include "CommitNode.h"
 #include "HashTable.h"
+#include "Arena.h"
 #include <string>
 
+class Repository;
+
 class CommitManager {
 private:
+    const Repository* repo;     // where the commits are and where messages go
+    Arena arena;        // every node, its strings and the hash table live here, freed together with the manager
     CommitNode* head;
     CommitNode* tail;
 
     HashTable* hashTable;
 
+    void writePathFilter(CommitNode* node);
 
 public:
-    CommitManager();
+    CommitManager(const Repository* repository);
 
     void loadListFromDisk();
-    CommitNode* loadSingleNode(const string& id);
+    CommitNode* loadSingleNode(string_view id);
 
-    void addCommit(const string& msg);
+    void addCommit(const string& msg, bool fromWorkingTree = true);
+    //fromWorkingTree: the staging area came from a (possibly sparse) working tree, so files outside the sparse
+    //checkout are carried over from the checked out commit. revert stages a whole commit and passes false
     void revert(const string& commitID);
     void printLog();
+    void printLog(const string& path);
+    void printLogWithChanges();
 
     CommitNode* getHead();
     CommitNode* getTail();
 
     bool commitExists(const string& commitID);
+    bool commitTouchesPath(CommitNode* node, const string& path);
+    string readCommitDate(string_view commitID) const;   // the commit record's timestamp, formatted like ctime
 
     ~CommitManager();
 };
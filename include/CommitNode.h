@@ -1,38 +1,48 @@
 #ifndef COMMITNODE_H
 #define COMMITNODE_H
 #include <string>
+#include <string_view>
+#include <filesystem>
+#include <memory_resource>
 using namespace std;
 
+/*
+The strings live in whatever memory resource the node was made with. CommitManager makes every node in its
+Arena, so a node and its strings are a few bumps of the same chunk; the default is the normal heap.
+Getters hand out views of those strings, valid for as long as the node is (copy them to keep them longer).
+*/
 class CommitNode {
 
 private:
 
-    string commitID;
-    string commitMsg;
-    string nextCommitID;
-    string prevCommitID;
+    pmr::string commitID;
+    pmr::string commitMsg;
+    pmr::string prevCommitID;
 
     CommitNode* nextNode;
     CommitNode* prevNode;
 
 public:
-
-    CommitNode();
-    CommitNode(string cI, string cM);
-    CommitNode(string cI);
-
-    void createCommitData();
-    void revertCommitData(string id);
-    void loadNodeInfo();
-
-    void setCommitID(string i);
-    void setCommitMsg(string m);
-    void setNextID(string n);
+    using allocator_type = pmr::polymorphic_allocator<char>;
+
+    CommitNode(allocator_type alloc = {});
+    CommitNode(string_view cI, string_view cM, string_view prevID, const filesystem::path& commitsDir,
+               const filesystem::path& stagingArea, allocator_type alloc = {});
+    //a new commit, its folder is filled from the staging area
+    CommitNode(string_view cI, const filesystem::path& commitsDir, allocator_type alloc = {});
+    //an existing commit, loaded from its record
+
+    void createCommitData(const filesystem::path& commitsDir, const filesystem::path& stagingArea);
+    void saveRecord(const filesystem::path& commitsDir);
+    //commit.bin, once Data and Manifest.txt are final. Until then the folder isn't a finished commit
+    void loadNodeInfo(const filesystem::path& commitsDir);
+
+    void setCommitID(string_view i);
+    void setCommitMsg(string_view m);
     void setNextNode(CommitNode* n);
 
-    string getCommitID();
-    string getCommitMsg();
-    string getNextID();
+    string_view getCommitID() const;
+    string_view getCommitMsg() const;
     CommitNode* getNextNode();
 
 
@@ -41,13 +51,8 @@ public:
     void setPrevNode(CommitNode* p);
     CommitNode* getPrevNode();
 
-    void setPrevID(string p);
-    string getPrevID();
-
-    void savePrevID(string id);
-
-
-    void saveNextID(string id);
+    void setPrevID(string_view p);
+    string_view getPrevID() const;
 };
 
 #endif
\ No newline at end of file
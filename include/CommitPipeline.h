@@ -0,0 +1,34 @@
+#ifndef COMMITPIPELINE_H
+#define COMMITPIPELINE_H
+
+#include <filesystem>
+#include "Manifest.h"
+
+using namespace std;
+
+/*
+Copies the staging area into a commit's Data folder and builds its manifest in the same pass.
+
+Four stages run on their own threads, connected by bounded lock-free queues (SpscQueue.h):
+
+    scan  -> walks the source tree, creates directories, queues every file
+    read  -> reads files in blocks of BLOCK_SIZE
+    hash  -> feeds each block into the file's content hash (same hash as hashFileContents)
+    write -> appends each block to the destination file
+
+So reading the next file, hashing the current one and writing the previous one overlap, and every byte is read
+from the staging area once (before, the copy read it and Manifest::build read the copy again).
+At most QUEUE_DEPTH blocks wait between two stages, which bounds memory whatever the file sizes are;
+written blocks go back to the reader so buffers are reused instead of reallocated.
+
+Any stage failing stops the others, and copy() throws runtime_error with the first error.
+*/
+class CommitPipeline {
+public:
+    static const size_t BLOCK_SIZE = 1 << 20;
+    static const size_t QUEUE_DEPTH = 16;
+
+    static Manifest copy(const filesystem::path& source, const filesystem::path& dest);
+};
+
+#endif
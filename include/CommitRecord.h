@@ -0,0 +1,89 @@
+#ifndef COMMITRECORD_H
+#define COMMITRECORD_H
+
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <cstdint>
+#include <ctime>
+
+using namespace std;
+
+const size_t COMMIT_ID_SIZE = 16;           // generateCommitID() and hashFileContents() are 16 hex characters
+
+// on disk exactly like this, little endian (every platform minigit builds on)
+struct CommitRecordHeader {
+    char magic[4];                  // "MGCR"
+    uint16_t version;
+    uint16_t headerSize;            // sizeof(CommitRecordHeader) when written, a later version can add fixed fields
+    int64_t timestamp;              // seconds since the epoch
+    char id[COMMIT_ID_SIZE];
+    char parent[COMMIT_ID_SIZE];    // all zero for the first commit
+    char tree[COMMIT_ID_SIZE];      // content hash of the commit's Manifest.txt
+    uint32_t authorSize;
+    uint32_t messageSize;           // author then message follow the header, no terminators
+};
+static_assert(sizeof(CommitRecordHeader) == 72, "the commit record header is an on-disk format");
+
+/*
+Everything about one commit except its files, in <commit folder>/commit.bin. It replaces info.txt,
+NextCommit.txt and PrevCommit.txt:
+
+    -written once (atomic rename) after Data and Manifest.txt, and never changed again. A folder without one is a
+     commit that never finished
+    -commits only point back at their parent. The newest commit of the history is commits/TIP.txt, the one small
+     file a new commit (or a transfer) rewrites, the oldest stays in TAIL.txt
+    -read with a single read() into the record itself, the fixed fields are used in place. Only an author and
+     message longer than the inline buffer need the heap
+
+The history is linear so there is one parent field, the version leaves room for more.
+
+Repositories from before (info.txt + the two pointer files, no TIP.txt) are converted by `minigit migrate-layout`;
+every other command refuses to run on them rather than half understand them.
+*/
+class CommitRecord {
+public:
+    static const uint16_t VERSION = 1;
+    static const char* const FILE_NAME;     // "commit.bin"
+
+    bool read(const filesystem::path& commitDir);
+    //false if the record is missing, damaged or from a newer minigit
+
+    string_view id() const;
+    string_view parent() const;     // "NA" for the first commit
+    string_view tree() const;
+    time_t timestamp() const;
+    string_view author() const;
+    string_view message() const;
+
+    static void write(const filesystem::path& commitDir, string_view id, string_view parent, string_view message);
+    //the current time, defaultAuthor() and the hash of commitDir/Manifest.txt (which has to be complete by now).
+    //throws runtime_error
+
+    static string defaultAuthor();
+    //$MINIGIT_AUTHOR, otherwise the login name
+    static string formatDate(time_t timestamp);
+    //like ctime() without the newline, what info.txt used to hold
+
+    static bool isLegacy(const filesystem::path& commitsDir);
+    //a history without TIP.txt, written by an older minigit
+    static void writeFromLegacy(const filesystem::path& commitDir, const string& id, const string& parent);
+    //builds commit.bin from an older commit's info.txt (the date is parsed back, the author is unknown).
+    //throws runtime_error
+    static void removeLegacy(const filesystem::path& commitDir);
+    static int convertLegacy(const filesystem::path& commitsDir);
+    //gives every commit of an older history its record, then writes TIP.txt and removes the text files.
+    //Nothing is removed before TIP.txt exists, so an interrupted conversion just runs again. Returns the commits
+    //converted, throws runtime_error
+
+private:
+    static const size_t INLINE_SIZE = 512;
+
+    CommitRecordHeader header;
+    char buffer[INLINE_SIZE];       // the file as read: header, author and message
+    string overflow;                // the whole file instead, only when it doesn't fit in buffer
+
+    const char* text() const;       // author followed by message
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <string>
+#include <vector>
+#include <filesystem>
+
+using namespace std;
+
+/*
+"minigit daemon" keeps one Session loaded and serves commands over the unix socket .Minivcs/daemon.sock,
+so repeated commands skip reloading the commit list, restore state, stat cache and object index.
+
+Any other minigit started in the repository forwards its arguments to the daemon if the socket exists
+(set MINIGIT_NO_DAEMON to opt out), prints whatever the daemon sends back and exits with its exit code.
+If the daemon can't be reached the command just runs locally.
+
+Requests are served one at a time under the same repository lock the CLI uses. Before each request the
+daemon checks whether another process changed HEAD, the tip of the commit list or the restore state,
+and reloads if so. A client has 2 seconds to send its request and the daemon 5 to take it on, a stalled
+client is dropped and a command the daemon doesn't get to in time runs locally.
+
+Wire format (all integers 4 byte little endian):
+    request   "MGD2", arg count, then (length, bytes) per argument
+    accept    the daemon's empty 'a' frame, answered by the client's "g". Only then does the command run
+    response  frames of (type byte, length, bytes): 'o' stdout, 'e' stderr, 'x' exit code as text (last frame)
+*/
+class Daemon {
+public:
+    static filesystem::path socketPath();
+
+    static bool forward(const vector<string>& args, int& exitCode);
+    static int serve();
+    static int stop();
+};
+
+#endif
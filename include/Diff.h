@@ -0,0 +1,35 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <ostream>
+
+using namespace std;
+
+// One step of an edit script turning the old lines into the new lines
+struct DiffEdit {
+    char type;      // ' ' unchanged, '-' only in old, '+' only in new
+    int oldLine;    // index into the old lines, -1 for '+'
+    int newLine;    // index into the new lines, -1 for '-'
+
+    DiffEdit(char t, int o, int n): type(t), oldLine(o), newLine(n) {}
+};
+
+/*
+Line based diff engine (Myers' O(ND) algorithm).
+Used by blame to carry line ownership from one version of a file to the next,
+and anywhere two versions of a file need to be compared.
+*/
+class Diff {
+public:
+    static vector<string> readLines(const filesystem::path& file);
+
+    static vector<DiffEdit> compute(const vector<string>& oldLines, const vector<string>& newLines);
+
+    static void printUnified(const vector<string>& oldLines, const vector<string>& newLines,
+                             const vector<DiffEdit>& edits, ostream& out, int context = 3);
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef FILECHANGE_H
+#define FILECHANGE_H
+
+#include <string>
+
+using namespace std;
+
+// one entry of a tree comparison (TreeDiff), also what MiniGit::changes() hands back
+struct FileChange {
+    char status;        // 'A' added, 'D' deleted, 'M' modified, 'R' renamed, 'C' copied
+    string oldPath;     // empty for 'A'
+    string newPath;     // empty for 'D'
+    int similarity;     // percent, only meaningful for 'R' and 'C'
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef FILEUTILS_H
+#define FILEUTILS_H
+
+#include <string>
+#include <filesystem>
+#include <cstdint>
+
+using namespace std;
+
+void writeFileAtomically(const filesystem::path& file, const string& contents);
+//writes to a uniquely named temporary file next to `file`, then renames it over `file`.
+//readers (including other minigit processes) see either the old contents or the new ones, never half a file.
+//throws runtime_error if the file can't be written
+
+void deferMetadataWrites(bool defer);
+bool metadataWritesDeferred();
+void writeMetadataFile(const filesystem::path& file, const string& contents);
+string readMetadataFile(const filesystem::path& file);
+void flushMetadataWrites();
+//small pointer files (HEAD.txt, TAIL.txt, TIP.txt) go through writeMetadataFile.
+//normally that is just writeFileAtomically, but while writes are deferred (batch mode) they are kept in memory
+//and only the last version of each file is written by flushMetadataWrites, in the order they were last changed.
+//readMetadataFile returns the first line of the file ("NA" if it doesn't exist) and sees pending writes
+
+void suppressWrites(bool suppress);
+bool writesSuppressed();
+//set while a read-only command runs without the repository lock (see MiniGit::execute). What a read normally leaves
+//behind to save work next time (an older commit's Manifest.txt, path filters, the commit graph, the stat and blame
+//caches, a first restore state) then stays in memory, since a writer may be replacing those files right now
+
+void copyToDescriptor(int in, int out, uintmax_t size);
+//copies size bytes from in's current offset to out (a file, pipe or socket). On linux this is sendfile(), so the
+//bytes never pass through this process, otherwise (or where the kernel refuses) a read/write loop.
+//throws runtime_error if either side fails or in ends early
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef FSCK_H
+#define FSCK_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <filesystem>
+#include <cstdint>
+#include "Repository.h"
+
+using namespace std;
+
+struct FsckResult {
+    int commits = 0;        // commits in the history
+    int files = 0;          // Data files and stash objects checked
+    uintmax_t bytes = 0;    // read while hashing them
+    int errors = 0;         // data that is missing, damaged or unreachable because of a broken link
+    int warnings = 0;       // things that are off but lose nothing (leftover folders, a missing manifest ...)
+
+    int exitCode() const {
+        return errors ? 2 : warnings ? 1 : 0;
+    }
+};
+
+/*
+minigit fsck: checks everything the repository stores, without changing any of it.
+
+    metadata => every commit folder's commit.bin (it has to name its own folder and the hash of its Manifest.txt),
+                Data and Manifest.txt are read on all cores, then the list is followed back from TIP.txt in memory:
+                every parent has to exist, without cycles, ending at NA after the commit TAIL.txt names.
+                HEAD.txt and the undo/redo targets have to be in that history.
+    content  => every file of every commit is compared with its manifest entry: it must exist, have the recorded
+                size and (unless --quick) hash to the recorded content hash. Same for the objects stashes use.
+                Files are hashed on all cores, a few hundred commits at a time so memory stays bounded
+                however long the history is.
+
+Problems are printed sorted by commit, errors in red and warnings in yellow. The exit code is made for cron:
+0 nothing wrong, 1 only warnings, 2 errors.
+*/
+class Fsck {
+private:
+    struct Problem {
+        bool error;
+        string subject;     // commit ID, file ... what it's about
+        string message;
+    };
+
+    Repository* repo;
+    filesystem::path vcsRoot;
+    filesystem::path sharedRoot;    // objects and stash, the main worktree's
+    filesystem::path commitsDir;
+
+    mutex problemsLock;
+    vector<Problem> problems;
+
+    void report(bool error, const string& subject, const string& message);
+    vector<string> checkHistory(FsckResult& result);
+    void checkContents(const vector<string>& history, bool quick, FsckResult& result);
+    void checkStashes(bool quick, FsckResult& result);
+
+public:
+    Fsck(Repository* repository);
+
+    FsckResult run(bool quick);
+};
+
+#endif
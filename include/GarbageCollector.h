@@ -0,0 +1,64 @@
+#ifndef GARBAGECOLLECTOR_H
+#define GARBAGECOLLECTOR_H
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <filesystem>
+#include <cstdint>
+#include "Repository.h"
+#include "Restore.h"
+
+using namespace std;
+
+struct GcResult {
+    int commits = 0;        // commit folders nothing refers to (a commit that failed half way, a crashed transfer)
+    int objects = 0;        // object store entries no stash uses any more
+    int cacheEntries = 0;   // blame cache files for commits that are gone
+    int temporary = 0;      // leftover .tmp / .incoming files and folders
+    int spared = 0;         // garbage still inside the grace period, left for next time
+    uintmax_t bytes = 0;    // freed (files that had no other hardlink)
+};
+
+/*
+minigit gc: mark and sweep over .Minivcs.
+
+    mark  => everything reachable is live: every commit in the list (TAIL .. tip), plus any commit ID named by
+             HEAD.txt, restore_state.txt / restore_journal.txt (undo and redo targets) and stash info files, every
+             object a stash manifest uses, and blame cache entries whose commits are all live.
+    sweep => the rest of commits/, objects/, cache/blame and any leftover temporary files is deleted.
+
+Stash manifests and blame cache files are read, and garbage deleted, on all cores (runOnWorkers).
+Anything modified less than graceMinutes ago is spared even when unreachable, so a writer that doesn't hold the
+repository lock (or a commit being assembled right now) can't lose its data. gc itself runs under the exclusive lock.
+Afterwards the restore journal is compacted into a fresh restore_state.txt.
+
+autoCollect() is called after write commands. At most once an hour it counts loose entries (folders in commits/ nothing
+refers to, objects while no stash exists) and runs gc when there are more than MINIGIT_GC_AUTO
+(default 256, 0 turns it off).
+*/
+class GarbageCollector {
+private:
+    Repository* repo;
+    Restore* restore;
+
+    filesystem::path vcsRoot;
+    filesystem::path sharedRoot;    // objects, stash and cache, the main worktree's
+    filesystem::path commitsDir;
+
+    unordered_set<string> liveCommits() const;
+
+public:
+    static const int DEFAULT_GRACE_MINUTES = 60;
+
+    GarbageCollector(Repository* repository, Restore* restoreState);
+    //the commit list is always loaded fresh from disk, never taken from a session that might be behind
+
+    GcResult collect(int graceMinutes, bool dryRun);
+    //dryRun counts what would go without deleting anything
+
+    bool autoCollect();
+    //returns true if it ran gc
+};
+
+#endif
@@ -2,16 +2,19 @@
 #define HASHTABLE_H
 
 #include <string>
+#include <string_view>
+#include <memory_resource>
 #include "CommitNode.h"
 
 using namespace std;
 
+// the key is a view of the node's own commit ID, so inserting doesn't copy the ID again
 struct ChainNode {
-    string commitID;
+    string_view commitID;
     CommitNode* commitNodePtr;
     ChainNode* next;
 
-    ChainNode(const string& id, CommitNode* ptr): commitID(id), commitNodePtr(ptr), next(nullptr) {}
+    ChainNode(string_view id, CommitNode* ptr): commitID(id), commitNodePtr(ptr), next(nullptr) {}
 };
 
 class HashTable {
@@ -20,25 +23,33 @@ private:
     int tableSize;
     int numElements;
     double loadFactorThreshold;
+    pmr::memory_resource* memory;       // chain nodes and bucket arrays (CommitManager passes its arena)
 
-    int hashFunction(const string& commitID) const;
+    int hashFunction(string_view commitID) const;
 
     void resize();
+    void rehash(int newSize);
+    ChainNode** newBuckets(int size);
+    void freeBuckets(ChainNode** buckets, int size);
 
-    void insertIntoTable(ChainNode** targetTable, int targetSize, const string& commitID, CommitNode* nodePtr);
+    void insertIntoTable(ChainNode** targetTable, int targetSize, CommitNode* nodePtr);
 
 public:
-    HashTable(int initialSize = 50);
+    HashTable(int initialSize = 50, pmr::memory_resource* resource = pmr::new_delete_resource());
 
     ~HashTable();
 
-    void insert(const string& commitID, CommitNode* nodePtr);
+    void insert(CommitNode* nodePtr);
+    //keyed by nodePtr's commit ID, the node has to stay alive while it's in the table
 
-    CommitNode* search(const string& commitID) const;
+    void reserve(int expected);
+    //grows the table once up front instead of doubling over and over while a known number of commits goes in
 
-    bool exists(const string& commitID) const;
+    CommitNode* search(string_view commitID) const;
 
-    bool remove(const string& commitID);
+    bool exists(string_view commitID) const;
+
+    bool remove(string_view commitID);
 
     double getLoadFactor() const;
 
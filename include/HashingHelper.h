@@ -2,6 +2,8 @@
 #define HASHINGHELPER_H
 
 #include <string>
+#include <cstdint>
+#include <filesystem>
 using namespace std;
 
 string generateCommitID(const string& data = "");
@@ -11,4 +13,16 @@ string generateCommitID(const string& data = "");
 
 //this header file is just to keep code organized and make inclusion in main easier
 
-#endif
\ No newline at end of file
+uint64_t hashString(const string& data);
+//FNV-1a of a string, used for anything that needs a number (bloom filters, sketches)
+
+string hashFileContents(const filesystem::path& path);
+//FNV-1a of a file's bytes, streamed in chunks, returned as 16 hex characters like commit IDs
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+uint64_t hashUpdate(uint64_t state, const char* data, size_t length);
+string formatHash(uint64_t state);
+//the same content hash fed piece by piece: start from FNV_OFFSET, call hashUpdate for every chunk in order,
+//formatHash gives exactly what hashFileContents would have returned for the whole file
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+
+using namespace std;
+
+struct LayoutMigration {
+    int commits = 0;        // folders moved into their shard
+    int objects = 0;
+};
+
+/*
+Where commit folders and stored objects live on disk.
+
+    flat    => .Minivcs/commits/<id>/ and .Minivcs/objects/<hash>, what older repositories have
+    sharded => .Minivcs/commits/<first two characters>/<id>/ and .Minivcs/objects/<first two>/<hash>
+
+With hundreds of thousands of commits a single folder gets slow to look things up in and to list (ext4's hashed
+directories degrade, NFS lists the whole thing); sharded keeps every folder at 1/256th of that. New repositories
+are sharded, `minigit migrate-layout` moves an existing one in place.
+
+The layout is recorded in commits/LAYOUT.txt ("sharded", or "migrating" while a migration runs, no file = flat),
+read once per commits folder and remembered until forget() (a long lived session calls it when it reloads). While migrating, a lookup that doesn't find the sharded folder falls
+back to the flat one, so a migration that was interrupted leaves a working repository and can simply be run again.
+
+Every path to a commit folder or an object goes through here, commitsDir/objectsDir name the repository
+(Transfer works with two of them at once).
+*/
+class Layout {
+public:
+    static filesystem::path commitDir(const filesystem::path& commitsDir, string_view commitID);
+
+    static filesystem::path objectPath(const filesystem::path& objectsDir, string_view hash);
+    //objectsDir is <vcsRoot>/objects, the layout comes from the commits folder next to it
+
+    static bool isSharded(const filesystem::path& commitsDir);
+    static void setSharded(const filesystem::path& commitsDir);
+    //marks a new (empty) repository as sharded
+    static void forget(const filesystem::path& commitsDir);
+    //drops the remembered layout, the next lookup reads LAYOUT.txt again (another process may have migrated)
+
+    static vector<filesystem::path> commitFolders(const filesystem::path& commitsDir);
+    static vector<filesystem::path> objectFiles(const filesystem::path& objectsDir);
+    //everything stored, in either layout. Temporary entries (".incoming-...", "*.tmp") aren't included
+
+    static vector<filesystem::path> temporaries(const filesystem::path& dir);
+    //just those temporary entries, at the top or inside a shard (gc deletes them)
+
+    static LayoutMigration migrate(const filesystem::path& vcsRoot);
+    //moves every flat commit folder and object into its shard, throws runtime_error (running it again continues)
+};
+
+#endif
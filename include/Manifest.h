@@ -0,0 +1,53 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <filesystem>
+#include <cstdint>
+
+using namespace std;
+
+class StatCache;
+
+// One file inside a commit's Data folder
+struct ManifestEntry {
+    string hash;        // hashFileContents() of the file
+    uintmax_t size;
+
+    ManifestEntry(): size(0) {}
+    ManifestEntry(const string& h, uintmax_t s): hash(h), size(s) {}
+};
+
+/*
+A manifest is the list of every file in a commit's Data folder along with its content hash.
+It is saved as Manifest.txt inside the commit folder, one "<hash> <size> <path>" line per file,
+so comparing two commits never needs to open the files themselves.
+Paths are stored relative to Data with '/' separators.
+*/
+class Manifest {
+private:
+    map<string, ManifestEntry> entries;   // sorted by path so directory prefixes are contiguous
+
+public:
+    Manifest();
+
+    static Manifest build(const filesystem::path& dataDir);
+    static Manifest forCommit(const filesystem::path& commitsDir, string_view commitID);
+    static Manifest scanWorkingTree(const filesystem::path& root, StatCache& cache);
+    static string normalizePath(const string& userPath, const filesystem::path& root);
+
+    bool load(const filesystem::path& file);
+    void save(const filesystem::path& file) const;
+
+    void add(const string& path, const ManifestEntry& entry);
+    const ManifestEntry* find(const string& path) const;
+    bool touches(const Manifest& parent, const string& path) const;
+    vector<string> changedPaths(const Manifest& parent) const;
+
+    const map<string, ManifestEntry>& getEntries() const;
+    int size() const;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef MINIGIT_H
+#define MINIGIT_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include <ostream>
+#include "FileChange.h"
+
+using namespace std;
+
+/*
+libminigit: the public API for using minigit from inside another program instead of running the binary.
+
+Every call returns a MiniGitResult. Nothing is printed: the engine writes its messages into buffers of the call,
+and on failure the error text (without colors) ends up in result.message.
+The numeric values of MiniGitError are part of the API, new codes only ever get added at the end.
+
+    MiniGit repo("/srv/artifacts");
+    CommitInfo created;
+    if (repo.addAll().ok() && repo.commit("nightly build", &created).ok()) { ... created.id ... }
+
+Each call takes the repository lock (shared for reads, exclusive for writes) like the CLI does, so it's safe
+to use alongside minigit processes and daemons on the same repository. The loaded commit list is kept between
+calls and reloaded only when another process changed the repository.
+
+execute() runs any command the way the minigit binary does (the binary itself goes through it), printing to the
+streams it's given.
+
+The engine works under the repository root and prints only to the streams a call hands it, so the host's working
+directory and cout/cerr are never touched. The I/O backend and deferred metadata writes are process wide though,
+so calls (from any MiniGit object, on any thread) are still serialized.
+*/
+
+enum MiniGitError {
+    MG_OK = 0,
+    MG_NOT_A_REPOSITORY = 1,
+    MG_ALREADY_INITIALIZED = 2,
+    MG_INVALID_ARGUMENT = 3,
+    MG_PATH_NOT_FOUND = 4,
+    MG_COMMIT_NOT_FOUND = 5,
+    MG_NOTHING_TO_UNDO = 6,
+    MG_NOTHING_TO_REDO = 7,
+    MG_IO_ERROR = 8
+};
+
+struct MiniGitResult {
+    MiniGitError error;
+    string message;     // empty on success
+
+    bool ok() const { return error == MG_OK; }
+};
+
+struct CommitInfo {
+    string id;
+    string message;
+    string date;        // the commit's timestamp, formatted like ctime
+    string parentID;    // "NA" for the first commit
+};
+
+struct RestoreInfo {
+    string current;     // commit the working tree was last checked out at
+    string undoTarget;  // "NA" when there's nothing to undo
+    string redoTarget;  // "NA" when there's nothing to redo
+    int undoDepth;
+    int redoDepth;
+};
+
+class Session;
+
+class MiniGit {
+private:
+    filesystem::path root;
+    unique_ptr<Session> session;
+    string sessionStamp;
+
+    template <typename Body>
+    MiniGitResult run(bool writes, Body body);
+    Session& attach(ostream& out, ostream& err);
+    void detach();
+
+public:
+    explicit MiniGit(const filesystem::path& repositoryRoot);
+    ~MiniGit();
+
+    MiniGit(const MiniGit&) = delete;
+    MiniGit& operator=(const MiniGit&) = delete;
+
+    static const char* errorName(MiniGitError error);
+
+    MiniGitResult init();
+    MiniGitResult add(const vector<string>& paths);         // paths relative to the repository root
+    MiniGitResult addAll();
+    MiniGitResult commit(const string& message, CommitInfo* created = nullptr);
+    MiniGitResult revert(const string& commitID, CommitInfo* created = nullptr);
+    MiniGitResult undo(string* checkedOut = nullptr);
+    MiniGitResult redo(string* checkedOut = nullptr);
+
+    MiniGitResult head(string& commitID);
+    MiniGitResult log(vector<CommitInfo>& commits, const string& path = "");   // newest first, optionally only commits touching path
+    MiniGitResult changes(vector<FileChange>& out, const string& fromCommit = "", const string& toCommit = "");
+    //fromCommit defaults to HEAD, an empty toCommit means the working tree
+    MiniGitResult restoreState(RestoreInfo& out);
+
+    int execute(const vector<string>& args, ostream& out, ostream& err);
+    //args like the command line without "minigit" ({"log", "--", "src"}), returns the exit code the binary would.
+    //Takes no lock for reads a current commit-graph snapshot can answer. init, clone, batch and daemon aren't
+    //commands of an existing repository and exit with 1
+};
+
+#endif
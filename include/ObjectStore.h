@@ -0,0 +1,36 @@
+#ifndef OBJECTSTORE_H
+#define OBJECTSTORE_H
+
+#include <string>
+#include <filesystem>
+#include <unordered_set>
+
+using namespace std;
+
+/*
+Content addressed file storage in .Minivcs/objects/<content hash>.
+A file is stored once no matter how many stashes (or anything else) refer to it.
+
+Files that already live in a commit's Data folder never change, so adopt() hardlinks them into the store
+instead of copying, which makes storing an unchanged file free. Everything else is copied with store().
+Objects are never modified once written, callers must copy them out rather than link to them.
+Hashes we've already seen on disk are remembered, so a long lived store (the daemon's) answers has() from memory.
+*/
+class ObjectStore {
+private:
+    filesystem::path objectsDir;
+    mutable unordered_set<string> known;
+
+public:
+    ObjectStore(const filesystem::path& vcsRoot);
+
+    bool has(const string& hash) const;
+    filesystem::path pathFor(const string& hash) const;
+
+    uintmax_t store(const filesystem::path& source, const string& hash);
+    uintmax_t adopt(const filesystem::path& committedFile, const string& hash);
+
+    void copyOut(const string& hash, const filesystem::path& dest) const;
+};
+
+#endif
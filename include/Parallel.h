@@ -0,0 +1,47 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include "Trace.h"
+
+using namespace std;
+
+/*
+runOnWorkers(count, workers, name, work) calls work(i) for every i below count, spread over up to `workers` threads
+(the calling thread is one of them). Workers take the next index from a shared counter, so one slow item doesn't hold
+up a whole share of the list. Small lists run on the calling thread, starting threads would cost more than it saves.
+work must be safe to call from several threads at once.
+*/
+const size_t INLINE_LIMIT = 16;
+
+template <typename Work>
+void runOnWorkers(size_t count, unsigned workers, const char* threadName, Work work) {
+    atomic<size_t> next(0);
+    auto loop = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            work(i);
+        }
+    };
+
+    if (count <= INLINE_LIMIT) {
+        loop();
+        return;
+    }
+
+    vector<thread> threads;
+    for (unsigned t = 1; t < workers && t < count; t++) {
+        threads.emplace_back([&]() {
+            Trace::setThreadName(threadName);
+            loop();
+        });
+    }
+    loop();
+    for (thread& t : threads) {
+        t.join();
+    }
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef RENAMEDETECTOR_H
+#define RENAMEDETECTOR_H
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <cstdint>
+#include "Manifest.h"
+
+using namespace std;
+
+struct RenamePair {
+    string oldPath;
+    string newPath;
+    int similarity;     // percent
+    bool copy;          // true if the old path still exists (or was already claimed by another rename)
+};
+
+/*
+Pairs deleted/added files between two trees so moves show up as renames instead of delete + add.
+
+    -Exact renames and copies are matched through the manifests' content hashes, O(files) with a hash map.
+    -Near renames use MinHash sketches: every file is reduced to SKETCH_SIZE minimum hashes of its lines,
+     and the fraction of matching minimums estimates how similar two files are.
+     Sketches are split into BANDS buckets (locality sensitive hashing), only files sharing a bucket
+     are ever compared, so we never do added x deleted full comparisons even when thousands of files move.
+*/
+class RenameDetector {
+private:
+    static const int SKETCH_SIZE = 64;
+    static const int BANDS = 16;
+
+    int minSimilarity;
+
+    vector<uint64_t> sketch(const filesystem::path& file) const;
+
+public:
+    RenameDetector(int minSimilarityPercent = 50);
+
+    vector<RenamePair> detect(const Manifest& oldTree, const filesystem::path& oldRoot,
+                              const Manifest& newTree, const filesystem::path& newRoot,
+                              const vector<string>& deleted, const vector<string>& added,
+                              const vector<string>& modified) const;
+};
+
+#endif
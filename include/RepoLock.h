@@ -0,0 +1,44 @@
+#ifndef REPOLOCK_H
+#define REPOLOCK_H
+
+#include <filesystem>
+#include <iostream>
+
+using namespace std;
+
+/*
+Repository wide lock on .Minivcs/lock so two minigit processes can't write HEAD.txt / TIP.txt at once.
+
+    Exclusive => commands that change the repository (add, commit, revert, undo, redo, stash push/pop ...)
+    Shared    => read-only commands, any number of them can hold it together
+
+Uses flock() on linux/mac and LockFileEx() on windows. The lock is released by the destructor,
+and by the OS if the process dies, so a crashed minigit never leaves the repository locked.
+*/
+class RepoLock {
+public:
+    enum Mode { Shared, Exclusive };
+
+private:
+#ifdef _WIN32
+    void* handle;
+#else
+    int fd;
+#endif
+    bool held;
+    bool busy;
+
+public:
+    RepoLock(const filesystem::path& vcsRoot, Mode mode, bool wait = true, ostream& warnings = cerr);
+    //with wait = false it returns straight away, isBusy() says whether another process had the lock. A lock
+    //that can't be taken is reported on warnings
+    ~RepoLock();
+
+    RepoLock(const RepoLock&) = delete;
+    RepoLock& operator=(const RepoLock&) = delete;
+
+    bool isHeld() const;
+    bool isBusy() const;
+};
+
+#endif
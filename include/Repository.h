@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <ostream>
+#include "BulkIO.h"
 
 using namespace std;
 
@@ -18,37 +20,59 @@ using namespace std;
 
 namespace fs =   filesystem;
 
+class SparseCheckout;
+
+/*
+Everything works under root, never the process's current directory, and messages go to out()/err() (cout/cerr
+unless setOutput() says otherwise), so a library host can run repositories side by side without its own working
+directory or streams being touched.
+*/
 class Repository {
 private:
+    fs::path root;           // the working tree
     fs::path vcsRoot;        // .Minivcs/
+    fs::path sharedRoot;     // the main worktree's .Minivcs/ (commits, objects, stash, cache, lock), vcsRoot itself there
     fs::path stagingArea;    // .Minivcs/staging_area/
     fs::path commitsDir;     // .Minivcs/commits/
-    fs::path headFile;       // .Minivcs/HEAD.txt
+    fs::path headFile;       // .Minivcs/commits/HEAD.txt (.Minivcs/HEAD.txt in a linked worktree)
+    ostream* outStream;
+    ostream* errStream;
     
     // Helper functions
-    void addSingleFile(const   string& filepath);
+    void addSingleFile(const   string& filepath, vector<CopyJob>& jobs, const SparseCheckout& sparse);
     bool isVcsDirectory(const fs::path& path) const;
-    void copyRecursive(const fs::path& src, const fs::path& dest);
+    void copyRecursive(const fs::path& src, const fs::path& dest, vector<CopyJob>& jobs, const SparseCheckout& sparse);
 
 public:
-    Repository();
+    explicit Repository(const fs::path& root = fs::current_path());
     
     void init();
-    void add(const   vector<  string>& files);
-    void addAll();
+    int add(const   vector<  string>& files);    // returns how many files couldn't be added
+    int addAll();
     void checkout(const   string& commitID);
+    int restorePaths(const string& commitID, const vector<string>& paths);    // returns how many paths couldn't be restored
+    fs::path pathInCommit(const string& commitID, const string& path) const;
     
     bool isInitialized() const;
     void clearStaging();
       vector<  string> getStagedFiles() const;
     bool isStagingEmpty() const;
     
+    fs::path getRoot() const;
     fs::path getVcsRoot() const;
+    fs::path getSharedRoot() const;
     fs::path getStagingArea() const;
     fs::path getCommitsDir() const;
+    static fs::path headFileFor(const fs::path& vcsRoot);
+    //the checked out commit: commits/HEAD.txt, or .Minivcs/HEAD.txt in a linked worktree (Worktree.h)
     
       string getHead() const;
     void setHead(const   string& commitID);
+
+    ostream& out() const;
+    ostream& err() const;
+    void setOutput(ostream& out, ostream& err);
+    //where this repository's commands print, the streams have to outlive their use
 };
 
 #endif
\ No newline at end of file
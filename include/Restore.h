@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 #include <iostream>
 #include <stdexcept>
 #include "CommitManager.h"
@@ -12,9 +13,10 @@
 
 using namespace std;
 
+// deque instead of vector so a bounded stack can drop its oldest entry in O(1)
 class Stack {
 public:
-    vector<string> data;
+    deque<string> data;
     int  top;
 
     Stack() :  top(-1) {}
@@ -48,15 +50,59 @@ public:
         }
         return data[ top];
     }
+
+    void dropBottom() {
+        if (isEmpty()) {
+            throw out_of_range("Stack underflow");
+        }
+        data.pop_front();
+        -- top;
+    }
+
+    void clear() {
+        data.clear();
+        top = -1;
+    }
 };
 
+/*
+Undo/redo state is persisted in two files inside .Minivcs:
+    restore_state.txt    => snapshot of the current commit and both stacks (the original format, plus a GENERATION line)
+    restore_journal.txt  => every operation since that snapshot, one appended line each (COMMIT:<id>, UNDO:<id>, REDO:<id>, CLEAR)
+
+Each operation only appends one line, so it costs O(1) I/O however long the history is.
+Loading reads the snapshot and replays the journal. Once the journal reaches JOURNAL_COMPACT_LIMIT entries
+we write a fresh snapshot and start a new journal, which keeps loading bounded too.
+The journal starts with the generation of the snapshot it belongs to, so if we crash between writing
+a new snapshot and resetting the journal, the old journal is ignored instead of being applied twice.
+
+While metadata writes are deferred (see FileUtils.h) journal lines are buffered in memory and
+flushJournal() appends them in one write, or compacts straight away if they'd push the journal past the limit.
+
+MINIGIT_UNDO_DEPTH limits how many entries each stack keeps, the oldest ones are dropped first.
+*/
 class Restore {
 private:
+    static const int JOURNAL_COMPACT_LIMIT = 1024;
+
     Stack undoStack;
     Stack redoStack;
     Repository* repo;
     string currentCommitID;
 
+    int maxDepth;           // 0 = unbounded
+    long generation;
+    int journalEntries;
+    string pendingJournal;  // entries held back while metadata writes are deferred (batch mode)
+    int pendingEntries;
+
+    void applyCommit(const string& commitID);
+    void applyUndo();
+    void applyRedo();
+    void applyClear();
+    void enforceDepth(Stack& stack);
+    void appendToJournal(const string& entry);
+
 public:
     Restore(Repository* repository);
     ~Restore();
@@ -75,8 +121,10 @@ public:
     int getRedoStackSize() const;
     void printStatus() const;
     void viewHistory(CommitNode* head) const;
-    void saveStateToDisk() const;
+    void setMaxDepth(int depth);
+    void saveStateToDisk();
     void loadStateFromDisk();
+    void flushJournal();
 };
 
 
@@ -0,0 +1,55 @@
+#ifndef SPARSECHECKOUT_H
+#define SPARSECHECKOUT_H
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "Manifest.h"
+
+using namespace std;
+
+/*
+Sparse checkout, cone mode: the working tree only holds some directories of each commit.
+
+The cones are directory prefixes kept in .Minivcs/sparse-checkout.txt, one per line. A file is checked out if
+    -it is at the top level, or
+    -it is anywhere under a cone, or
+    -it sits directly in a directory on the way down to a cone (for cone "services/api" that's the files in
+     "services/" itself, but not "services/web/...")
+No file (or an empty one) means everything is checked out, exactly like before.
+
+What uses it:
+    checkout / revert => copyTree skips excluded directories without listing them, so time and disk scale with the cones
+    status / diff     => scanWorkingTree never enters excluded directories, and visible() drops them from the commit
+                         side so they don't show up as deleted
+    add               => refuses paths outside the cones, directories are walked inside the cones only
+    commit            => the working tree only has the cones, so carryOver() hardlinks everything else from the
+                         checked out commit into the new one (no file contents are read or copied)
+*/
+class SparseCheckout {
+private:
+    vector<string> cones;       // normalized directory paths, no trailing '/'
+
+public:
+    static SparseCheckout load(const filesystem::path& root);
+    void save(const filesystem::path& root) const;
+    //root is the working tree, the cones live in root/.Minivcs/sparse-checkout.txt. save() with no cones disables it
+
+    bool isEnabled() const;
+    const vector<string>& getCones() const;
+    void setCones(const vector<string>& directories, const filesystem::path& root);
+    //directories as typed, relative to (or absolute under) the working tree root
+
+    bool includesFile(const string& path) const;
+    bool includesDirectory(const string& path) const;
+    //paths relative to the working tree with '/' separators. A directory is included if anything in it can be
+
+    Manifest visible(Manifest tree) const;
+    //the part of a commit's manifest that's checked out (the whole manifest when sparse checkout is off)
+
+    int carryOver(const filesystem::path& commitsDir, const string& fromCommit, const string& toCommit) const;
+    //hardlinks fromCommit's excluded files into toCommit (falling back to a copy) unless toCommit already has them,
+    //and adds them to its manifest. Returns how many files were carried over
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstddef>
+
+using namespace std;
+
+/*
+Bounded single producer / single consumer queue (ring buffer), used to connect the stages of the commit pipeline.
+
+No locks: the producer only moves tail, the consumer only moves head, and each reads the other's index with
+acquire ordering so the slot contents are visible before the index that publishes them.
+Capacity is rounded up to a power of two so wrapping is a mask. One slot stays empty to tell full from empty.
+
+push/pop wait while the queue is full/empty, that's the backpressure: a fast stage can only run
+capacity items ahead of a slow one. They spin briefly (multi-core machines only), then yield, then sleep in short steps, and give up
+(return false) once `abort` is set so a failing stage can stop the whole pipeline.
+*/
+template <typename T>
+class SpscQueue {
+private:
+    vector<T> slots;
+    size_t mask;
+
+    alignas(64) atomic<size_t> head;    // next slot to read, written by the consumer
+    alignas(64) atomic<size_t> tail;    // next slot to write, written by the producer
+
+    static void backoff(int& attempt) {
+        // on a single core spinning only delays the thread we're waiting for
+        static const int spins = thread::hardware_concurrency() > 1 ? 64 : 0;
+
+        if (attempt < spins) {
+            // busy wait, the other side is usually only a moment behind
+        } else if (attempt < 128) {
+            this_thread::yield();
+        } else {
+            this_thread::sleep_for(chrono::microseconds(50));
+        }
+        attempt++;
+    }
+
+public:
+    explicit SpscQueue(size_t capacity) : head(0), tail(0) {
+        size_t size = 2;
+        while (size < capacity + 1) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool tryPush(T& value) {
+        size_t t = tail.load(memory_order_relaxed);
+        size_t next = (t + 1) & mask;
+        if (next == head.load(memory_order_acquire)) {
+            return false;
+        }
+        slots[t] = move(value);
+        tail.store(next, memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& out) {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire)) {
+            return false;
+        }
+        out = move(slots[h]);
+        head.store((h + 1) & mask, memory_order_release);
+        return true;
+    }
+
+    bool push(T value, const atomic<bool>& abort) {
+        for (int attempt = 0; !tryPush(value); ) {
+            if (abort.load(memory_order_relaxed)) {
+                return false;
+            }
+            backoff(attempt);
+        }
+        return true;
+    }
+
+    bool pop(T& out, const atomic<bool>& abort) {
+        for (int attempt = 0; !tryPop(out); ) {
+            if (abort.load(memory_order_relaxed)) {
+                return false;
+            }
+            backoff(attempt);
+        }
+        return true;
+    }
+};
+
+#endif
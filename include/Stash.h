@@ -0,0 +1,44 @@
+#ifndef STASH_H
+#define STASH_H
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "Repository.h"
+#include "Manifest.h"
+#include "ObjectStore.h"
+#include "StatCache.h"
+
+using namespace std;
+
+/*
+Sets uncommitted work aside so undo/checkout can't wipe it.
+
+Each stash entry is a folder .Minivcs/stash/<number>/ holding
+    info.txt      => commit it was based on, message, date
+    worktree.txt  => manifest of the working tree
+    staging.txt   => manifest of the staging area
+The file contents themselves go into the ObjectStore. Files that are unchanged since the base commit
+are hardlinked from the commit's Data folder, so a stash only costs the bytes that were actually edited.
+
+Both push (resetting back to the base commit) and pop only write the files that differ,
+and pop refuses to overwrite files that were changed again since the stash was made.
+*/
+class Stash {
+private:
+    Repository* repo;
+    filesystem::path stashDir;
+    ObjectStore& objects;
+    StatCache& statCache;
+
+    vector<int> entries() const;
+
+public:
+    Stash(Repository* repository, ObjectStore* objectStore, StatCache* cache);
+
+    bool push(const string& message);
+    bool pop();
+    void list() const;
+};
+
+#endif
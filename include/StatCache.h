@@ -0,0 +1,45 @@
+#ifndef STATCACHE_H
+#define STATCACHE_H
+
+#include <string>
+#include <unordered_map>
+#include <filesystem>
+#include <cstdint>
+
+using namespace std;
+
+struct StatEntry {
+    uintmax_t size;
+    int64_t mtime;      // last write time in the filesystem clock's ticks
+    string hash;
+};
+
+/*
+Remembers the content hash of working tree files along with the size and modification time we saw
+when hashing them. If neither changed, the file is assumed unchanged and we skip reading it,
+so status/diff on a large tree with few edits only hashes the edited files.
+
+Saved as .Minivcs/stat_cache.txt, one "<size> <mtime> <hash> <path>" line per file.
+Files modified in the last couple of seconds are never cached, since another write in the same
+timestamp tick would be invisible to us.
+The file is only read the first time a hash is asked for, so commands that never scan the tree don't pay for it.
+*/
+class StatCache {
+private:
+    filesystem::path cacheFile;
+    unordered_map<string, StatEntry> entries;
+    bool dirty;
+    bool loaded;
+
+    void load();
+
+public:
+    StatCache(const filesystem::path& file);
+    ~StatCache();
+
+    string hashFor(const filesystem::path& fullPath, const string& key);
+    string hashFor(const filesystem::path& fullPath, const string& key, uintmax_t size, filesystem::file_time_type writeTime);
+    void save();
+};
+
+#endif
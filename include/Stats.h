@@ -0,0 +1,57 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+using namespace std;
+
+/*
+Counters for how much work a command did, printed by "minigit <command> --stats" (a table on stderr,
+--stats=json for JSON).
+
+Every thread counts into its own block, so counting is a plain load and store with no lock and no shared
+cache line. Blocks of threads that have finished (pipeline stages, io workers) are merged into a total when the
+thread exits, and total() adds the live ones on top.
+*/
+enum StatCounter {
+    STAT_FILES_STATED,
+    STAT_FILES_OPENED,
+    STAT_FILES_COPIED,
+    STAT_BYTES_READ,
+    STAT_BYTES_WRITTEN,
+    STAT_BYTES_COPIED,
+    STAT_DIRS_CREATED,
+    STAT_HASH_LOOKUPS,
+    STAT_HASH_PROBES,       // chain entries compared, so probes / lookups is the average chain walk
+    STAT_HASH_RESIZES,
+    STAT_CACHE_HITS,
+    STAT_CACHE_MISSES,
+    STAT_ARENA_CHUNKS,      // heap allocations made by command arenas (Arena.h)
+    STAT_ARENA_BYTES,
+    STAT_HEAP_ALLOCATIONS,  // every operator new, counted by debug builds of the minigit binary only
+    STAT_COUNTER_COUNT
+};
+
+struct StatBlock {
+    atomic<uint64_t> counts[STAT_COUNTER_COUNT];
+
+    StatBlock();
+    ~StatBlock();
+};
+
+namespace Stats {
+    inline void add(StatCounter counter, uint64_t amount = 1) {
+        // one block per thread; only this thread writes it, other threads only read it when printing
+        thread_local StatBlock block;
+        atomic<uint64_t>& count = block.counts[counter];
+        count.store(count.load(memory_order_relaxed) + amount, memory_order_relaxed);
+    }
+
+    const char* name(StatCounter counter);
+    uint64_t total(StatCounter counter);
+    void print(ostream& out, bool json);
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+
+using namespace std;
+
+/*
+Scoped tracing spans for finding where a slow command spends its time.
+
+    TRACE_SPAN("CommitManager::addCommit");                  // one span from here to the end of the scope
+    TRACE_SPAN_DETAIL("copy_file", source.string());        // same, with a detail string shown in the viewer
+
+Set MINIGIT_TRACE=path and every span is recorded per thread and written at exit as Chrome trace-event JSON
+(open it in Perfetto or chrome://tracing, every thread gets its own timeline). "%p" in the path is replaced
+by the process ID so a daemon and its clients don't overwrite each other's trace.
+
+Without MINIGIT_TRACE a span costs one predictable branch and the detail expression isn't even evaluated.
+Building with -DMINIGIT_NO_TRACE (CMake: -DMINIGIT_TRACING=OFF) removes the spans entirely.
+*/
+namespace Trace {
+    inline bool enabled() {
+        static const bool on = getenv("MINIGIT_TRACE") != nullptr && *getenv("MINIGIT_TRACE") != '\0';
+        return on;
+    }
+
+    uint64_t now();
+    //nanoseconds on the steady clock
+    void record(const char* name, const string& detail, uint64_t start, uint64_t end);
+    void setThreadName(const char* name);
+    //names the calling thread's timeline (pipeline stages, io workers), no-op when tracing is off
+    void flush();
+    //writes everything recorded so far; runs by itself at exit
+}
+
+class TraceSpan {
+private:
+    const char* name;
+    string detail;
+    uint64_t start;
+
+public:
+    explicit TraceSpan(const char* n) : name(n), start(Trace::enabled() ? Trace::now() : 0) {}
+    TraceSpan(const char* n, string d) : name(n), detail(move(d)), start(Trace::enabled() ? Trace::now() : 0) {}
+
+    ~TraceSpan() {
+        if (start) {
+            Trace::record(name, detail, start, Trace::now());
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef MINIGIT_NO_TRACE
+#define TRACE_SPAN(name) ((void)0)
+#define TRACE_SPAN_DETAIL(name, detail) ((void)0)
+#else
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+#define TRACE_SPAN_DETAIL(name, detail) \
+    TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name, Trace::enabled() ? string(detail) : string())
+#endif
+
+#endif
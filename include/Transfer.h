@@ -0,0 +1,55 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <string>
+#include <filesystem>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+struct TransferResult {
+    string oldTip;          // receiver's newest commit before ("NA" if it had none)
+    string newTip;          // and after
+    int commits = 0;
+    int linked = 0;         // Data files hardlinked instead of copied
+    int copied = 0;
+    uintmax_t bytesCopied = 0;
+};
+
+/*
+Moves commits between two repositories on the same machine, for clone, fetch and push.
+
+History is a single list, so the receiver can only take commits that continue its own (a fast-forward):
+
+    1. negotiate => find both tips, then walk back from the sender's tip through the parents until we reach the
+                    receiver's tip. Only commits the receiver lacks are ever opened, however long the history is.
+                    Reaching the sender's first commit without meeting it means the histories diverged: nothing moves.
+    2. transfer  => each new commit is assembled in commits/.incoming-<id> and renamed into place. Data files are
+                    hardlinked from the sender when both repositories are on one filesystem (commit data never changes
+                    after it's written). Across filesystems, files whose path and hash match the previous commit's
+                    manifest are hardlinked from the receiver's own copy, and only the rest is copied.
+    3. publish   => the receiver's TIP.txt is replaced with the sender's tip (atomic rename). That one write is
+                    what makes the commits part of the history, so a crash before it leaves the old history intact
+                    with a few unreferenced folders.
+
+Both repositories have to be locked by the caller. Throws runtime_error on diverged histories or unreadable repositories.
+*/
+class Transfer {
+public:
+    static TransferResult send(const filesystem::path& fromRoot, const filesystem::path& toRoot);
+
+    static string findTip(const filesystem::path& commitsDir);
+    //newest commit of the repository whose commits folder this is, "NA" for an empty one
+
+    static string parentOf(const filesystem::path& commitsDir, const string& id);
+    //from the commit's record, throws runtime_error if it can't be read
+
+    static bool inHistory(const filesystem::path& commitsDir, const string& tip, const string& id);
+    //whether id is tip or one of its ancestors (walks the parents, so only use it off the common path)
+
+    static void publish(const filesystem::path& commitsDir, const string& oldTip, const vector<string>& ids);
+    //step 3 for commits already renamed into place (oldest first, the first one's parent being oldTip)
+};
+
+#endif
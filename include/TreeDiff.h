@@ -0,0 +1,28 @@
+#ifndef TREEDIFF_H
+#define TREEDIFF_H
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <ostream>
+#include "Manifest.h"
+#include "FileChange.h"
+
+using namespace std;
+
+/*
+Compares two trees (commit snapshots or the working directory) through their manifests,
+then runs rename/copy detection over what was added and deleted.
+Used by diff, status and log --name-status.
+*/
+class TreeDiff {
+public:
+    static vector<FileChange> compare(const Manifest& oldTree, const filesystem::path& oldRoot,
+                                      const Manifest& newTree, const filesystem::path& newRoot);
+
+    static void printNameStatus(const vector<FileChange>& changes, ostream& out);
+    static void printPatch(const vector<FileChange>& changes,
+                           const filesystem::path& oldRoot, const filesystem::path& newRoot, ostream& out);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef WORKTREE_H
+#define WORKTREE_H
+
+#include <string>
+#include <vector>
+#include <filesystem>
+
+using namespace std;
+
+struct WorktreeInfo {
+    filesystem::path root;      // the working directory
+    string head;                // its checked out commit
+    bool main;
+    bool missing;               // listed but its folder is gone (remove cleans it up)
+};
+
+/*
+Linked worktrees: more working directories for the same repository, each with its own commit checked out.
+
+A linked worktree has its own .Minivcs folder, but only for what belongs to that working directory:
+
+    .Minivcs/
+        |->HEAD.txt          => the commit checked out here (the main worktree's stays in commits/HEAD.txt)
+        |->worktree.txt      => "MAIN:<path>" of the repository it belongs to, this is what makes it a linked worktree
+        |->staging_area/     => its own staging area, restore state, stat cache and sparse checkout
+        |->commits  -> <main>/.Minivcs/commits      (symlinks: history and stored files are shared,
+        |->objects  -> <main>/.Minivcs/objects       so a worktree only costs its checked out files)
+        |->stash    -> <main>/.Minivcs/stash
+        |->cache    -> <main>/.Minivcs/cache
+        |->lock     -> <main>/.Minivcs/lock          (one repository lock for all of them)
+
+The shared parts are found through worktree.txt (mainVcsRoot(), Repository::getSharedRoot() and RepoLock), the
+symlinks are only there for people looking around. Where they can't be created (windows without the symlink
+privilege) a worktree has none and works the same.
+The main worktree lists the linked ones in .Minivcs/worktrees.txt (one path per line), which gc reads so commits
+checked out (or in the undo/redo history of) any worktree are kept.
+*/
+class Worktree {
+public:
+    static bool isLinked(const filesystem::path& vcsRoot);
+    static filesystem::path mainVcsRoot(const filesystem::path& vcsRoot);
+    //the main worktree's .Minivcs, from any worktree's
+
+    static vector<WorktreeInfo> list(const filesystem::path& vcsRoot);
+    //the main worktree first, then the linked ones in the order they were added
+
+    static void add(const filesystem::path& vcsRoot, const filesystem::path& dest, const string& commitID);
+    //creates dest/.Minivcs (dest must not exist or be empty) and registers it. The caller checks the commit out there.
+    //throws runtime_error
+
+    static void remove(const filesystem::path& vcsRoot, const filesystem::path& dest);
+    //deletes the linked worktree's folder and unregisters it. throws runtime_error if it isn't one
+};
+
+#endif
@@ -0,0 +1,423 @@
+#include "Archive.h"
+#include "Manifest.h"
+#include "FileUtils.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "Layout.h"
+#include "CommitRecord.h"
+#include <filesystem>
+#include <vector>
+#include <set>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef MINIGIT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+using namespace std;
+
+static const size_t BLOCK = 512;
+static const size_t CHUNK_SIZE = 256 * 1024;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// SINKS
+// Where the tar bytes go. Headers and padding are written, file contents are handed over as an open fd
+//----------------------------------------------------------------------------------------------------------------------------
+
+class ArchiveSink {
+public:
+    virtual ~ArchiveSink() {}
+    virtual void write(const char* data, size_t length) = 0;
+    virtual void writeFile(int fd, uintmax_t size) = 0;
+    virtual void finish() = 0;
+};
+
+class RawSink : public ArchiveSink {
+private:
+    int out;
+
+public:
+    explicit RawSink(int fd) : out(fd) {}
+
+    void write(const char* data, size_t length) override {
+        Stats::add(STAT_BYTES_WRITTEN, length);
+        while (length > 0) {
+            ssize_t n = ::write(out, data, length);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                throw runtime_error(string("could not write the archive: ") + strerror(errno));
+            }
+            data += n;
+            length -= n;
+        }
+    }
+
+    // sendfile where it can, file contents go from the page cache to the output without passing through here
+    void writeFile(int fd, uintmax_t size) override {
+        copyToDescriptor(fd, out, size);
+    }
+
+    void finish() override {
+    }
+};
+
+// reads file contents into a buffer and hands them to write(), for sinks that can't take an fd
+static void copyThrough(ArchiveSink& sink, vector<char>& buffer, int fd, uintmax_t size) {
+    uintmax_t left = size;
+    while (left > 0) {
+        ssize_t n = ::read(fd, buffer.data(), min<uintmax_t>(left, buffer.size()));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw runtime_error("a file changed size while it was being archived");
+        }
+        sink.write(buffer.data(), n);
+        Stats::add(STAT_BYTES_READ, n);
+        left -= n;
+    }
+}
+
+// a library caller's stream ("-" when the output isn't cout), bytes go through the stream instead of fd 1
+class StreamSink : public ArchiveSink {
+private:
+    ostream& out;
+    vector<char> buffer;
+
+public:
+    explicit StreamSink(ostream& stream) : out(stream), buffer(CHUNK_SIZE) {}
+
+    void write(const char* data, size_t length) override {
+        Stats::add(STAT_BYTES_WRITTEN, length);
+        if (!out.write(data, length)) {
+            throw runtime_error("could not write the archive to the output stream");
+        }
+    }
+
+    void writeFile(int fd, uintmax_t size) override {
+        copyThrough(*this, buffer, fd, size);
+    }
+
+    void finish() override {
+        if (!out.flush()) {
+            throw runtime_error("could not write the archive to the output stream");
+        }
+    }
+};
+
+#ifdef MINIGIT_HAVE_ZLIB
+// deflates into another sink (a file, stdout or a stream) in CHUNK_SIZE pieces
+class GzipSink : public ArchiveSink {
+private:
+    ArchiveSink& target;
+    z_stream zs = {};
+    vector<char> buffer;
+    vector<char> compressed;
+
+    void deflateInto(int flush) {
+        do {
+            zs.next_out = (Bytef*)compressed.data();
+            zs.avail_out = compressed.size();
+            int rc = deflate(&zs, flush);
+            if (rc == Z_STREAM_ERROR) {
+                throw runtime_error("could not write the archive: gzip stream error");
+            }
+            target.write(compressed.data(), compressed.size() - zs.avail_out);
+        } while (zs.avail_out == 0);
+    }
+
+public:
+    explicit GzipSink(ArchiveSink& into) : target(into), buffer(CHUNK_SIZE), compressed(CHUNK_SIZE) {
+        // 15 + 16: a gzip header and trailer around the deflate stream
+        if (deflateInit2(&zs, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw runtime_error("could not start the gzip stream");
+        }
+    }
+
+    ~GzipSink() {
+        deflateEnd(&zs);
+    }
+
+    void write(const char* data, size_t length) override {
+        zs.next_in = (Bytef*)data;
+        zs.avail_in = length;
+        deflateInto(Z_NO_FLUSH);
+    }
+
+    void writeFile(int fd, uintmax_t size) override {
+        copyThrough(*this, buffer, fd, size);
+    }
+
+    void finish() override {
+        zs.avail_in = 0;
+        deflateInto(Z_FINISH);
+        target.finish();
+    }
+};
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------------
+// TAR HEADERS
+// ustar, numbers are zero padded octal. Anything that doesn't fit goes into a pax 'x' record first
+//----------------------------------------------------------------------------------------------------------------------------
+
+static void putOctal(char* field, size_t width, uintmax_t value) {
+    snprintf(field, width, "%0*llo", (int)width - 1, (unsigned long long)value);
+}
+
+static void putString(char* field, size_t width, const string& value) {
+    memcpy(field, value.data(), min(width, value.size()));
+}
+
+static void finishHeader(char* header) {
+    memset(header + 148, ' ', 8);
+    unsigned sum = 0;
+    for (size_t i = 0; i < BLOCK; i++) {
+        sum += (unsigned char)header[i];
+    }
+    snprintf(header + 148, 8, "%06o", sum);
+    header[155] = ' ';
+}
+
+// "<length> key=value\n", where length counts the whole record including its own digits
+static string paxRecord(const string& key, const string& value) {
+    size_t base = key.size() + value.size() + 3;
+    size_t length = base + to_string(base).size();
+    if (to_string(length).size() != to_string(base).size()) {
+        length++;
+    }
+    return to_string(length) + " " + key + "=" + value + "\n";
+}
+
+static void padTo512(ArchiveSink& sink, uintmax_t written) {
+    static const char zeros[BLOCK] = {};
+    size_t tail = written % BLOCK;
+    if (tail) {
+        sink.write(zeros, BLOCK - tail);
+    }
+}
+
+static void writeHeader(ArchiveSink& sink, const string& name, char type, unsigned mode, uintmax_t size, time_t mtime) {
+    const uintmax_t MAX_USTAR_SIZE = 077777777777ULL;
+
+    string prefix, shortName = name;
+    bool fits = name.size() <= 100;
+    if (!fits && name.size() <= 256) {
+        // split at a '/' so the first part fits the 155 byte prefix and the rest the 100 byte name
+        for (size_t slash = name.find('/'); slash != string::npos; slash = name.find('/', slash + 1)) {
+            if (slash <= 155 && name.size() - slash - 1 <= 100 && name.size() - slash - 1 > 0) {
+                prefix = name.substr(0, slash);
+                shortName = name.substr(slash + 1);
+                fits = true;
+                break;
+            }
+        }
+    }
+
+    if (!fits || size > MAX_USTAR_SIZE) {
+        string records;
+        if (!fits) {
+            records += paxRecord("path", name);
+            shortName = name.substr(0, 100);
+        }
+        if (size > MAX_USTAR_SIZE) {
+            records += paxRecord("size", to_string(size));
+        }
+
+        char pax[BLOCK] = {};
+        putString(pax, 100, "PaxHeader/" + shortName.substr(0, 90));
+        putOctal(pax + 100, 8, 0644);
+        putOctal(pax + 108, 8, 0);
+        putOctal(pax + 116, 8, 0);
+        putOctal(pax + 124, 12, records.size());
+        putOctal(pax + 136, 12, mtime);
+        pax[156] = 'x';
+        memcpy(pax + 257, "ustar", 6);
+        memcpy(pax + 263, "00", 2);
+        finishHeader(pax);
+
+        sink.write(pax, BLOCK);
+        sink.write(records.data(), records.size());
+        padTo512(sink, records.size());
+    }
+
+    char header[BLOCK] = {};
+    putString(header, 100, shortName);
+    putOctal(header + 100, 8, mode);
+    putOctal(header + 108, 8, 0);
+    putOctal(header + 116, 8, 0);
+    putOctal(header + 124, 12, min(size, MAX_USTAR_SIZE));
+    putOctal(header + 136, 12, mtime);
+    header[156] = type;
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+    putString(header + 265, 32, "root");
+    putString(header + 297, 32, "root");
+    putString(header + 345, 155, prefix);
+    finishHeader(header);
+
+    sink.write(header, BLOCK);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// WRITE
+//----------------------------------------------------------------------------------------------------------------------------
+
+static time_t commitTime(const filesystem::path& commitDir) {
+    CommitRecord record;
+    return record.read(commitDir) ? record.timestamp() : time(nullptr);
+}
+
+// the -o file: closed on every way out, and removed unless the archive was finished (no half written tars left)
+class OutputFile {
+private:
+    string path;
+    int fd = 1;
+    bool finished = false;
+
+public:
+    explicit OutputFile(const string& output) {
+        if (output == "-") {
+            return;
+        }
+        fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+        if (fd < 0) {
+            throw runtime_error("could not create '" + output + "'");
+        }
+        path = output;
+    }
+
+    ~OutputFile() {
+        if (path.empty()) {
+            return;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (!finished) {
+            error_code ignored;
+            filesystem::remove(path, ignored);
+        }
+    }
+
+    int descriptor() const {
+        return fd;
+    }
+
+    void finish() {
+        if (path.empty()) {
+            return;
+        }
+        int closing = fd;
+        fd = -1;
+        if (close(closing) != 0) {
+            throw runtime_error("could not write '" + path + "'");
+        }
+        finished = true;
+    }
+};
+
+ArchiveResult Archive::write(const filesystem::path& commitsDir, const string& commitID, const string& format, const string& prefix, const string& output, ostream& out) {
+    TRACE_SPAN_DETAIL("Archive::write", commitID);
+
+    if (format != "tar" && format != "tar.gz" && format != "tgz") {
+        throw runtime_error("unknown archive format '" + format + "' (tar or tar.gz)");
+    }
+
+    OutputFile file(output);
+#ifdef _WIN32
+    if (output == "-") {
+        _setmode(1, _O_BINARY);
+    }
+#endif
+
+    // a library caller's stream gets the bytes through the stream, stdout and files straight through the fd
+    unique_ptr<ArchiveSink> destination;
+    if (output == "-" && &out != &cout) {
+        destination.reset(new StreamSink(out));
+    } else {
+        destination.reset(new RawSink(file.descriptor()));
+    }
+
+    unique_ptr<ArchiveSink> compressor;
+    ArchiveSink* sink = destination.get();
+    if (format != "tar") {
+#ifdef MINIGIT_HAVE_ZLIB
+        compressor.reset(new GzipSink(*destination));
+        sink = compressor.get();
+#else
+        throw runtime_error("this minigit was built without zlib, only --format=tar is available");
+#endif
+    }
+
+    filesystem::path commitDir = Layout::commitDir(commitsDir, commitID);
+    time_t mtime = commitTime(commitDir);
+    Manifest tree = Manifest::forCommit(commitsDir, commitID);
+
+    ArchiveResult result;
+    set<string> directories;
+
+    for (const auto& [path, entry] : tree.getEntries()) {
+        // parents first, once each (the manifest is sorted, so a directory's files are together)
+        for (size_t slash = path.find('/'); slash != string::npos; slash = path.find('/', slash + 1)) {
+            string dir = path.substr(0, slash + 1);
+            if (directories.insert(dir).second) {
+                writeHeader(*sink, prefix + dir, '5', 0755, 0, mtime);
+            }
+        }
+
+        filesystem::path source = commitDir / "Data" / path;
+        int in = open(source.string().c_str(), O_RDONLY | O_BINARY);
+        struct stat info;
+        if (in < 0 || fstat(in, &info) != 0) {
+            if (in >= 0) {
+                close(in);
+            }
+            throw runtime_error("could not read '" + path + "' from commit " + commitID);
+        }
+        Stats::add(STAT_FILES_OPENED);
+
+        uintmax_t size = info.st_size;
+        unsigned mode = (info.st_mode & S_IXUSR) ? 0755 : 0644;
+
+        try {
+            writeHeader(*sink, prefix + path, '0', mode, size, mtime);
+            sink->writeFile(in, size);
+            padTo512(*sink, size);
+        } catch (...) {
+            close(in);
+            throw;
+        }
+        close(in);
+
+        result.files++;
+        result.bytes += size;
+    }
+
+    // end of archive: two empty blocks
+    static const char zeros[2 * BLOCK] = {};
+    sink->write(zeros, sizeof(zeros));
+    sink->finish();
+    file.finish();
+    return result;
+}
@@ -0,0 +1,18 @@
+#include "Arena.h"
+#include "Stats.h"
+
+using namespace std;
+
+void* Arena::CountingResource::do_allocate(size_t bytes, size_t alignment) {
+    Stats::add(STAT_ARENA_CHUNKS);
+    Stats::add(STAT_ARENA_BYTES, bytes);
+    return pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void Arena::CountingResource::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+bool Arena::CountingResource::do_is_equal(const pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
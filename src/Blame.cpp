@@ -0,0 +1,183 @@
+#include "Blame.h"
+#include "Diff.h"
+#include "Manifest.h"
+#include "HashingHelper.h"
+#include "FileUtils.h"
+#include "Repository.h"
+#include "Layout.h"
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CONSTRUCTOR
+//----------------------------------------------------------------------------------------------------------------------------
+
+Blame::Blame(const Repository* repository, CommitManager* commitManager) : repo(repository), manager(commitManager) {
+    cacheDir = repo->getSharedRoot() / "cache" / "blame";
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CACHE
+// One file per (path, commit that introduced this version of it), named by the FNV-1a hash of both.
+// The file holds one commit ID per line of that version. The first line repeats the key so a hash
+// collision can't hand us someone else's result
+//----------------------------------------------------------------------------------------------------------------------------
+
+filesystem::path Blame::cacheFile(const string& path, const string& commitID) const {
+    stringstream name;
+    name << hex << setw(16) << setfill('0') << hashString(commitID + ":" + path);
+    return cacheDir / name.str();
+}
+
+bool Blame::loadCached(const string& path, const string& commitID, size_t lineCount, vector<string>& owners) const {
+    ifstream in(cacheFile(path, commitID));
+    if (!in) {
+        return false;
+    }
+
+    string key;
+    getline(in, key);
+    if (key != commitID + ":" + path) {
+        return false;
+    }
+
+    owners.clear();
+    string owner;
+    while (getline(in, owner)) {
+        owners.push_back(owner);
+    }
+
+    return owners.size() == lineCount;
+}
+
+void Blame::saveCached(const string& path, const string& commitID, const vector<string>& owners) const {
+    if (writesSuppressed()) {
+        return;
+    }
+    try {
+        filesystem::create_directories(cacheDir);
+
+        string contents = commitID + ":" + path + "\n";
+        for (const string& owner : owners) {
+            contents += owner + "\n";
+        }
+
+        writeFileAtomically(cacheFile(path, commitID), contents);
+    } catch (const exception& e) {
+        // the cache is only an optimization, blame still works without it
+        repo->err() << YEL << "warning: could not write blame cache: " << e.what() << END << endl;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// ANNOTATE
+/*
+    PART 1 => find the versions
+        -walk from HEAD towards the tail, skipping every commit that didn't touch the path
+         (the bloom filter answers most of these without loading anything)
+        -every commit that did touch it introduced a new version, we remember it
+        -we stop at the first version that is already in the cache, or where the file didn't exist in the parent
+
+    PART 2 => attribute oldest to newest
+        -the oldest version either comes from the cache, or all its lines belong to the commit that added the file
+        -for each newer version we diff it against the previous one:
+            unchanged lines keep their previous owner, inserted lines belong to the new version's commit
+        -every version we compute goes into the cache for next time
+*/
+//----------------------------------------------------------------------------------------------------------------------------
+
+bool Blame::annotate(const string& path, vector<BlameLine>& result) {
+    result.clear();
+
+    CommitNode* head = manager->getHead();
+    if (!head) {
+        repo->err() << RED << "fatal: no commits yet" << END << endl;
+        return false;
+    }
+
+    filesystem::path commitsPath = repo->getCommitsDir();
+    string key = Manifest::normalizePath(path, repo->getRoot());
+    if (!Manifest::forCommit(commitsPath, head->getCommitID()).find(key)) {
+        repo->err() << RED << "fatal: no such path '" << key << "' in HEAD" << END << endl;
+        return false;
+    }
+
+    // ----------------------------------------- PART 1 -----------------------------------------
+    vector<CommitNode*> versions;           // newest first
+    vector<vector<string>> versionLines;
+    vector<string> owners;
+    bool fromCache = false;
+
+    for (CommitNode* curr = head; curr; curr = curr->getPrevNode()) {
+        if (!manager->commitTouchesPath(curr, key)) {
+            continue;
+        }
+
+        if (!Manifest::forCommit(commitsPath, curr->getCommitID()).find(key)) {
+            break;      // deleted here, so anything older belongs to a different file
+        }
+
+        versions.push_back(curr);
+        versionLines.push_back(Diff::readLines(Layout::commitDir(commitsPath, curr->getCommitID()) / "Data" / key));
+
+        if (loadCached(key, string(curr->getCommitID()), versionLines.back().size(), owners)) {
+            fromCache = true;
+            break;
+        }
+
+        if (!Manifest::forCommit(commitsPath, curr->getPrevID()).find(key)) {
+            break;      // file was added in this commit
+        }
+    }
+
+    // ----------------------------------------- PART 2 -----------------------------------------
+    int oldest = static_cast<int>(versions.size()) - 1;
+
+    if (!fromCache) {
+        owners.assign(versionLines[oldest].size(), string(versions[oldest]->getCommitID()));
+        saveCached(key, string(versions[oldest]->getCommitID()), owners);
+    }
+
+    for (int i = oldest - 1; i >= 0; i--) {
+        const string id(versions[i]->getCommitID());
+        vector<string> newOwners(versionLines[i].size(), id);
+
+        for (const DiffEdit& e : Diff::compute(versionLines[i + 1], versionLines[i])) {
+            if (e.type == ' ') {
+                newOwners[e.newLine] = owners[e.oldLine];
+            }
+        }
+
+        owners.swap(newOwners);
+        saveCached(key, id, owners);
+    }
+
+    for (size_t i = 0; i < versionLines[0].size(); i++) {
+        result.push_back({owners[i], versionLines[0][i]});
+    }
+
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// PRINT
+// "<commit> <line number>) <text>", commit IDs shortened to 8 characters like the rest of the output
+//----------------------------------------------------------------------------------------------------------------------------
+
+void Blame::print(const string& path) {
+    vector<BlameLine> lines;
+    if (!annotate(path, lines)) {
+        return;
+    }
+
+    int width = static_cast<int>(to_string(lines.size()).size());
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        repo->out() << YEL << lines[i].commitID.substr(0, 8) << END << " "
+             << setw(width) << (i + 1) << ") " << lines[i].text << "\n";
+    }
+}
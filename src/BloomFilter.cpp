@@ -0,0 +1,116 @@
+#include "BloomFilter.h"
+#include "HashingHelper.h"
+#include "FileUtils.h"
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CONSTRUCTOR
+// ~10 bits per item with 7 hash functions gives roughly a 1% false positive rate.
+// We round up to whole bytes and never go below 64 bits so tiny commits still get a usable filter
+//----------------------------------------------------------------------------------------------------------------------------
+
+BloomFilter::BloomFilter(size_t expectedItems, int bitsPerItem) {
+    size_t numBits = expectedItems * bitsPerItem;
+    if (numBits < 64) {
+        numBits = 64;
+    }
+
+    bits.assign((numBits + 7) / 8, 0);
+    numHashes = 7;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// POSITIONS
+// Double hashing: instead of k separate hash functions we take one FNV-1a hash and derive
+// position i as h1 + i*h2. h2 is forced odd so it never collapses to a single bit
+//----------------------------------------------------------------------------------------------------------------------------
+
+void BloomFilter::positions(const string& key, vector<uint64_t>& out) const {
+    uint64_t h1 = hashString(key);
+    uint64_t h2 = ((h1 >> 33) ^ (h1 * 0x9E3779B97F4A7C15ULL)) | 1;
+    uint64_t numBits = bits.size() * 8;
+
+    out.clear();
+    for (int i = 0; i < numHashes; i++) {
+        out.push_back((h1 + i * h2) % numBits);
+    }
+}
+
+void BloomFilter::add(const string& key) {
+    vector<uint64_t> pos;
+    positions(key, pos);
+
+    for (uint64_t p : pos) {
+        bits[p / 8] |= (uint8_t)(1 << (p % 8));
+    }
+}
+
+bool BloomFilter::mightContain(const string& key) const {
+    vector<uint64_t> pos;
+    positions(key, pos);
+
+    for (uint64_t p : pos) {
+        if (!(bits[p / 8] & (1 << (p % 8)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// LOAD / SAVE
+// Format: "MGBF", 1 byte hash count, 4 byte little endian byte count, then the bit array
+//----------------------------------------------------------------------------------------------------------------------------
+
+bool BloomFilter::load(const filesystem::path& file) {
+    ifstream in(file, ios::binary);
+    if (!in) {
+        return false;
+    }
+
+    char magic[4];
+    unsigned char header[5];
+    in.read(magic, 4);
+    in.read((char*)header, 5);
+
+    if (!in || string(magic, 4) != "MGBF") {
+        return false;
+    }
+
+    uint32_t numBytes = header[1] | (header[2] << 8) | (header[3] << 16) | ((uint32_t)header[4] << 24);
+    if (numBytes == 0 || header[0] == 0) {
+        return false;
+    }
+
+    vector<uint8_t> loaded(numBytes);
+    in.read((char*)loaded.data(), numBytes);
+    if (!in) {
+        return false;
+    }
+
+    numHashes = header[0];
+    bits.swap(loaded);
+    return true;
+}
+
+void BloomFilter::save(const filesystem::path& file) const {
+    uint32_t numBytes = static_cast<uint32_t>(bits.size());
+    unsigned char header[5] = {
+        (unsigned char)numHashes,
+        (unsigned char)(numBytes & 0xff), (unsigned char)((numBytes >> 8) & 0xff),
+        (unsigned char)((numBytes >> 16) & 0xff), (unsigned char)((numBytes >> 24) & 0xff)
+    };
+
+    string contents = "MGBF";
+    contents.append((const char*)header, 5);
+    contents.append((const char*)bits.data(), bits.size());
+
+    writeFileAtomically(file, contents);
+}
+
+size_t BloomFilter::bitCount() const {
+    return bits.size() * 8;
+}
@@ -0,0 +1,135 @@
+#include "BulkIO.h"
+#include "Trace.h"
+#include "Stats.h"
+#include "Parallel.h"
+#include "SparseCheckout.h"
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <cstdlib>
+#include <stdexcept>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// BACKEND SELECTION
+//----------------------------------------------------------------------------------------------------------------------------
+
+BulkIO& BulkIO::get() {
+    static unique_ptr<BulkIO> backend;
+
+    if (!backend) {
+        const char* choice = getenv("MINIGIT_IO");
+        if (!choice || string(choice) != "threads") {
+            backend.reset(createUringIO());
+        }
+        if (!backend) {
+            backend.reset(new ThreadPoolIO());
+        }
+    }
+    return *backend;
+}
+
+/*
+copyTree
+    -walk the source, creating every directory under dest as we go (so copy jobs always have a parent)
+    -hand all files to the backend in one call
+    -report the first failure, the other files have been copied anyway
+*/
+void BulkIO::copyTree(const filesystem::path& source, const filesystem::path& dest, const SparseCheckout* sparse) {
+    TRACE_SPAN("BulkIO::copyTree");
+    vector<CopyJob> jobs;
+    filesystem::create_directories(dest);
+
+    auto it = filesystem::recursive_directory_iterator(source);
+    for (; it != filesystem::recursive_directory_iterator(); ++it) {
+        filesystem::path relative = filesystem::relative(it->path(), source);
+
+        if (it->is_directory()) {
+            string name = it->path().filename().string();
+            if (name == ".Minivcs" || name == ".git" || (sparse && !sparse->includesDirectory(relative.generic_string()))) {
+                it.disable_recursion_pending();
+                continue;
+            }
+            if (filesystem::create_directories(dest / relative)) {
+                Stats::add(STAT_DIRS_CREATED);
+            }
+        } else if (!sparse || sparse->includesFile(relative.generic_string())) {
+            jobs.push_back({it->path(), dest / relative});
+        }
+    }
+
+    vector<string> errors = copyFiles(jobs);
+    for (size_t i = 0; i < errors.size(); i++) {
+        if (!errors[i].empty()) {
+            throw runtime_error("could not copy '" + jobs[i].source.string() + "': " + errors[i]);
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// TIMESTAMPS
+// filesystem::file_time_type doesn't have to use the unix epoch (libstdc++'s doesn't), but every implementation's
+// epoch is a whole number of seconds away from it. Measuring the gap once with both clocks and rounding to seconds
+// gives the exact offset, so converted statx times compare equal to last_write_time
+//----------------------------------------------------------------------------------------------------------------------------
+
+filesystem::file_time_type fileTimeFromUnix(int64_t seconds, uint32_t nanoseconds) {
+    static const chrono::seconds epochGap = chrono::round<chrono::seconds>(
+        chrono::duration_cast<chrono::nanoseconds>(filesystem::file_time_type::clock::now().time_since_epoch()) -
+        chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()));
+
+    chrono::nanoseconds sinceEpoch = chrono::seconds(seconds) + chrono::nanoseconds(nanoseconds) + epochGap;
+    return filesystem::file_time_type(chrono::duration_cast<filesystem::file_time_type::duration>(sinceEpoch));
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// THREAD POOL BACKEND
+// The list is shared out with runOnWorkers (Parallel.h)
+//----------------------------------------------------------------------------------------------------------------------------
+
+ThreadPoolIO::ThreadPoolIO() {
+    // I/O bound, so more threads than cores still helps while some of them wait on the disk
+    workers = max(4u, min(16u, thread::hardware_concurrency() * 2));
+}
+
+const char* ThreadPoolIO::name() const {
+    return "threads";
+}
+
+vector<string> ThreadPoolIO::copyFiles(const vector<CopyJob>& jobs) {
+    TRACE_SPAN_DETAIL("ThreadPoolIO::copyFiles", to_string(jobs.size()) + " files");
+    vector<string> errors(jobs.size());
+
+    runOnWorkers(jobs.size(), workers, "io worker", [&](size_t i) {
+        TRACE_SPAN_DETAIL("copy_file", jobs[i].source.string());
+        error_code ec;
+        filesystem::copy_file(jobs[i].source, jobs[i].dest, filesystem::copy_options::overwrite_existing, ec);
+        if (ec) {
+            errors[i] = ec.message();
+            return;
+        }
+        Stats::add(STAT_FILES_COPIED);
+        Stats::add(STAT_FILES_OPENED, 2);
+        uintmax_t size = filesystem::file_size(jobs[i].dest, ec);
+        Stats::add(STAT_BYTES_COPIED, ec ? 0 : size);
+    });
+    return errors;
+}
+
+vector<FileStat> ThreadPoolIO::statFiles(const vector<filesystem::path>& paths) {
+    TRACE_SPAN_DETAIL("ThreadPoolIO::statFiles", to_string(paths.size()) + " files");
+    vector<FileStat> stats(paths.size());
+    Stats::add(STAT_FILES_STATED, paths.size());
+
+    runOnWorkers(paths.size(), workers, "io worker", [&](size_t i) {
+        error_code sizeError, timeError;
+        stats[i].size = filesystem::file_size(paths[i], sizeError);
+        stats[i].mtime = filesystem::last_write_time(paths[i], timeError);
+        stats[i].ok = !sizeError && !timeError;
+        if (!stats[i].ok) {
+            stats[i].size = 0;
+        }
+    });
+    return stats;
+}
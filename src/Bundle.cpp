@@ -0,0 +1,621 @@
+#include "Bundle.h"
+#include "Transfer.h"
+#include "Manifest.h"
+#include "HashingHelper.h"
+#include "FileUtils.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "Layout.h"
+#include "CommitRecord.h"
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <unordered_set>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+
+#ifdef MINIGIT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const size_t CHUNK_SIZE = 256 * 1024;
+static const size_t MAX_LINE = 4096;
+static const uintmax_t MAX_COMMITS = 1 << 24;      // a COMMITS count above this is damage, not history
+
+//----------------------------------------------------------------------------------------------------------------------------
+// OUTPUT STREAM
+// gzip through zlib when we have it, plain stdio otherwise. A bundle written to a file goes to <file>.tmp first
+// and is renamed when complete, so a failed create never leaves something that looks like a bundle
+//----------------------------------------------------------------------------------------------------------------------------
+
+class BundleOut {
+private:
+#ifdef MINIGIT_HAVE_ZLIB
+    gzFile out;
+#else
+    FILE* out;
+#endif
+    string file;
+    bool toStdout;
+
+public:
+    explicit BundleOut(const string& path) : file(path), toStdout(path == "-") {
+#ifdef _WIN32
+        if (toStdout) {
+            _setmode(_fileno(stdout), _O_BINARY);
+        }
+#endif
+#ifdef MINIGIT_HAVE_ZLIB
+        out = toStdout ? gzdopen(dup(fileno(stdout)), "wb6") : gzopen((file + ".tmp").c_str(), "wb6");
+        if (out) {
+            gzbuffer(out, CHUNK_SIZE);
+        }
+#else
+        out = toStdout ? stdout : fopen((file + ".tmp").c_str(), "wb");
+#endif
+        if (!out) {
+            throw runtime_error("could not open '" + file + "' for writing");
+        }
+    }
+
+    ~BundleOut() {
+        if (out) {
+#ifdef MINIGIT_HAVE_ZLIB
+            gzclose(out);
+#else
+            if (!toStdout) {
+                fclose(out);
+            }
+#endif
+            if (!toStdout) {
+                error_code ec;
+                filesystem::remove(file + ".tmp", ec);
+            }
+        }
+    }
+
+    void write(const char* data, size_t length) {
+#ifdef MINIGIT_HAVE_ZLIB
+        bool ok = length == 0 || gzwrite(out, data, length) == (int)length;
+#else
+        bool ok = fwrite(data, 1, length, out) == length;
+#endif
+        if (!ok) {
+            throw runtime_error("could not write to '" + file + "'");
+        }
+    }
+
+    void line(const string& text) {
+        write(text.data(), text.size());
+        write("\n", 1);
+    }
+
+    void close() {
+#ifdef MINIGIT_HAVE_ZLIB
+        bool ok = gzclose(out) == Z_OK;
+#else
+        bool ok = fflush(out) == 0 && (toStdout || fclose(out) == 0);
+#endif
+        out = nullptr;
+        if (!ok) {
+            throw runtime_error("could not write to '" + file + "'");
+        }
+        if (!toStdout) {
+            filesystem::rename(file + ".tmp", file);
+        }
+    }
+};
+
+//----------------------------------------------------------------------------------------------------------------------------
+// INPUT STREAM
+// zlib's gzread passes uncompressed input through unchanged, so one reader handles both kinds of bundle
+//----------------------------------------------------------------------------------------------------------------------------
+
+class BundleIn {
+private:
+#ifdef MINIGIT_HAVE_ZLIB
+    gzFile in;
+#else
+    FILE* in;
+#endif
+    bool fromStdin;
+    vector<char> buffer;
+    size_t pos;
+    size_t end;
+
+    bool fill() {
+#ifdef MINIGIT_HAVE_ZLIB
+        int n = gzread(in, buffer.data(), buffer.size());
+        if (n < 0) {
+            int code;
+            throw runtime_error(string("damaged bundle: ") + gzerror(in, &code));
+        }
+#else
+        size_t n = fread(buffer.data(), 1, buffer.size(), in);
+        if (n == 0 && ferror(in)) {
+            throw runtime_error("could not read the bundle");
+        }
+#endif
+        pos = 0;
+        end = n;
+        return end > 0;
+    }
+
+public:
+    explicit BundleIn(const string& file) : fromStdin(file == "-"), buffer(CHUNK_SIZE), pos(0), end(0) {
+#ifdef _WIN32
+        if (fromStdin) {
+            _setmode(_fileno(stdin), _O_BINARY);
+        }
+#endif
+#ifdef MINIGIT_HAVE_ZLIB
+        in = fromStdin ? gzdopen(dup(fileno(stdin)), "rb") : gzopen(file.c_str(), "rb");
+        if (in) {
+            gzbuffer(in, CHUNK_SIZE);
+        }
+#else
+        in = fromStdin ? stdin : fopen(file.c_str(), "rb");
+#endif
+        if (!in) {
+            throw runtime_error("could not open '" + file + "'");
+        }
+
+#ifndef MINIGIT_HAVE_ZLIB
+        if (fill() && end >= 2 && (unsigned char)buffer[0] == 0x1f && (unsigned char)buffer[1] == 0x8b) {
+            throw runtime_error("'" + file + "' is compressed and this minigit was built without zlib");
+        }
+#endif
+    }
+
+    ~BundleIn() {
+#ifdef MINIGIT_HAVE_ZLIB
+        gzclose(in);
+#else
+        if (!fromStdin) {
+            fclose(in);
+        }
+#endif
+    }
+
+    BundleIn(const BundleIn&) = delete;
+    BundleIn& operator=(const BundleIn&) = delete;
+
+    bool readLine(string& line) {
+        line.clear();
+        while (true) {
+            if (pos == end && !fill()) {
+                if (!line.empty()) {
+                    throw runtime_error("bundle is truncated");
+                }
+                return false;
+            }
+            char* start = buffer.data() + pos;
+            char* newline = (char*)memchr(start, '\n', end - pos);
+            size_t taken = newline ? newline - start : end - pos;
+
+            line.append(start, taken);
+            pos += taken;
+            if (line.size() > MAX_LINE) {
+                throw runtime_error("damaged bundle: record line too long");
+            }
+            if (newline) {
+                pos++;
+                return true;
+            }
+        }
+    }
+
+    size_t read(char* data, size_t length) {
+        //returns up to length bytes (at least one), throws if the stream has ended
+        if (pos == end && !fill()) {
+            throw runtime_error("bundle is truncated");
+        }
+        size_t n = min(length, end - pos);
+        memcpy(data, buffer.data() + pos, n);
+        pos += n;
+        return n;
+    }
+};
+
+//----------------------------------------------------------------------------------------------------------------------------
+// HELPERS
+//----------------------------------------------------------------------------------------------------------------------------
+
+static string contentKey(const ManifestEntry& entry) {
+    return entry.hash + " " + to_string(entry.size);
+}
+
+// everything in a bundle is untrusted, names may only ever land inside the folder they're meant for
+static bool safeName(const string& name) {
+    return !name.empty() && name[0] != '.' && name.find_first_of("/\\:") == string::npos;
+}
+
+static bool safeRelativePath(const string& path) {
+    if (path.empty() || path[0] == '/' || path.find('\\') != string::npos) {
+        return false;
+    }
+    stringstream parts(path);
+    string part;
+    while (getline(parts, part, '/')) {
+        if (part.empty() || part == "." || part == "..") {
+            return false;
+        }
+    }
+    return true;
+}
+
+static vector<string> words(const string& line) {
+    vector<string> result;
+    stringstream in(line);
+    string word;
+    while (in >> word) {
+        result.push_back(word);
+    }
+    return result;
+}
+
+static uintmax_t parseSize(const string& text) {
+    if (text.empty() || text.find_first_not_of("0123456789") != string::npos || text.size() > 18) {
+        throw runtime_error("damaged bundle: bad size '" + text + "'");
+    }
+    return stoull(text);
+}
+
+static void sendFile(BundleOut& out, const filesystem::path& file, uintmax_t size, vector<char>& chunk) {
+    ifstream in(file, ios::binary);
+    Stats::add(STAT_FILES_OPENED);
+
+    uintmax_t left = size;
+    while (left > 0 && in) {
+        in.read(chunk.data(), min<uintmax_t>(left, chunk.size()));
+        out.write(chunk.data(), in.gcount());
+        left -= in.gcount();
+    }
+    if (left > 0) {
+        throw runtime_error("'" + file.string() + "' is shorter than its manifest says");
+    }
+    Stats::add(STAT_BYTES_READ, size);
+}
+
+// copies the next size bytes of the bundle into file (or nowhere), returns their content hash
+static string receiveFile(BundleIn& in, const filesystem::path* file, uintmax_t size, vector<char>& chunk) {
+    ofstream out;
+    if (file) {
+        out.open(*file, ios::binary | ios::trunc);
+        if (!out) {
+            throw runtime_error("could not create '" + file->string() + "'");
+        }
+    }
+
+    uint64_t hash = FNV_OFFSET;
+    uintmax_t left = size;
+    while (left > 0) {
+        size_t n = in.read(chunk.data(), min<uintmax_t>(left, chunk.size()));
+        hash = hashUpdate(hash, chunk.data(), n);
+        if (file) {
+            out.write(chunk.data(), n);
+        }
+        left -= n;
+    }
+
+    if (file) {
+        out.close();
+        if (!out) {
+            throw runtime_error("could not write '" + file->string() + "'");
+        }
+        Stats::add(STAT_BYTES_WRITTEN, size);
+    }
+    return formatHash(hash);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CREATE
+//----------------------------------------------------------------------------------------------------------------------------
+
+BundleResult Bundle::create(const filesystem::path& commitsDir, const string& file, const string& base,
+                            const string& tip) {
+    TRACE_SPAN("Bundle::create");
+
+    // the range, walked back from tip
+    vector<string> ids;
+    string id = tip;
+    for (; id != "NA" && !id.empty() && id != base; id = Transfer::parentOf(commitsDir, id)) {
+        ids.push_back(id);
+    }
+    if (id != base) {
+        throw runtime_error(base + " is not an ancestor of " + tip);
+    }
+    if (ids.empty()) {
+        throw runtime_error("no commits after " + base + ", nothing to bundle");
+    }
+    reverse(ids.begin(), ids.end());
+
+    BundleResult result;
+    result.base = base;
+    result.tip = tip;
+    result.commits = ids.size();
+
+    BundleOut out(file);
+    out.line("MINIGIT-BUNDLE 1");
+    out.line("BASE " + base);
+    out.line("COMMITS " + to_string(ids.size()));
+    for (const string& commit : ids) {
+        out.line(commit);
+    }
+
+    // the receiver has the base commit, its contents never need sending
+    unordered_set<string> sent;
+    if (base != "NA") {
+        Manifest baseTree = Manifest::forCommit(commitsDir, base);
+        for (const auto& [path, entry] : baseTree.getEntries()) {
+            sent.insert(contentKey(entry));
+        }
+    }
+
+    vector<char> chunk(CHUNK_SIZE);
+
+    for (const string& commit : ids) {
+        TRACE_SPAN_DETAIL("Bundle::create commit", commit);
+        filesystem::path commitDir = Layout::commitDir(commitsDir, commit);
+        Manifest tree = Manifest::forCommit(commitsDir, commit);     // makes sure Manifest.txt exists for older commits
+
+        for (const auto& [path, entry] : tree.getEntries()) {
+            string key = contentKey(entry);
+            if (sent.insert(key).second) {
+                out.line("BLOB " + key);
+                sendFile(out, commitDir / "Data" / path, entry.size, chunk);
+                result.blobs++;
+                result.bytes += entry.size;
+            }
+        }
+
+        vector<filesystem::path> files;
+        for (auto& entry : filesystem::directory_iterator(commitDir)) {
+            string name = entry.path().filename().string();
+            if (entry.is_regular_file() && safeName(name)) {
+                files.push_back(entry.path());
+            }
+        }
+
+        out.line("COMMIT " + commit + " " + to_string(files.size()));
+        for (const filesystem::path& metadata : files) {
+            uintmax_t size = filesystem::file_size(metadata);
+            out.line("FILE " + metadata.filename().string() + " " + to_string(size));
+            sendFile(out, metadata, size, chunk);
+        }
+    }
+
+    out.line("END " + to_string(ids.size()) + " " + to_string(result.blobs));
+    out.close();
+    return result;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// UNBUNDLE
+// Contents are staged in commits/.incoming-blobs as they arrive, named by hash and size, and every commit's Data
+// folder is rebuilt from them (or from the base commit) with hardlinks. The staging folder goes away at the end
+//----------------------------------------------------------------------------------------------------------------------------
+
+static void buildCommit(BundleIn& in, const filesystem::path& commitsDir, const string& id, uintmax_t files,
+                        const string& prev, const map<string, filesystem::path>& known, vector<char>& chunk) {
+    TRACE_SPAN_DETAIL("Bundle::unbundle commit", id);
+
+    filesystem::path incoming = commitsDir / (".incoming-" + id);
+    filesystem::remove_all(incoming);
+    filesystem::create_directories(incoming / "Data");
+
+    string line;
+    for (uintmax_t i = 0; i < files; i++) {
+        vector<string> record = in.readLine(line) ? words(line) : vector<string>();
+        if (record.size() != 3 || record[0] != "FILE" || !safeName(record[1])) {
+            throw runtime_error("damaged bundle: expected a FILE record for commit " + id);
+        }
+        filesystem::path file = incoming / record[1];
+        receiveFile(in, &file, parseSize(record[2]), chunk);
+    }
+
+    Manifest tree;
+    if (!tree.load(incoming / "Manifest.txt")) {
+        throw runtime_error("damaged bundle: commit " + id + " has no manifest");
+    }
+
+    // a bundle from an older minigit has info.txt instead of a record
+    if (!filesystem::exists(incoming / CommitRecord::FILE_NAME) && filesystem::exists(incoming / "info.txt")) {
+        CommitRecord::writeFromLegacy(incoming, id, prev);
+        CommitRecord::removeLegacy(incoming);
+    }
+
+    CommitRecord commit;
+    if (!commit.read(incoming) || commit.id() != id || commit.parent() != prev) {
+        throw runtime_error("damaged bundle: commit " + id + " has no record that continues from " + prev);
+    }
+
+    for (const auto& [path, entry] : tree.getEntries()) {
+        auto content = known.find(contentKey(entry));
+        if (!safeRelativePath(path) || content == known.end()) {
+            throw runtime_error("damaged bundle: no content for '" + path + "' in commit " + id);
+        }
+
+        filesystem::path dest = incoming / "Data" / path;
+        filesystem::create_directories(dest.parent_path());
+
+        error_code ec;
+        filesystem::create_hard_link(content->second, dest, ec);
+        if (ec) {
+            filesystem::copy_file(content->second, dest, filesystem::copy_options::overwrite_existing);
+            Stats::add(STAT_FILES_COPIED);
+            Stats::add(STAT_BYTES_COPIED, entry.size);
+        }
+    }
+
+    filesystem::path dest = Layout::commitDir(commitsDir, id);
+    filesystem::remove_all(dest);
+    filesystem::create_directories(dest.parent_path());
+    filesystem::rename(incoming, dest);
+}
+
+BundleResult Bundle::unbundle(const filesystem::path& commitsDir, const string& file) {
+    TRACE_SPAN("Bundle::unbundle");
+    flushMetadataWrites();
+
+    BundleIn in(file);
+    BundleResult result;
+
+    // ----------------------------------------- HEADER -----------------------------------------
+    string line;
+    if (!in.readLine(line) || line != "MINIGIT-BUNDLE 1") {
+        throw runtime_error("'" + file + "' is not a minigit bundle (or was made by a newer minigit)");
+    }
+
+    vector<string> record = in.readLine(line) ? words(line) : vector<string>();
+    if (record.size() != 2 || record[0] != "BASE" || (record[1] != "NA" && !safeName(record[1]))) {
+        throw runtime_error("damaged bundle: bad BASE line");
+    }
+    result.base = record[1];
+
+    record = in.readLine(line) ? words(line) : vector<string>();
+    if (record.size() != 2 || record[0] != "COMMITS") {
+        throw runtime_error("damaged bundle: bad COMMITS line");
+    }
+    uintmax_t count = parseSize(record[1]);
+    if (count == 0) {
+        throw runtime_error("damaged bundle: no commits");
+    }
+    if (count > MAX_COMMITS) {
+        throw runtime_error("damaged bundle: implausible commit count " + record[1]);
+    }
+
+    // the count isn't trusted with an allocation, the list grows as ids actually arrive
+    vector<string> ids;
+    ids.reserve(min<uintmax_t>(count, 4096));
+    while (ids.size() < count) {
+        string id;
+        if (!in.readLine(id) || !safeName(id) || id == "NA") {
+            throw runtime_error("damaged bundle: bad commit list");
+        }
+        ids.push_back(move(id));
+    }
+    result.tip = ids.back();
+
+    // ----------------------------------------- WHAT'S NEW HERE -----------------------------------------
+    string localTip = Transfer::findTip(commitsDir);
+    size_t first;
+
+    if (localTip == result.base) {
+        first = 0;
+    } else if (find(ids.begin(), ids.end(), localTip) != ids.end()) {
+        first = find(ids.begin(), ids.end(), localTip) - ids.begin() + 1;     // an earlier copy of this bundle
+    } else if (localTip != "NA" && Transfer::inHistory(commitsDir, localTip, result.tip)) {
+        first = ids.size();
+    } else if (result.base == "NA" || (localTip != "NA" && Transfer::inHistory(commitsDir, localTip, result.base))) {
+        throw runtime_error("histories have diverged: " + localTip + " is not in the bundle (only fast-forwards can be "
+                            "unbundled)");
+    } else {
+        throw runtime_error("the bundle continues from " + result.base + ", which this repository doesn't have yet "
+                            "(unbundle the commits before it first)");
+    }
+
+    if (first == ids.size()) {
+        return result;
+    }
+
+    // ----------------------------------------- RECORDS -----------------------------------------
+    filesystem::path blobDir = commitsDir / ".incoming-blobs";
+    filesystem::remove_all(blobDir);
+    filesystem::create_directories(blobDir);
+
+    map<string, filesystem::path> known;     // content key => a file that has it
+    if (result.base != "NA") {
+        Manifest baseTree;
+        if (baseTree.load(Layout::commitDir(commitsDir, result.base) / "Manifest.txt")) {
+            for (const auto& [path, entry] : baseTree.getEntries()) {
+                known.emplace(contentKey(entry), Layout::commitDir(commitsDir, result.base) / "Data" / path);
+            }
+        }
+    }
+
+    vector<char> chunk(CHUNK_SIZE);
+    size_t next = 0;
+    bool ended = false;
+
+    try {
+        while (!ended && in.readLine(line)) {
+            record = words(line);
+
+            if (record.size() == 3 && record[0] == "BLOB") {
+                string key = record[1] + " " + record[2];
+                filesystem::path blob = blobDir / (record[1] + "-" + record[2]);
+                if (!safeName(record[1])) {
+                    throw runtime_error("damaged bundle: bad BLOB record");
+                }
+                if (receiveFile(in, &blob, parseSize(record[2]), chunk) != record[1]) {
+                    throw runtime_error("damaged bundle: content " + record[1] + " doesn't match its hash");
+                }
+                known[key] = blob;
+                result.blobs++;
+                result.bytes += parseSize(record[2]);
+
+            } else if (record.size() == 3 && record[0] == "COMMIT") {
+                if (next >= ids.size() || record[1] != ids[next]) {
+                    throw runtime_error("damaged bundle: commit " + record[1] + " out of order");
+                }
+                uintmax_t files = parseSize(record[2]);
+
+                if (next < first) {
+                    // already here, skip over its files
+                    for (uintmax_t i = 0; i < files; i++) {
+                        vector<string> skipped = in.readLine(line) ? words(line) : vector<string>();
+                        if (skipped.size() != 3 || skipped[0] != "FILE") {
+                            throw runtime_error("damaged bundle: expected a FILE record");
+                        }
+                        receiveFile(in, nullptr, parseSize(skipped[2]), chunk);
+                    }
+                } else {
+                    string prev = next == 0 ? result.base : ids[next - 1];
+                    buildCommit(in, commitsDir, ids[next], files, prev, known, chunk);
+                }
+                next++;
+
+            } else if (record.size() == 3 && record[0] == "END") {
+                if (next != ids.size() || record[1] != to_string(ids.size())) {
+                    throw runtime_error("damaged bundle: it ends after " + to_string(next) + " of " +
+                                        to_string(ids.size()) + " commits");
+                }
+                ended = true;
+
+            } else {
+                throw runtime_error("damaged bundle: unexpected record '" + line.substr(0, 40) + "'");
+            }
+        }
+        if (!ended) {
+            throw runtime_error("bundle is truncated");
+        }
+    } catch (...) {
+        error_code ec;
+        filesystem::remove_all(blobDir, ec);
+        if (next < ids.size()) {
+            filesystem::remove_all(commitsDir / (".incoming-" + ids[next]), ec);
+        }
+        throw;
+    }
+
+    // ----------------------------------------- PUBLISH -----------------------------------------
+    vector<string> added(ids.begin() + first, ids.end());
+    Transfer::publish(commitsDir, localTip, added);
+    filesystem::remove_all(blobDir);
+
+    result.commits = added.size();
+    return result;
+}
@@ -0,0 +1,1177 @@
+#include "Commands.h"
+#include "Blame.h"
+#include "Manifest.h"
+#include "TreeDiff.h"
+#include "Stash.h"
+#include "FileUtils.h"
+#include "Trace.h"
+#include "RepoLock.h"
+#include "Transfer.h"
+#include "Bundle.h"
+#include "GarbageCollector.h"
+#include "Fsck.h"
+#include "Archive.h"
+#include "Stats.h"
+#include "SparseCheckout.h"
+#include "Worktree.h"
+#include "Layout.h"
+#include "CommitRecord.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// SESSION
+// load() must be called with the repository lock held, since it reads the commit list and restore state
+//----------------------------------------------------------------------------------------------------------------------------
+
+Session::Session(const fs::path& root) : repo(root), manager(nullptr), restore(nullptr), statCache(nullptr), objects(nullptr) {
+}
+
+Session::~Session() {
+    unload();
+}
+
+void Session::load() {
+    TRACE_SPAN("Session::load");
+    unload();
+
+    // another process may have run migrate-layout since the last load
+    Layout::forget(repo.getCommitsDir());
+    manager = new CommitManager(&repo);
+    restore = new Restore(&repo);
+    statCache = new StatCache(repo.getVcsRoot() / "stat_cache.txt");
+    objects = new ObjectStore(repo.getSharedRoot());
+}
+
+void Session::unload() {
+    delete objects;
+    delete statCache;
+    delete restore;
+    delete manager;
+
+    objects = nullptr;
+    statCache = nullptr;
+    restore = nullptr;
+    manager = nullptr;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// STAMP
+// Cheap fingerprint of everything another process could change under a long lived session: HEAD, TIP.txt, the
+// restore state files and the layout. The daemon and the library reload the session when it changes
+//----------------------------------------------------------------------------------------------------------------------------
+
+static string firstLine(const filesystem::path& file) {
+    ifstream in(file);
+    string line;
+    getline(in, line);
+    return line;
+}
+
+static string fileStamp(const filesystem::path& file) {
+    error_code ec;
+    uintmax_t size = filesystem::file_size(file, ec);
+    if (ec) {
+        return "-";
+    }
+    return to_string(size) + "@" + to_string(filesystem::last_write_time(file, ec).time_since_epoch().count());
+}
+
+string Session::stamp() {
+    string stamp = firstLine(Repository::headFileFor(repo.getVcsRoot())) + "|";
+
+    stamp += firstLine(repo.getCommitsDir() / "TIP.txt");
+
+    stamp += "|" + fileStamp(repo.getVcsRoot() / "restore_state.txt");
+    stamp += "|" + fileStamp(repo.getVcsRoot() / "restore_journal.txt");
+    stamp += "|" + fileStamp(repo.getCommitsDir() / "LAYOUT.txt");
+    return stamp;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// USAGE
+//----------------------------------------------------------------------------------------------------------------------------
+
+void printUsage(ostream& out) {
+    out << "Usage: minigit <command> [args]\n";
+    out << "Commands:\n";
+    out << "  init              - Initialize repository\n";
+    out << "  add <files>       - Add files to staging\n";
+    out << "  addall            - Add all files\n";
+    out << "  commit <message>  - Create a commit\n";
+    out << "  log               - Show commit history\n";
+    out << "  log -- <path>     - Show commits that changed a file or directory\n";
+    out << "  log --name-status - Show commit history with changed files and renames\n";
+    out << "  revert <commitID> - Revert to a commit (creates new commit)\n";
+    out << "  undo              - Undo to previous commit\n";
+    out << "  redo              - Redo to next commit\n";
+    out << "  status            - Show restore status\n";
+    out << "  history           - Show commit history with current position\n";
+    out << "  blame <file>      - Show which commit last changed each line\n";
+    out << "  diff [<c1> [<c2>]] [--name-status] - Compare commits or HEAD with the working tree\n";
+    out << "  stash [push [msg]] - Set aside working tree and staging changes\n";
+    out << "  stash pop         - Reapply the newest stash\n";
+    out << "  stash list        - List stashes\n";
+    out << "  clone <src> [<dir>] - Copy a repository (and check out its newest commit)\n";
+    out << "  fetch <path>      - Bring in new commits from another repository on this machine\n";
+    out << "  push <path>       - Send new commits to another repository on this machine\n";
+    out << "  bundle create <file> [[<base>..]<commit>] - Write commits into one compressed file (- for stdout)\n";
+    out << "  bundle unbundle <file> - Add the commits of a bundle (- for stdin)\n";
+    out << "  worktree add <path> <commit> - Check out another commit in a second working directory (list, remove)\n";
+    out << "  sparse-checkout set|add <dirs...> - Only check out these directories (list, disable)\n";
+    out << "  show <commit>:<path> - Print one file as it was in a commit\n";
+    out << "  restore --source <commit> <paths...> - Rewrite only these files from a commit\n";
+    out << "  archive <commit> [--format=tar|tar.gz] [--prefix=<dir>/] [-o <file>] - Write a commit's files as a tar stream\n";
+    out << "  fsck [--quick]    - Check every commit's links, metadata and file contents (exit 0 ok, 1 warnings, 2 errors)\n";
+    out << "  gc [--grace=<minutes>] [--dry-run] - Delete commit folders, objects and caches nothing refers to\n";
+    out << "  migrate-layout    - Convert an older repository: commit records, commits and objects in two-character subfolders\n";
+    out << "  batch             - Run commands read from stdin, one per line, in a single process\n";
+    out << "  daemon [stop]     - Keep repository state in memory and serve commands over a socket\n";
+    out << "\n  Add --stats (or --stats=json) to any command to print files, bytes and cache hits it used\n";
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// READ ONLY COMMANDS
+// These only need a shared repository lock (or none, see main)
+//----------------------------------------------------------------------------------------------------------------------------
+
+bool isReadOnlyCommand(const vector<string>& args) {
+    if (args.empty()) {
+        return true;
+    }
+
+    const string& cmd = args[0];
+    return cmd == "log" || cmd == "history" || cmd == "status" || cmd == "diff" || cmd == "blame" || cmd == "push" ||
+           cmd == "fsck" || cmd == "archive" || cmd == "show" ||
+           (cmd == "stash" && args.size() >= 2 && args[1] == "list") ||
+           (cmd == "sparse-checkout" && args.size() >= 2 && args[1] == "list") ||
+           (cmd == "worktree" && args.size() >= 2 && args[1] == "list") ||
+           (cmd == "bundle" && args.size() >= 2 && args[1] == "create");
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CHECKS
+//----------------------------------------------------------------------------------------------------------------------------
+
+bool checkRepository(Repository& repo, const string& cmd) {
+    if (!repo.isInitialized()) {
+        repo.err() << "fatal: not a Minivcs repository\n";
+        repo.err() << "Hint: Use 'minigit init' to create a repository\n";
+        return false;
+    }
+
+    // Repositories from before commit records have to be converted first, nothing else reads their history
+    if (CommitRecord::isLegacy(repo.getCommitsDir()) && cmd != "migrate-layout") {
+        repo.err() << RED << "fatal: this repository uses the older commit format (info.txt)" << END << "\n";
+        repo.err() << YEL << "Hint: run 'minigit migrate-layout' once to convert it" << END << "\n";
+        return false;
+    }
+    return true;
+}
+
+void autoCollect(Session& session) {
+    try {
+        GarbageCollector(&session.repo, session.restore).autoCollect();
+    } catch (const exception& e) {
+        session.repo.err() << YEL << "warning: auto gc failed: " << e.what() << END << endl;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// REMOTES
+// The other repository of a clone/fetch/push is locked without blocking: if another process has it we retry for a few
+// seconds and then give up, instead of hanging behind (or deadlocking with) a command running over there
+//----------------------------------------------------------------------------------------------------------------------------
+
+static unique_ptr<RepoLock> lockRemote(const fs::path& remoteRoot, RepoLock::Mode mode, ostream& err) {
+    for (int attempt = 0; attempt < 100; attempt++) {
+        unique_ptr<RepoLock> lock(new RepoLock(remoteRoot / ".Minivcs", mode, false, err));
+        if (!lock->isBusy()) {
+            return lock;
+        }
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+    return nullptr;
+}
+
+static bool isRepository(const fs::path& root) {
+    return fs::exists(Worktree::mainVcsRoot(root / ".Minivcs") / "commits");
+}
+
+static void printTransfer(const TransferResult& result, const string& direction, ostream& out) {
+    if (result.commits == 0) {
+        out << "Already up to date.\n";
+        return;
+    }
+    out << GRN << (result.oldTip == "NA" ? "(new)" : result.oldTip) << ".." << result.newTip << "  " << result.commits
+         << " commit(s) " << direction << END << "\n";
+    out << "  " << result.linked << " file(s) linked, " << result.copied << " copied (" << result.bytesCopied << " bytes)\n";
+}
+
+static bool headAtTip(Session& session) {
+    CommitNode* tip = session.manager->getHead();
+    return tip ? session.repo.getHead() == tip->getCommitID() : session.repo.getHead() == "NA";
+}
+
+static bool hasUncommittedChanges(Session& session) {
+    string head = session.repo.getHead();
+    if (head == "NA") {
+        return false;
+    }
+    return !session.repo.isStagingEmpty() ||
+           !Manifest::scanWorkingTree(session.repo.getRoot(), *session.statCache)
+                .changedPaths(SparseCheckout::load(session.repo.getRoot())
+                                  .visible(Manifest::forCommit(session.repo.getCommitsDir(), head)))
+                .empty();
+}
+
+// fetch and unbundle move a checked out tip along with the new commits, which rewrites the working tree
+static void followNewCommits(Session& session, bool followTip, const string& newTip, int commits) {
+    if (commits == 0) {
+        return;
+    }
+    if (followTip) {
+        session.repo.checkout(newTip);
+        session.restore->recordCommit(newTip);
+    }
+    session.load();
+}
+
+/*
+runClone
+    -"clone <source> [<dir>]", runs outside any repository so main calls it before the initialized check
+    -<dir> defaults to the source folder's name and must not exist yet (or be empty)
+    -the new repository gets the whole history through Transfer, then its newest commit is checked out
+*/
+int runClone(const vector<string>& args) {
+    if (args.size() < 2) {
+        cout << "Usage: minigit clone <source> [<dir>]\n";
+        return 0;
+    }
+
+    fs::path source = fs::absolute(args[1]).lexically_normal();
+    if (!source.has_filename()) {
+        source = source.parent_path();
+    }
+    if (!isRepository(source)) {
+        cerr << RED << "fatal: '" << args[1] << "' is not a Minivcs repository" << END << endl;
+        return 1;
+    }
+
+    fs::path dest = fs::absolute(args.size() >= 3 ? fs::path(args[2]) : source.filename());
+    if (fs::exists(dest) && !fs::is_empty(dest)) {
+        cerr << RED << "fatal: destination '" << dest.string() << "' already exists and is not empty" << END << endl;
+        return 1;
+    }
+
+    unique_ptr<RepoLock> sourceLock = lockRemote(source, RepoLock::Shared, cerr);
+    if (!sourceLock) {
+        cerr << RED << "fatal: '" << args[1] << "' is busy, try again later" << END << endl;
+        return 1;
+    }
+
+    fs::create_directories(dest);
+
+    Session session(dest);
+    session.repo.init();
+    RepoLock lock(session.repo.getVcsRoot(), RepoLock::Exclusive);
+
+    TransferResult result = Transfer::send(source, dest);
+    session.load();
+
+    cout << "Cloned into '" << dest.string() << "'\n";
+    printTransfer(result, "from " + source.string(), cout);
+
+    if (result.newTip != "NA") {
+        session.repo.checkout(result.newTip);
+        session.restore->recordCommit(result.newTip);
+    }
+    return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// RUN COMMAND
+//----------------------------------------------------------------------------------------------------------------------------
+
+int runCommand(Session& session, const vector<string>& args) {
+    ostream& out = session.repo.out();
+    ostream& err = session.repo.err();
+
+    if (args.empty()) {
+        printUsage(out);
+        return 0;
+    }
+
+    const string& cmd = args[0];
+    TRACE_SPAN_DETAIL("command", cmd);
+
+    Repository& repo = session.repo;
+    CommitManager& manager = *session.manager;
+    Restore& restore = *session.restore;
+    StatCache& statCache = *session.statCache;
+    ObjectStore& objects = *session.objects;
+
+    // =====================================
+    // ADD FILES
+    // =====================================
+    if (cmd == "add") {
+        if (args.size() < 2) {
+            out << "Usage: minigit add <file1> <file2> ...\n";
+            return 0;
+        }
+
+        vector<string> files;
+        for (size_t i = 1; i < args.size(); i++)
+            files.push_back(args[i]);
+
+        return repo.add(files) == 0 ? 0 : 1;
+    }
+
+    // =====================================
+    // ADD ALL
+    // =====================================
+    if (cmd == "addall") {
+        return repo.addAll() == 0 ? 0 : 1;
+    }
+
+    // =====================================
+    // COMMIT
+    // =====================================
+    if (cmd == "commit") {
+        if (args.size() < 2) {
+            out << "Usage: minigit commit <message>\n";
+            return 0;
+        }
+
+        // Combine everything after "commit" into a message
+        string msg;
+        for (size_t i = 1; i < args.size(); i++) {
+            msg += args[i];
+            if (i < args.size() - 1) msg += " ";
+        }
+
+        manager.addCommit(msg);
+
+        // Get the new commit ID from HEAD.txt
+        string newCommitID = repo.getHead();
+
+        // Record the commit in restore system
+        restore.recordCommit(newCommitID);
+
+        repo.clearStaging();
+        out << "Commit created: " << newCommitID << "\n";
+        return 0;
+    }
+
+    // =====================================
+    // LOG
+    // =====================================
+    if (cmd == "log") {
+        if (args.size() >= 3 && args[1] == "--") {
+            manager.printLog(args[2]);
+            return 0;
+        }
+        if (args.size() >= 2 && args[1] == "--name-status") {
+            manager.printLogWithChanges();
+            return 0;
+        }
+        manager.printLog();
+        return 0;
+    }
+
+    // =====================================
+    // REVERT (creates a new commit with old data)
+    // =====================================
+    if (cmd == "revert") {
+        if (args.size() < 2) {
+            out << "Usage: minigit revert <commitID>\n";
+            return 0;
+        }
+
+        string id = args[1];
+        manager.revert(id);
+
+        // Get the new revert commit ID
+        string newCommitID = repo.getHead();
+
+        // Record the new revert commit
+        restore.recordCommit(newCommitID);
+
+        return 0;
+    }
+
+    // =====================================
+    // UNDO (checkout to previous commit)
+    // =====================================
+    if (cmd == "undo") {
+        restore.undo();
+        return 0;
+    }
+
+    // =====================================
+    // REDO (checkout to next commit)
+    // =====================================
+    if (cmd == "redo") {
+        restore.redo();
+        return 0;
+    }
+
+    // =====================================
+    // STATUS (Restore Status)
+    // =====================================
+    if (cmd == "status") {
+        restore.printStatus();
+
+        // working tree compared with the checked out commit, moved files shown as renames
+        string current = repo.getHead();
+        if (current != "NA" && manager.commitExists(current)) {
+            Manifest workingTree = Manifest::scanWorkingTree(repo.getRoot(), statCache);
+
+            // excluded by a sparse checkout isn't deleted
+            vector<FileChange> changes = TreeDiff::compare(
+                SparseCheckout::load(repo.getRoot()).visible(Manifest::forCommit(repo.getCommitsDir(), current)),
+                Layout::commitDir(repo.getCommitsDir(), current) / "Data", workingTree, repo.getRoot());
+
+            out << "Working tree changes since " << current << ":\n";
+            if (changes.empty()) {
+                out << "  (clean)\n";
+            }
+            TreeDiff::printNameStatus(changes, out);
+        }
+        return 0;
+    }
+
+    // =====================================
+    // HISTORY (Show commit history with current position)
+    // =====================================
+    if (cmd == "history") {
+        restore.viewHistory(manager.getHead());
+        return 0;
+    }
+
+    // =====================================
+    // BLAME (line level attribution of a file in HEAD)
+    // =====================================
+    if (cmd == "blame") {
+        if (args.size() < 2) {
+            out << "Usage: minigit blame <file>\n";
+            return 0;
+        }
+
+        Blame blame(&repo, &manager);
+        blame.print(args[1]);
+        return 0;
+    }
+
+    // =====================================
+    // DIFF (commit vs commit, or commit vs working tree)
+    // =====================================
+    if (cmd == "diff") {
+        vector<string> ids;
+        bool nameStatus = false;
+
+        for (size_t i = 1; i < args.size(); i++) {
+            const string& arg = args[i];
+            if (arg == "--name-status") {
+                nameStatus = true;
+            } else {
+                ids.push_back(arg == "HEAD" ? repo.getHead() : arg);
+            }
+        }
+
+        if (ids.size() > 2) {
+            out << "Usage: minigit diff [<commitID> [<commitID>]] [--name-status]\n";
+            return 0;
+        }
+        if (ids.empty()) {
+            ids.push_back(repo.getHead());
+        }
+
+        for (const string& id : ids) {
+            if (!manager.commitExists(id)) {
+                err << "fatal: commit '" << id << "' not found\n";
+                return 1;
+            }
+        }
+
+        fs::path oldRoot = Layout::commitDir(repo.getCommitsDir(), ids[0]) / "Data";
+        Manifest oldTree = Manifest::forCommit(repo.getCommitsDir(), ids[0]);
+
+        fs::path newRoot;
+        Manifest newTree;
+
+        if (ids.size() == 2) {
+            newRoot = Layout::commitDir(repo.getCommitsDir(), ids[1]) / "Data";
+            newTree = Manifest::forCommit(repo.getCommitsDir(), ids[1]);
+        } else {
+            newRoot = repo.getRoot();
+            newTree = Manifest::scanWorkingTree(newRoot, statCache);
+            oldTree = SparseCheckout::load(repo.getRoot()).visible(oldTree);
+        }
+
+        vector<FileChange> changes = TreeDiff::compare(oldTree, oldRoot, newTree, newRoot);
+
+        if (nameStatus) {
+            TreeDiff::printNameStatus(changes, out);
+        } else {
+            TreeDiff::printPatch(changes, oldRoot, newRoot, out);
+        }
+        return 0;
+    }
+
+    // =====================================
+    // STASH (set aside uncommitted work)
+    // =====================================
+    if (cmd == "stash") {
+        Stash stash(&repo, &objects, &statCache);
+        string sub = args.size() >= 2 ? args[1] : "push";
+
+        if (sub == "push") {
+            string msg = "WIP";
+            for (size_t i = 2; i < args.size(); i++) {
+                msg = (i == 2 ? "" : msg + " ") + args[i];
+            }
+            return stash.push(msg) ? 0 : 1;
+        }
+        if (sub == "pop") {
+            return stash.pop() ? 0 : 1;
+        }
+        if (sub == "list") {
+            stash.list();
+            return 0;
+        }
+
+        out << "Usage: minigit stash [push [message] | pop | list]\n";
+        return 0;
+    }
+
+    // =====================================
+    // FETCH / PUSH (fast-forward from / to another repository)
+    // =====================================
+    if (cmd == "fetch" || cmd == "push") {
+        if (args.size() < 2) {
+            out << "Usage: minigit " << cmd << " <path to repository>\n";
+            return 0;
+        }
+
+        fs::path remote = fs::absolute(args[1]).lexically_normal();
+        if (!isRepository(remote)) {
+            err << RED << "fatal: '" << args[1] << "' is not a Minivcs repository" << END << endl;
+            return 1;
+        }
+        if (fs::equivalent(remote, repo.getRoot())) {
+            err << RED << "fatal: '" << args[1] << "' is this repository" << END << endl;
+            return 1;
+        }
+
+        bool fetching = cmd == "fetch";
+        unique_ptr<RepoLock> remoteLock = lockRemote(remote, fetching ? RepoLock::Shared : RepoLock::Exclusive, err);
+        if (!remoteLock) {
+            err << RED << "fatal: '" << args[1] << "' is busy, try again later" << END << endl;
+            return 1;
+        }
+
+        bool followTip = fetching && headAtTip(session);
+        if (followTip && hasUncommittedChanges(session)) {
+            err << RED << "error: the working tree has uncommitted changes, commit or stash them before fetching" << END << endl;
+            return 1;
+        }
+
+        TransferResult result;
+        try {
+            result = fetching ? Transfer::send(remote, repo.getRoot()) : Transfer::send(repo.getRoot(), remote);
+        } catch (const exception& e) {
+            err << RED << "fatal: " << e.what() << END << endl;
+            return 1;
+        }
+        printTransfer(result, (fetching ? "from " : "to ") + remote.string(), out);
+
+        // push never touches the other working tree, its owner checks the new commits out (undo/redo) when they like
+        if (fetching) {
+            followNewCommits(session, followTip, result.newTip, result.commits);
+        }
+        return 0;
+    }
+
+    // =====================================
+    // FSCK (verify metadata, links and contents)
+    // =====================================
+    if (cmd == "fsck") {
+        bool quick = args.size() >= 2 && args[1] == "--quick";
+
+        FsckResult result = Fsck(&repo).run(quick);
+
+        out << (result.errors ? RED : result.warnings ? YEL : GRN) << "Checked " << result.commits << " commit(s), "
+             << result.files << " file(s)";
+        if (!quick) {
+            out << ", " << result.bytes << " bytes hashed";
+        }
+        out << ": " << result.errors << " error(s), " << result.warnings << " warning(s)" << END << "\n";
+        return result.exitCode();
+    }
+
+    // =====================================
+    // GC (delete what nothing refers to any more)
+    // =====================================
+    if (cmd == "gc") {
+        int grace = GarbageCollector::DEFAULT_GRACE_MINUTES;
+        bool dryRun = false;
+
+        for (size_t i = 1; i < args.size(); i++) {
+            if (args[i] == "--dry-run") {
+                dryRun = true;
+            } else if (args[i].rfind("--grace=", 0) == 0 && args[i].size() > 8 &&
+                       args[i].find_first_not_of("0123456789", 8) == string::npos) {
+                grace = stoi(args[i].substr(8));
+            } else {
+                out << "Usage: minigit gc [--grace=<minutes>] [--dry-run]\n";
+                return 0;
+            }
+        }
+
+        GcResult result;
+        try {
+            result = GarbageCollector(&repo, &restore).collect(grace, dryRun);
+        } catch (const exception& e) {
+            err << RED << "fatal: " << e.what() << END << endl;
+            return 1;
+        }
+
+        out << GRN << (dryRun ? "Would remove " : "Removed ") << result.commits << " commit folder(s), "
+             << result.objects << " object(s), " << result.cacheEntries << " cache entries and " << result.temporary
+             << " temporary file(s), " << result.bytes << " bytes" << END << "\n";
+        if (result.spared > 0) {
+            out << "  " << result.spared << " more changed within the last " << grace << " minute(s), kept for now\n";
+        }
+
+        // the object store and restore state in this session remember things that may be gone now
+        session.load();
+        return 0;
+    }
+
+    // =====================================
+    // MIGRATE-LAYOUT (text commit files into records, flat commits/objects folders into shards)
+    // =====================================
+    if (cmd == "migrate-layout") {
+        bool legacy = CommitRecord::isLegacy(repo.getCommitsDir());
+        bool sharded = Layout::isSharded(repo.getCommitsDir());
+        if (!legacy && sharded) {
+            out << YEL << "Already using commit records and the sharded layout" << END << "\n";
+            return 0;
+        }
+
+        int converted = 0;
+        LayoutMigration result;
+        try {
+            flushMetadataWrites();
+            if (legacy) {
+                converted = CommitRecord::convertLegacy(repo.getCommitsDir());
+            }
+            if (!sharded) {
+                result = Layout::migrate(repo.getSharedRoot());
+            }
+        } catch (const exception& e) {
+            err << RED << "fatal: " << e.what() << END << endl;
+            err << YEL << "Hint: run migrate-layout again to finish" << END << endl;
+            return 1;
+        }
+
+        if (legacy) {
+            out << GRN << "Converted " << converted << " commit(s) to commit records" << END << "\n";
+        }
+        if (!sharded) {
+            out << GRN << "Moved " << result.commits << " commit folder(s) and " << result.objects
+                 << " object(s) into the sharded layout" << END << "\n";
+        }
+        session.load();
+        return 0;
+    }
+
+    // =====================================
+    // BUNDLE (history in one streamable file)
+    // =====================================
+    if (cmd == "bundle") {
+        string sub = args.size() >= 2 ? args[1] : "";
+
+        if (sub == "create" && args.size() >= 3) {
+            CommitNode* tip = manager.getHead();
+            string range = args.size() >= 4 ? args[3] : "";
+            size_t dots = range.find("..");
+
+            string base = dots == string::npos ? "NA" : range.substr(0, dots);
+            string last = dots == string::npos ? range : range.substr(dots + 2);
+            if (last.empty() || last == "HEAD") {
+                last = tip ? string(tip->getCommitID()) : "NA";
+            }
+
+            for (const string& id : {base, last}) {
+                if (id != "NA" && !manager.commitExists(id)) {
+                    err << RED << "fatal: commit '" << id << "' not found" << END << endl;
+                    return 1;
+                }
+            }
+            if (last == "NA") {
+                err << RED << "fatal: nothing to bundle, there are no commits yet" << END << endl;
+                return 1;
+            }
+
+            // with the bundle on stdout, anything we say goes to stderr
+            ostream& report = args[2] == "-" ? err : out;
+            try {
+                BundleResult result = Bundle::create(repo.getCommitsDir(), args[2], base, last);
+                report << GRN << "Bundled " << result.commits << " commit(s) " << (base == "NA" ? "up to " : base + "..")
+                    << last << END << "\n";
+                report << "  " << result.blobs << " distinct file(s), " << result.bytes << " bytes before compression\n";
+            } catch (const exception& e) {
+                err << RED << "fatal: " << e.what() << END << endl;
+                return 1;
+            }
+            return 0;
+        }
+
+        if (sub == "unbundle" && args.size() >= 3) {
+            bool followTip = headAtTip(session);
+            if (followTip && hasUncommittedChanges(session)) {
+                err << RED << "error: the working tree has uncommitted changes, commit or stash them before unbundling" << END << endl;
+                return 1;
+            }
+
+            BundleResult result;
+            try {
+                result = Bundle::unbundle(repo.getCommitsDir(), args[2]);
+            } catch (const exception& e) {
+                err << RED << "fatal: " << e.what() << END << endl;
+                return 1;
+            }
+
+            if (result.commits == 0) {
+                out << "Already up to date.\n";
+            } else {
+                out << GRN << "Unbundled " << result.commits << " commit(s), now at " << result.tip << END << "\n";
+                out << "  " << result.blobs << " distinct file(s), " << result.bytes << " bytes\n";
+            }
+            followNewCommits(session, followTip, result.tip, result.commits);
+            return 0;
+        }
+
+        out << "Usage: minigit bundle create <file|-> [[<base>..]<commit>]\n";
+        out << "       minigit bundle unbundle <file|->\n";
+        return 0;
+    }
+
+    // =====================================
+    // WORKTREE (more working directories sharing this history)
+    // =====================================
+    if (cmd == "worktree") {
+        string sub = args.size() >= 2 ? args[1] : "";
+
+        if (sub == "list") {
+            for (const WorktreeInfo& worktree : Worktree::list(repo.getVcsRoot())) {
+                string state = worktree.missing ? YEL "(missing, minigit worktree remove cleans it up)" END : worktree.head;
+                out << worktree.root.string() << "  " << state << (worktree.main ? "  (main)" : "") << "\n";
+            }
+            return 0;
+        }
+
+        if (sub == "add" && args.size() == 4) {
+            string commitID = args[3] == "HEAD" ? repo.getHead() : args[3];
+            if (!manager.commitExists(commitID)) {
+                err << RED << "fatal: commit '" << commitID << "' not found" << END << endl;
+                return 1;
+            }
+
+            fs::path dest = fs::absolute(args[2]);
+            try {
+                Worktree::add(repo.getVcsRoot(), dest, commitID);
+
+                // the checkout and its restore state belong to the new worktree
+                Session linked(dest);
+                linked.repo.setOutput(out, err);
+                linked.load();
+                linked.repo.checkout(commitID);
+                linked.restore->recordCommit(commitID);
+            } catch (const exception& e) {
+                err << RED << "fatal: " << e.what() << END << endl;
+                return 1;
+            }
+            out << GRN << "Worktree " << dest.lexically_normal().string() << " at " << commitID << END << "\n";
+            return 0;
+        }
+
+        if (sub == "remove" && (args.size() == 3 || (args.size() == 4 && args[3] == "--force"))) {
+            fs::path dest = fs::absolute(args[2]);
+            if (args.size() == 3 && fs::exists(dest / ".Minivcs" / "worktree.txt")) {
+                bool dirty;
+                {
+                    Session linked(dest);
+                    linked.repo.setOutput(out, err);
+                    linked.load();
+                    dirty = hasUncommittedChanges(linked);
+                }
+                if (dirty) {
+                    err << RED << "error: '" << args[2] << "' has uncommitted changes, use --force to delete them" << END << endl;
+                    return 1;
+                }
+            }
+
+            try {
+                Worktree::remove(repo.getVcsRoot(), dest);
+            } catch (const exception& e) {
+                err << RED << "fatal: " << e.what() << END << endl;
+                return 1;
+            }
+            out << GRN << "Removed worktree " << dest.lexically_normal().string() << END << "\n";
+            return 0;
+        }
+
+        out << "Usage: minigit worktree add <path> <commit>\n";
+        out << "       minigit worktree list\n";
+        out << "       minigit worktree remove <path> [--force]\n";
+        return 0;
+    }
+
+    // =====================================
+    // SPARSE CHECKOUT (only some directories in the working tree)
+    // =====================================
+    if (cmd == "sparse-checkout") {
+        string sub = args.size() >= 2 ? args[1] : "";
+        SparseCheckout sparse = SparseCheckout::load(repo.getRoot());
+
+        if (sub == "list") {
+            if (!sparse.isEnabled()) {
+                out << "(sparse checkout is off, the whole tree is checked out)\n";
+            }
+            for (const string& cone : sparse.getCones()) {
+                out << cone << "\n";
+            }
+            return 0;
+        }
+
+        vector<string> cones;
+        if (sub == "add") {
+            cones = sparse.getCones();
+        }
+        if ((sub == "set" || sub == "add") && args.size() >= 3) {
+            cones.insert(cones.end(), args.begin() + 2, args.end());
+        } else if (sub != "disable") {
+            out << "Usage: minigit sparse-checkout set <dirs...>\n";
+            out << "       minigit sparse-checkout add <dirs...>\n";
+            out << "       minigit sparse-checkout list\n";
+            out << "       minigit sparse-checkout disable\n";
+            return 0;
+        }
+
+        // the working tree is rewritten from HEAD, anything not committed would be lost
+        if (hasUncommittedChanges(session)) {
+            err << RED << "error: the working tree has uncommitted changes, commit or stash them first" << END << endl;
+            return 1;
+        }
+
+        sparse.setCones(cones, repo.getRoot());
+        sparse.save(repo.getRoot());
+
+        string head = repo.getHead();
+        if (head != "NA") {
+            repo.checkout(head);
+        }
+        if (sparse.isEnabled()) {
+            size_t count = sparse.getCones().size();
+            out << GRN << "Sparse checkout of " << count << (count == 1 ? " directory" : " directories") << END << "\n";
+        } else {
+            out << GRN << "Sparse checkout disabled, the whole tree is checked out" << END << "\n";
+        }
+        return 0;
+    }
+
+    // =====================================
+    // SHOW (one file of a commit, to stdout)
+    // =====================================
+    if (cmd == "show") {
+        size_t colon = args.size() == 2 ? args[1].find(':') : string::npos;
+        if (colon == string::npos) {
+            out << "Usage: minigit show <commit>:<path>\n";
+            return 0;
+        }
+
+        string commitID = args[1].substr(0, colon);
+        string path = args[1].substr(colon + 1);
+        if (commitID == "HEAD") {
+            commitID = repo.getHead();
+        }
+        if (!manager.commitExists(commitID)) {
+            err << RED << "fatal: commit '" << commitID << "' not found" << END << endl;
+            return 1;
+        }
+
+        try {
+            // the root is the commit itself, pathInCommit() only takes paths inside it
+            string key = Manifest::normalizePath(path, repo.getRoot());
+            fs::path stored = key.empty() || key == "." ? Layout::commitDir(repo.getCommitsDir(), commitID) / "Data"
+                                                        : repo.pathInCommit(commitID, path);
+
+            // a directory lists what's in it, like a tree
+            if (fs::is_directory(stored)) {
+                vector<string> names;
+                for (const auto& entry : fs::directory_iterator(stored)) {
+                    names.push_back(entry.path().filename().string() + (entry.is_directory() ? "/" : ""));
+                }
+                sort(names.begin(), names.end());
+                for (const string& name : names) {
+                    out << name << "\n";
+                }
+                return 0;
+            }
+
+            // a library caller's stream gets the bytes through the stream, stdout straight from the file
+            if (&out != &cout) {
+                ifstream file(stored, ios::binary);
+                if (!file) {
+                    throw runtime_error("could not read '" + path + "' from commit " + commitID);
+                }
+                Stats::add(STAT_FILES_OPENED);
+                if (fs::file_size(stored) > 0) {
+                    out << file.rdbuf();
+                }
+                return 0;
+            }
+
+            int in = open(stored.string().c_str(), O_RDONLY | O_BINARY);
+            if (in < 0) {
+                throw runtime_error("could not read '" + path + "' from commit " + commitID);
+            }
+            Stats::add(STAT_FILES_OPENED);
+            cout.flush();
+#ifdef _WIN32
+            _setmode(1, _O_BINARY);
+#endif
+            try {
+                copyToDescriptor(in, 1, fs::file_size(stored));
+            } catch (...) {
+                close(in);
+                throw;
+            }
+            close(in);
+        } catch (const exception& e) {
+            err << RED << "fatal: " << e.what() << END << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // =====================================
+    // RESTORE (some paths from a commit, nothing else changes)
+    // =====================================
+    if (cmd == "restore") {
+        string commitID;
+        vector<string> paths;
+        for (size_t i = 1; i < args.size(); i++) {
+            if (args[i] == "--source" && i + 1 < args.size()) {
+                commitID = args[++i];
+            } else if (args[i].rfind("--source=", 0) == 0) {
+                commitID = args[i].substr(9);
+            } else {
+                paths.push_back(args[i]);
+            }
+        }
+        if (commitID.empty() || paths.empty()) {
+            out << "Usage: minigit restore --source <commit> <paths...>\n";
+            return 0;
+        }
+
+        if (commitID == "HEAD") {
+            commitID = repo.getHead();
+        }
+        if (!manager.commitExists(commitID)) {
+            err << RED << "fatal: commit '" << commitID << "' not found" << END << endl;
+            return 1;
+        }
+        return repo.restorePaths(commitID, paths) == 0 ? 0 : 1;
+    }
+
+    // =====================================
+    // ARCHIVE (one commit as tar, straight from storage)
+    // =====================================
+    if (cmd == "archive") {
+        string commitID, format, prefix, output = "-";
+        bool usage = false;
+
+        for (size_t i = 1; i < args.size(); i++) {
+            if (args[i].rfind("--format=", 0) == 0) {
+                format = args[i].substr(9);
+            } else if (args[i].rfind("--prefix=", 0) == 0) {
+                prefix = args[i].substr(9);
+            } else if (args[i] == "-o" && i + 1 < args.size()) {
+                output = args[++i];
+            } else if (commitID.empty() && args[i][0] != '-') {
+                commitID = args[i];
+            } else {
+                usage = true;
+            }
+        }
+        if (usage || commitID.empty()) {
+            out << "Usage: minigit archive <commit> [--format=tar|tar.gz] [--prefix=<dir>/] [-o <file>]\n";
+            return 0;
+        }
+
+        if (commitID == "HEAD") {
+            commitID = repo.getHead();
+        }
+        if (!manager.commitExists(commitID)) {
+            err << RED << "fatal: commit '" << commitID << "' not found" << END << endl;
+            return 1;
+        }
+        // -o out.tar.gz picks the format by itself
+        if (format.empty()) {
+            bool gzipped = output.size() > 7 && output.compare(output.size() - 7, 7, ".tar.gz") == 0;
+            format = gzipped ? "tar.gz" : "tar";
+        }
+
+        // with the archive on stdout, anything we say goes to stderr
+        ostream& report = output == "-" ? err : out;
+        try {
+            ArchiveResult result = Archive::write(repo.getCommitsDir(), commitID, format, prefix, output, out);
+            report << GRN << "Archived " << result.files << " file(s) of commit " << commitID << ", " << result.bytes
+                << " bytes" << END << "\n";
+        } catch (const exception& e) {
+            err << RED << "fatal: " << e.what() << END << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // =====================================
+    // DEFAULT (unknown)
+    // =====================================
+    out << "Unknown command: " << cmd << "\n";
+    return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// BATCH
+//----------------------------------------------------------------------------------------------------------------------------
+
+/*
+Splits one batch line into arguments. Whitespace separates arguments, double quotes group them
+(commit "add generated files") and a backslash inside quotes escapes the next character
+*/
+static vector<string> splitBatchLine(const string& line) {
+    vector<string> args;
+    string current;
+    bool inQuotes = false;
+    bool hasToken = false;
+
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+
+        if (inQuotes) {
+            if (c == '\\' && i + 1 < line.size()) {
+                current += line[++i];
+            } else if (c == '"') {
+                inQuotes = false;
+            } else {
+                current += c;
+            }
+        } else if (c == '"') {
+            inQuotes = true;
+            hasToken = true;
+        } else if (isspace((unsigned char)c)) {
+            if (hasToken) {
+                args.push_back(current);
+                current.clear();
+                hasToken = false;
+            }
+        } else {
+            current += c;
+            hasToken = true;
+        }
+    }
+
+    if (inQuotes) {
+        throw runtime_error("unterminated quote");
+    }
+    if (hasToken) {
+        args.push_back(current);
+    }
+    return args;
+}
+
+static void flushBatch(Session& session) {
+    flushMetadataWrites();
+    session.restore->flushJournal();
+}
+
+/*
+runBatch
+    -reads one command per line (same words as on the command line, without "minigit"), blank lines and # comments are skipped
+    -every command runs against the same loaded session, so the commit list and hash table are built once for the whole batch
+    -HEAD.txt, TAIL.txt, TIP.txt and the restore journal are kept in memory and written once at the end,
+     or whenever a line says "flush". Commit data itself is still written by each commit as usual
+    -a failing command is reported with its line number and the batch carries on, the exit code is 1 if anything failed
+*/
+int runBatch(Session& session, istream& in) {
+    int failures = 0;
+    int lineNumber = 0;
+    string line;
+
+    deferMetadataWrites(true);
+
+    while (getline(in, line)) {
+        lineNumber++;
+
+        vector<string> args;
+        try {
+            args = splitBatchLine(line);
+        } catch (const exception& e) {
+            session.repo.err() << RED << "batch line " << lineNumber << ": " << e.what() << END << "\n";
+            failures++;
+            continue;
+        }
+
+        if (args.empty() || args[0][0] == '#') {
+            continue;
+        }
+
+        const string& cmd = args[0];
+        if (cmd == "flush") {
+            flushBatch(session);
+            continue;
+        }
+        if (cmd == "init" || cmd == "batch" || cmd == "daemon") {
+            session.repo.err() << RED << "batch line " << lineNumber << ": '" << cmd << "' can't be used inside a batch" << END << "\n";
+            failures++;
+            continue;
+        }
+
+        try {
+            if (runCommand(session, args) != 0) {
+                failures++;
+            }
+        } catch (const exception& e) {
+            session.repo.err() << RED << "batch line " << lineNumber << ": " << e.what() << END << "\n";
+            failures++;
+        }
+    }
+
+    flushBatch(session);
+    deferMetadataWrites(false);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+#include "CommitGraph.h"
+#include "FileUtils.h"
+#include "Stats.h"
+#include <fstream>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+
+using namespace std;
+
+filesystem::path CommitGraph::graphPath(const filesystem::path& commitsDir) {
+    return commitsDir / "commit-graph.txt";
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// HEADER
+// Reads the first three lines, returns the tip ID and commit count, or false if this isn't a (sound) graph file.
+// Version 1 wrote messages raw, a multi-line one broke the file, those are rebuilt like a stale graph
+//----------------------------------------------------------------------------------------------------------------------------
+
+static const char* const MAGIC = "MINIGIT-COMMIT-GRAPH 2";
+
+static bool readHeader(ifstream& in, string& tip, long& count) {
+    string magic, tipLine, countLine;
+
+    if (!getline(in, magic) || magic != MAGIC) {
+        return false;
+    }
+    if (!getline(in, tipLine) || tipLine.find("TIP:") != 0) {
+        return false;
+    }
+    if (!getline(in, countLine) || countLine.find("COUNT:") != 0) {
+        return false;
+    }
+
+    // a damaged count is just a graph that can't be used, the list loads from the commit folders instead
+    const char* digits = countLine.c_str() + 6;
+    char* end = nullptr;
+    errno = 0;
+    count = strtol(digits, &end, 10);
+    if (end == digits || *end != '\0' || errno == ERANGE || count <= 0) {
+        return false;
+    }
+
+    tip = tipLine.substr(4);
+    return !tip.empty();
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// MESSAGES
+// One line per commit, so backslashes and line breaks in a message are escaped
+//----------------------------------------------------------------------------------------------------------------------------
+
+static void appendEscaped(string& body, string_view message) {
+    for (char c : message) {
+        if (c == '\\') {
+            body += "\\\\";
+        } else if (c == '\n') {
+            body += "\\n";
+        } else if (c == '\r') {
+            body += "\\r";
+        } else {
+            body += c;
+        }
+    }
+}
+
+static string unescape(string_view text) {
+    string message;
+    message.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '\\' && i + 1 < text.size()) {
+            char next = text[++i];
+            message += next == 'n' ? '\n' : next == 'r' ? '\r' : next;
+        } else {
+            message += text[i];
+        }
+    }
+    return message;
+}
+
+static bool tipIsNewest(const filesystem::path& commitsDir, const string& tip) {
+    return readMetadataFile(commitsDir / "TIP.txt") == tip;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// IS CURRENT
+// Cheap check used to decide whether a read-only command can skip the repository lock
+//----------------------------------------------------------------------------------------------------------------------------
+
+bool CommitGraph::isCurrent(const filesystem::path& commitsDir) {
+    ifstream in(graphPath(commitsDir));
+    string tip;
+    long count;
+
+    return in && readHeader(in, tip, count) && tipIsNewest(commitsDir, tip);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// LOAD
+// Builds the nodes (oldest first) with their IDs, messages and links filled in. Returns false if there is no
+// current graph, in which case the caller loads the list from the commit folders instead
+//----------------------------------------------------------------------------------------------------------------------------
+
+bool CommitGraph::load(const filesystem::path& commitsDir, vector<CommitNode*>& nodes, Arena& arena) {
+    ifstream in(graphPath(commitsDir));
+    string tip;
+    long count;
+
+    if (!in || !readHeader(in, tip, count) || !tipIsNewest(commitsDir, tip)) {
+        Stats::add(STAT_CACHE_MISSES);
+        return false;
+    }
+    Stats::add(STAT_CACHE_HITS);
+    Stats::add(STAT_FILES_OPENED);
+
+    vector<CommitNode*> loaded;
+    loaded.reserve(min(count, 1L << 20));
+
+    string line;
+    while (getline(in, line)) {
+        size_t a = line.find(' ');
+        size_t b = (a == string::npos) ? a : line.find(' ', a + 1);
+
+        if (b == string::npos) {
+            break;
+        }
+
+        string_view view(line);
+        CommitNode* node = arena.make<CommitNode>();
+        node->setCommitID(view.substr(0, a));
+        node->setPrevID(view.substr(a + 1, b - a - 1));
+        string_view message = view.substr(b + 1);
+        if (message.find('\\') == string_view::npos) {
+            node->setCommitMsg(message);
+        } else {
+            node->setCommitMsg(unescape(message));
+        }
+
+        if (!loaded.empty()) {
+            loaded.back()->setNextNode(node);
+            node->setPrevNode(loaded.back());
+        }
+        loaded.push_back(node);
+    }
+
+    if (loaded.empty() || (long)loaded.size() != count || loaded.back()->getCommitID() != tip) {
+        return false;       // the half loaded nodes stay in the arena until the manager goes away
+    }
+
+    nodes.swap(loaded);
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// WRITE
+// Walks from the tail through the next pointers and replaces the graph file in one go
+//----------------------------------------------------------------------------------------------------------------------------
+
+void CommitGraph::write(const filesystem::path& commitsDir, CommitNode* tail) {
+    if (!tail) {
+        return;
+    }
+
+    string body;
+    long count = 0;
+    CommitNode* last = tail;
+
+    for (CommitNode* curr = tail; curr; curr = curr->getNextNode()) {
+        body.append(curr->getCommitID()).append(" ").append(curr->getPrevID()).append(" ");
+        appendEscaped(body, curr->getCommitMsg());
+        body.append("\n");
+        count++;
+        last = curr;
+    }
+
+    writeFileAtomically(graphPath(commitsDir), string(MAGIC) + "\nTIP:" + string(last->getCommitID()) +
+                                     "\nCOUNT:" + to_string(count) + "\n" + body);
+}
@@ -1,10 +1,22 @@
 #include "CommitManager.h"
 #include "HashingHelper.h"
 #include "HashingHelper.h"
+#include "Manifest.h"
+#include "BloomFilter.h"
+#include "TreeDiff.h"
+#include "FileUtils.h"
+#include "BulkIO.h"
+#include "CommitGraph.h"
+#include "Trace.h"
+#include "Repository.h"
+#include "SparseCheckout.h"
+#include "Layout.h"
+#include "CommitRecord.h"
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 
 using namespace std;
 
@@ -17,15 +29,8 @@ Made cause baar baar koi file parhni par rahi thi to get the ID
 //----------------------------------------------------------------------------------------------------------------------------
 
 static string readFile(const filesystem::path& path) {
-    if (!filesystem::exists(path)){
-        return "NA";
-    }
-
-    ifstream file(path);
-
-    string s;
-    getline(file, s); //IDs jo baar baar parhni par rahi thein
-    return s;
+    // goes through the metadata buffer so batch mode sees HEAD/TAIL/TIP writes that aren't flushed yet
+    return readMetadataFile(path);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------
@@ -34,24 +39,47 @@ static string readFile(const filesystem::path& path) {
 /* CONSTRUCTOR
 
     -Sets the head (latest commit) and tail (oldest commit) to NULL.
-    -Initializes a path variable that contains the path to the commits folder (current_directory/.Minivcs/commits)
-    -Checks if the path exists. If it doesn't, it returns, else, it calls loadListFromDisk() function.
+    -Takes the commits folder from the repository (<root>/.Minivcs/commits)
+    -Checks if the path exists. If it doesn't, it returns.
+    -If a current commit-graph snapshot exists the whole list is built from that one file,
+     otherwise it calls loadListFromDisk() and saves a fresh snapshot for the next process.
 
 */
 //----------------------------------------------------------------------------------------------------------------------------
 
-CommitManager::CommitManager() {
+CommitManager::CommitManager(const Repository* repository) : repo(repository) {
+    TRACE_SPAN("CommitManager::open");
     head = nullptr;
     tail = nullptr;
 
-    hashTable = new HashTable(50);
+    hashTable = new HashTable(50, arena.resource());
 
-    filesystem::path VCSRepo = filesystem::current_path() / ".Minivcs" / "commits";
+    filesystem::path VCSRepo = repo->getCommitsDir();
     if (!filesystem::exists(VCSRepo)) {
         return;
     }
 
+    vector<CommitNode*> nodes;
+    if (CommitGraph::load(VCSRepo, nodes, arena)) {
+        tail = nodes.front();
+        head = nodes.back();
+        hashTable->reserve(nodes.size());
+        for (CommitNode* node : nodes) {
+            hashTable->insert(node);
+        }
+        return;
+    }
+
     loadListFromDisk();
+    if (writesSuppressed()) {
+        return;     // a lock-free reader that lost a race with a commit, the next locked open writes it
+    }
+
+    try {
+        CommitGraph::write(VCSRepo, tail);
+    } catch (const exception& e) {
+        // only a cache, the next run will try again
+    }
 }
 
 //----------------------------------------------------------------------------------------------------------------------------
@@ -71,53 +99,61 @@ CommitManager::CommitManager() {
                  ↓
                 NULL
 
-We started creating our linked list from tail to head simply due to the convenience of having the nextNode of the TAIL commit not be NULL
-There is no issue in starting from the HEAD commit, but changes would be made to the direction of nodes we pick, i.e, we'll traverse using prev nodes
-
-commitPaths refers to the path "current_directory/.Minivcs/commits" where all the commits are saved, along with HEAD.txt and TAIL.txt
-
-As the name suggests, HEAD.txt holds the commitID of the head node and TAIL.txt holds the tail ID
+Commits only know their previous commit (it's in their commit.bin, which never changes), so the list is built from
+the newest one backwards. TIP.txt holds the newest commit's ID, TAIL.txt the oldest one's; both contain "NA" until
+the first commit.
 
-If there is no head or tail yet, both files will contain "NA"
+HEAD.txt is only the checked out commit (and each linked worktree has its own), it has nothing to do with the list.
 
-After loading up the head and tail pointer, we traverse the list and set the next and prev pointers accordingly.
+We load the tip, then keep loading the previous commit and linking the pair until a commit says "NA".
 
 */
 //----------------------------------------------------------------------------------------------------------------------------
 
 void CommitManager::loadListFromDisk() {
+    TRACE_SPAN("CommitManager::loadListFromDisk");
 
-    filesystem::path commitsPath = filesystem::current_path() / ".Minivcs" / "commits";
+    filesystem::path commitsPath = repo->getCommitsDir();
+    string tipID = readFile(commitsPath / "TIP.txt");
 
-    string headID = readFile(commitsPath / "HEAD.txt");
-    string tailID = readFile(commitsPath / "TAIL.txt");
-
-    if (headID == "NA" || tailID == "NA") {
+    if (tipID == "NA" || tipID.empty()) {
         return;
     }
 
-    head = loadSingleNode(headID);
-    tail = loadSingleNode(tailID);
+    head = loadSingleNode(tipID);
 
-    CommitNode* current = tail;
+    CommitNode* current = head;
 
-    if (tail != nullptr) {
-        hashTable->insert(tailID, tail);
+    if (head != nullptr) {
+        hashTable->insert(head);
+    } else {
+        repo->err() << YEL << "warning: the newest commit " << tipID << " can't be read (run minigit fsck)" << END << endl;
     }
 
-    while (current && current->getNextID() != "NA") {
-        CommitNode* next = loadSingleNode(current->getNextID());
-        current->setNextNode(next);
-        next->setPrevNode(current);
+    while (current && current->getPrevID() != "NA") {
+        // a commit that can't be read (or a pointer back into the list) ends the history here rather than crashing,
+        // what's loaded so far is still usable and fsck can say what's wrong
+        if (hashTable->exists(current->getPrevID())) {
+            repo->err() << YEL << "warning: commit " << current->getCommitID() << " points back to "
+                 << current->getPrevID() << ", history is cut short there (run minigit fsck)" << END << endl;
+            break;
+        }
 
-        if (next != nullptr) {
-            hashTable->insert(next->getCommitID(), next);
+        CommitNode* prev = loadSingleNode(current->getPrevID());
+        if (prev == nullptr) {
+            repo->err() << YEL << "warning: commit " << current->getPrevID() << " (before " << current->getCommitID()
+                 << ") can't be read, history is cut short there (run minigit fsck)" << END << endl;
+            break;
         }
 
-        current = next;
+        current->setPrevNode(prev);
+        prev->setNextNode(current);
+        hashTable->insert(prev);
+
+        current = prev;
     }
 
-    head = current;
+    tail = current;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------
@@ -126,7 +162,7 @@ void CommitManager::loadListFromDisk() {
 /* FUNCTION TO LOAD UP A SINGLE NODE
 
 We could do this part within LoadListFfromDisk but for the sake of readability and cleaner code we've seperated it.
-Taking an ID, it calls the commitNode's constructor that handles loading up one specific node from the info.txt file.
+Taking an ID, it calls the commitNode's constructor that handles loading up one specific node from its commit.bin.
 If it works, we send it back up to the caller function e.g, LoadListffromDisj
 else, the catch block returns a NULL pointer to signify said Node does not exist
 
@@ -134,9 +170,9 @@ else, the catch block returns a NULL pointer to signify said Node does not exist
 
 //----------------------------------------------------------------------------------------------------------------------------
 
-CommitNode* CommitManager::loadSingleNode(const string& id) {
+CommitNode* CommitManager::loadSingleNode(string_view id) {
     try {
-        return new CommitNode(id);
+        return arena.make<CommitNode>(id, repo->getCommitsDir());
     }
     catch (...) {
         return nullptr;
@@ -155,60 +191,65 @@ The relevant commit folder will be made by the CommitNode class constructor that
 - The function calls the hashinghelper class to create a random unique ID for the commit.
 - A new node is created by calling CommitNode(Commit ID, Commit message)
 - The function checks if the head is NULL or not
+    -the new node's previous commit is the current head ("NA" for the first commit), it goes into the commit's record
+    -once Data, Manifest.txt and the path filter are done the record (commit.bin) is written, that finishes the folder
     -if the head is null, that means that this is the first commit to be made.
         -in which case, our new node is both the head and the tail for our list.
-        - we open up two files: HEAD.txt and TAIL.txt, to store the ID of the node
-        -After writing the ID to both files, the function returns to caller
+        -TAIL.txt, TIP.txt and HEAD.txt all get the ID of the node
+        -After writing the ID to the files, the function returns to caller
 
     -if the head is not null, it means that this is NOT the first commit, and as such, we will now have a new head
-        -first we need to create the forward link between head and new node
-            -the first thing we do is to set head->next = new commit.
-            -then, we set the nextID parameter to that too.
-            -then, we save the nextID inside head's NextCommit.txt file
-        -then, we create the backward link betweem head and the new node.
-            -new node's previous node is set to head.
-            -new node's previous node id is set to head id
-            -new node's previous node id is saved in previousCommit.txt
-        -now that the connection is done, we'll set the new node asour head (latest commit)
-        -we open up HEAD.txt, and save the now current head's id to the file.
+        -we link head and the new node both ways in memory, nothing in the old head's folder changes
+        -now that the connection is done, we'll set the new node as our head (latest commit)
+        -TIP.txt and HEAD.txt get the now current head's id.
 
 */
 
 //----------------------------------------------------------------------------------------------------------------------------
 
-void CommitManager::addCommit(const string& msg) {
+void CommitManager::addCommit(const string& msg, bool fromWorkingTree) {
+    TRACE_SPAN("CommitManager::addCommit");
 
+    filesystem::path commitsDir = repo->getCommitsDir();
+    filesystem::path headFile = Repository::headFileFor(repo->getVcsRoot());
+    string checkedOut = readMetadataFile(headFile);
     string id = HASHINGHELPER_H::generateCommitID();
-    CommitNode* newNode = new CommitNode(id, msg);
+    CommitNode* newNode = arena.make<CommitNode>(id, msg, head ? head->getCommitID() : string_view("NA"), commitsDir,
+                                                 repo->getStagingArea());
+
+    // a sparse working tree only staged its cones, the rest of the snapshot comes from the commit it was based on
+    if (fromWorkingTree) {
+        SparseCheckout::load(repo->getRoot()).carryOver(commitsDir, checkedOut, id);
+    }
 
     if (head == nullptr) {
         // first commit in repo
         head = tail = newNode;
 
-        ofstream f1(filesystem::current_path() / ".Minivcs" / "commits" / "HEAD.txt");
-        ofstream f2(filesystem::current_path() / ".Minivcs" / "commits" / "TAIL.txt");
-        f1 << id;
-        f2 << id;
+        writePathFilter(newNode);
+        newNode->saveRecord(commitsDir);
+
+        writeMetadataFile(commitsDir / "TAIL.txt", id);
+        writeMetadataFile(commitsDir / "TIP.txt", id);
+        writeMetadataFile(headFile, id);
 
-        hashTable->insert(id, newNode);
+        hashTable->insert(newNode);
 
         return;
     }
 
-    head->setNextNode(newNode);
-    head->setNextID(newNode->getCommitID());
-    head->saveNextID(newNode->getCommitID());
+    writePathFilter(newNode);
+    newNode->saveRecord(commitsDir);
 
+    head->setNextNode(newNode);
     newNode->setPrevNode(head);
-    newNode->setPrevID(head->getCommitID());
-    newNode->savePrevID(head->getCommitID());
 
     head = newNode;
 
-    ofstream Hfile(filesystem::current_path() / ".Minivcs" / "commits" / "HEAD.txt");
-    Hfile << head->getCommitID();
+    writeMetadataFile(commitsDir / "TIP.txt", id);
+    writeMetadataFile(headFile, id);
 
-    hashTable->insert(id, newNode);
+    hashTable->insert(newNode);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------
@@ -263,24 +304,25 @@ We check that current_directory/.Minivcs/commits/<source commit ID> exists
 //----------------------------------------------------------------------------------------------------------------------------
 
 void CommitManager::revert(const string& commitID) {
+    TRACE_SPAN_DETAIL("CommitManager::revert", commitID);
 
     // ----------------------------------------- PART 1 -----------------------------------------
-    cout<<"checking if ID exists..."<<endl;
+    repo->out()<<"checking if ID exists..."<<endl;
     if (!commitExists(commitID)) {
-        cout << "Error: Commit '" << commitID << "' not found." << endl;
+        repo->out() << "Error: Commit '" << commitID << "' not found." << endl;
         return;
     }
-    cout<<"ID found..."<<endl;
+    repo->out()<<"ID found..."<<endl;
 
-    filesystem::path commitPath = filesystem::current_path() / ".Minivcs" / "commits" / commitID;
+    filesystem::path commitPath = Layout::commitDir(repo->getCommitsDir(), commitID);
 
     if (!filesystem::exists(commitPath)) {
-        cout << "Commit not found.\n";
+        repo->out() << "Commit not found.\n";
         return;
     }
 
     filesystem::path srcCommit = commitPath / "Data";
-    filesystem::path stagingPath = filesystem::current_path() / ".Minivcs" / "staging_area";
+    filesystem::path stagingPath = repo->getStagingArea();
 
 
     for (auto& entry : filesystem::directory_iterator(stagingPath)) {
@@ -288,32 +330,17 @@ void CommitManager::revert(const string& commitID) {
     }
 
 
-    for (auto& entry : filesystem::recursive_directory_iterator(srcCommit)) {
-
-       filesystem::path relativePath = filesystem::relative(entry.path(), srcCommit);
+    BulkIO::get().copyTree(srcCommit, stagingPath);
 
-        if (filesystem::is_directory(entry)) {
-            filesystem::create_directories(stagingPath/relativePath);
-        } else {
-            filesystem::create_directories((stagingPath/relativePath).parent_path());
-            if (filesystem::exists(stagingPath/relativePath)) {
-                filesystem::remove(stagingPath/relativePath);
-            }
-            filesystem::copy_file(entry.path(), stagingPath/relativePath);
-        }
-    }
     // ----------------------------------------- PART 2 -----------------------------------------
 
-    addCommit("Revert to " + commitID);
-
-    string newID;
+    addCommit("Revert to " + commitID, false);
 
-    ifstream h(filesystem::current_path() / ".Minivcs" / "commits" / "HEAD.txt");
-    getline(h, newID);
+    string newID(head->getCommitID());
 
 
-    filesystem::path newDataPath = filesystem::current_path() / ".Minivcs" / "commits" / newID / "Data";
-    filesystem::path workingDir = filesystem::current_path();
+    filesystem::path newDataPath = Layout::commitDir(repo->getCommitsDir(), newID) / "Data";
+    filesystem::path workingDir = repo->getRoot();
 
     for (auto& entry : filesystem::directory_iterator(workingDir)) {
         string name = entry.path().filename().string();
@@ -330,24 +357,10 @@ void CommitManager::revert(const string& commitID) {
 
 
 
-    for (auto& entry : filesystem::recursive_directory_iterator(newDataPath)) {
-
-        filesystem::path relativePath = filesystem::relative(entry.path(), newDataPath);
+    SparseCheckout sparse = SparseCheckout::load(workingDir);
+    BulkIO::get().copyTree(newDataPath, workingDir, &sparse);
 
-        if (filesystem::is_directory(entry)) {
-            filesystem::create_directories(workingDir / relativePath);
-        } else {
-            filesystem::create_directories((workingDir / relativePath).parent_path());
-
-            if (filesystem::exists(workingDir / relativePath)) {
-                filesystem::remove(workingDir / relativePath);
-            }
-            filesystem::copy_file(entry.path(), workingDir / relativePath);
-        }
-    }
-
-    cout << "Revert complete. Created commit: " << newID << "\n";
-    h.close();
+    repo->out() << "Revert complete. Created commit: " << newID << "\n";
 }
 
 //----------------------------------------------------------------------------------------------------------------------------
@@ -357,7 +370,7 @@ void CommitManager::revert(const string& commitID) {
 
 Traversal from HEAD (latest commit) to TAIL(oldest commit).
 We use previous nodes for traversal since head will not have any next nodes.
-We open the info.txt file to extract the timestamp
+We read the commit's record for its timestamp
 once we're on the correct line, we take the substring after the DATE AND TIME heading
 we then print the ID + MEssage + timestamp
 we then move to the previous node
@@ -365,34 +378,109 @@ we then move to the previous node
 
 //----------------------------------------------------------------------------------------------------------------------------
 
+string CommitManager::readCommitDate(string_view commitID) const {
+    CommitRecord record;
+    if (!record.read(Layout::commitDir(repo->getCommitsDir(), commitID))) {
+        return "";
+    }
+    return CommitRecord::formatDate(record.timestamp());
+}
+
+static void printLogEntry(const Repository* repo, CommitNode* curr) {
+    CommitRecord record;
+    bool found = record.read(Layout::commitDir(repo->getCommitsDir(), curr->getCommitID()));
+
+    repo->out() << "Commit: " << curr->getCommitID() << endl;
+    if (found && !record.author().empty()) {
+        repo->out() << "Author: " << record.author() << endl;
+    }
+    repo->out() << "Message: " << curr->getCommitMsg() << endl;
+    repo->out() << "Date: " << (found ? CommitRecord::formatDate(record.timestamp()) : "") << endl;
+    repo->out() << "------------------------------------" << endl;
+}
+
 void CommitManager::printLog(){
 
     if (!head) {
-        cout << "No commits found." << endl;
+        repo->out() << "No commits found." << endl;
         return;
     }
 
     CommitNode* curr = head;
 
     while (curr) {
-        filesystem::path infoPath = filesystem::current_path()/
-                            ".Minivcs"/"commits"/curr->getCommitID()/"info.txt";
+        printLogEntry(repo, curr);
+        curr = curr->getPrevNode();
+    }
+}
 
-        ifstream f(infoPath.string());
-        string line;
-        string timestamp;
+//----------------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------------
 
-        while (getline(f, line)) {
-            if (line.find("3. DATE & TIME OF COMMIT: ") == 0)
-                timestamp = line.substr(strlen("3. DATE & TIME OF COMMIT: "));
-        }
+/* LOG WITH CHANGES ("log --name-status")
 
-        cout << "Commit: " << curr->getCommitID() << endl;
-        cout << "Message: " << curr->getCommitMsg() << endl;
-        cout << "Date: " << timestamp << endl;
-        cout << "------------------------------------" << endl;
+Same traversal as printLog, and under every commit we list what it changed compared to its parent,
+with moved files shown as renames/copies (TreeDiff + RenameDetector) instead of a delete and an add.
+*/
 
-        curr = curr->getPrevNode();
+//----------------------------------------------------------------------------------------------------------------------------
+
+void CommitManager::printLogWithChanges() {
+
+    if (!head) {
+        repo->out() << "No commits found." << endl;
+        return;
+    }
+
+    filesystem::path commitsPath = repo->getCommitsDir();
+
+    for (CommitNode* curr = head; curr; curr = curr->getPrevNode()) {
+        printLogEntry(repo, curr);
+
+        vector<FileChange> changes = TreeDiff::compare(
+            Manifest::forCommit(commitsPath, curr->getPrevID()), Layout::commitDir(commitsPath, curr->getPrevID()) / "Data",
+            Manifest::forCommit(commitsPath, curr->getCommitID()), Layout::commitDir(commitsPath, curr->getCommitID()) / "Data");
+
+        TreeDiff::printNameStatus(changes, repo->out());
+        repo->out() << "------------------------------------" << endl;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------------
+
+/* PATH LIMITED LOG ("log -- <path>")
+
+Same traversal as printLog, but only commits that changed the given file or directory are printed.
+
+Comparing two manifests costs O(files) per commit, so on long histories we first ask the commit's
+ChangedPaths.bloom filter. A "no" from the filter is always correct, so most commits are skipped after
+reading one small file. A "maybe" is confirmed against the manifests since bloom filters can give false positives.
+
+The path is normalized first with Manifest::normalizePath so it matches the '/' separated keys we put in the filters.
+*/
+
+//----------------------------------------------------------------------------------------------------------------------------
+
+void CommitManager::printLog(const string& path) {
+
+    if (!head) {
+        repo->out() << "No commits found." << endl;
+        return;
+    }
+
+    string key = Manifest::normalizePath(path, repo->getRoot());
+    int shown = 0;
+
+    for (CommitNode* curr = head; curr; curr = curr->getPrevNode()) {
+        if (commitTouchesPath(curr, key)) {
+            printLogEntry(repo, curr);
+            shown++;
+        }
+    }
+
+    if (shown == 0) {
+        repo->out() << "No commits touched '" << key << "'." << endl;
     }
 }
 
@@ -406,15 +494,8 @@ CommitNode* CommitManager::getTail() {
     return tail;
 }
 
+// the nodes are all in the arena, which hands its chunks back when the manager goes away
 CommitManager::~CommitManager() {
-    CommitNode* curr = head;
-
-    while (curr != nullptr) {
-        CommitNode* prev = curr->getPrevNode();
-        delete curr;
-        curr = prev;
-    }
-
     head = nullptr;
     tail = nullptr;
 
@@ -425,5 +506,64 @@ bool CommitManager::commitExists(const string& commitID) {
     return hashTable->exists(commitID);
 }
 
+//----------------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------------
+
+/* CHANGED PATH FILTERS
+
+writePathFilter compares a commit's manifest with its parent's and stores a bloom filter of every changed path
+in commits/<id>/ChangedPaths.bloom. Parent directories of each path are added as well
+(a/b/c.txt also adds a/b and a) so "log -- a" can be answered from the filter too.
+
+commitTouchesPath checks the filter first and only loads manifests on a "maybe".
+Commits made before filters existed get one written the first time they are asked about.
+*/
+
+//----------------------------------------------------------------------------------------------------------------------------
+
+void CommitManager::writePathFilter(CommitNode* node) {
+    TRACE_SPAN("CommitManager::writePathFilter");
+    filesystem::path commitsDir = repo->getCommitsDir();
+    Manifest current = Manifest::forCommit(commitsDir, node->getCommitID());
+    Manifest parent = Manifest::forCommit(commitsDir, node->getPrevID());
+
+    vector<string> keys;
+    for (const string& changed : current.changedPaths(parent)) {
+        keys.push_back(changed);
+
+        size_t slash = changed.rfind('/');
+        while (slash != string::npos && slash > 0) {
+            keys.push_back(changed.substr(0, slash));
+            slash = changed.rfind('/', slash - 1);
+        }
+    }
+
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+    BloomFilter filter(keys.size());
+    for (const string& k : keys) {
+        filter.add(k);
+    }
+
+    filter.save(Layout::commitDir(commitsDir, node->getCommitID()) / "ChangedPaths.bloom");
+}
+
+bool CommitManager::commitTouchesPath(CommitNode* node, const string& path) {
+    filesystem::path commitsDir = repo->getCommitsDir();
+    filesystem::path filterPath = Layout::commitDir(commitsDir, node->getCommitID()) / "ChangedPaths.bloom";
+
+    // without a filter (and nothing may be written) the manifests answer by themselves
+    BloomFilter filter;
+    bool filtered = filter.load(filterPath);
+    if (!filtered && !writesSuppressed()) {
+        writePathFilter(node);
+        filtered = filter.load(filterPath);
+    }
 
+    if (filtered && !filter.mightContain(path)) {
+        return false;
+    }
 
+    return Manifest::forCommit(commitsDir, node->getCommitID()).touches(Manifest::forCommit(commitsDir, node->getPrevID()), path);
+}
@@ -1,40 +1,54 @@
 #include "HashingHelper.h"
 #include "CommitNode.h"
+#include "Manifest.h"
+#include "FileUtils.h"
+#include "CommitPipeline.h"
+#include "Trace.h"
+#include "Stats.h"
+#include "Layout.h"
+#include "CommitRecord.h"
 #include <fstream>
 #include <filesystem>
 #include <ctime>
 #include <iostream>
 #include <cstring>
+#include <stdexcept>
 using namespace std;
 
-CommitNode::CommitNode() {
+CommitNode::CommitNode(allocator_type alloc)
+    : commitID(alloc), commitMsg(alloc), prevCommitID(alloc) {
 
     this->nextNode = NULL;
     prevNode = NULL;
-    nextCommitID = "NA";
     prevCommitID = "NA";
 
 }
 
-CommitNode::CommitNode(string cI, string cM) {
+CommitNode::CommitNode(string_view cI, string_view cM, string_view prevID, const filesystem::path& commitsDir,
+                       const filesystem::path& stagingArea, allocator_type alloc)
+    : commitID(alloc), commitMsg(alloc), prevCommitID(alloc) {
+    TRACE_SPAN("CommitNode::create");
 
     commitID = cI;
     commitMsg = cM;
+    prevCommitID = prevID;
     nextNode = NULL;
     prevNode = NULL;
 
 
-    createCommitData();
+    createCommitData(commitsDir, stagingArea);
 
 }
 
-CommitNode::CommitNode(string cI) {
+CommitNode::CommitNode(string_view cI, const filesystem::path& commitsDir, allocator_type alloc)
+    : commitID(alloc), commitMsg(alloc), prevCommitID(alloc) {
+    TRACE_SPAN("CommitNode::load");
 
     commitID = cI;
     nextNode = NULL;
     prevNode = NULL;
 
-    loadNodeInfo();
+    loadNodeInfo(commitsDir);
 
 }
 
@@ -45,186 +59,78 @@ CUrrent Directory
 |-> .Minivcs
 |   |
 |   |->commits (where all commits are stored)
-|   |    |-> HEAD.txt  => holds ID of head commit (latest commit)
+|   |    |-> TIP.txt   => holds ID of the newest commit of the history
 |   |    |-> TAIL.txt  => holds ID of tail commit (first commit)
-|   |    |-> <Commit ID> (folders created for each commit)
+|   |    |-> HEAD.txt  => holds ID of the checked out commit
+|   |    |-> <first two characters>/<Commit ID> (folders created for each commit, see Layout.h)
 |   |    |      |
-|   |    |      |->info.txt  => holds commit ID, commit Message, timestamp
-|   |    |      |->NextCommit.txt   => holds the next commit's ID
-|   |    |      |->PrevCommit.txt   => holds the next commit's ID
+|   |    |      |->commit.bin  => ID, previous commit's ID, timestamp, author, message, manifest hash (see CommitRecord.h)
+|   |    |      |->Manifest.txt   => path, size and content hash of every file in Data
+|   |    |      |->ChangedPaths.bloom   => bloom filter of paths changed since the previous commit
 |   |    |      |->Data    => this is where all the files will get stored from the staging area after calling ("commit")
 |   |
 |   |->staging area (where files get added upon "add" command)
 |
 |->any files in the project/directory/whatever it is we wanna put version control
 */
-void CommitNode::createCommitData() {
+void CommitNode::createCommitData(const filesystem::path& commitsDir, const filesystem::path& stagingArea) {
+    TRACE_SPAN("CommitNode::createCommitData");
 
     try {
-        filesystem::create_directories(filesystem::current_path()/".Minivcs"/"commits"/commitID);
-        filesystem::create_directories(filesystem::current_path()/".Minivcs"/"commits"/commitID/"Data");
+        filesystem::create_directories(Layout::commitDir(commitsDir, commitID)/"Data");
 
-        filesystem::path currNodePath = filesystem::current_path()/".Minivcs"/"commits"/commitID/"info.txt";
+        filesystem::path dataPath = Layout::commitDir(commitsDir, commitID)/"Data";
 
-        ofstream infoFile(currNodePath.string());
 
-        if (!infoFile) {
-            throw runtime_error("Could not save info to info.txt");
-        }
-
-        time_t timestamp; //this is just to get the current time
-        time(&timestamp);
-        string ts = ctime(&timestamp);
-
-
-
-        infoFile<<"1. COMMIT ID: " + commitID + "\n2. COMMIT MESSAGE: " + commitMsg + "\n3. DATE & TIME OF COMMIT: " + ts + "\n";
-
-        infoFile.close();
-
-        filesystem::path dataPath = filesystem::current_path()/".Minivcs"/"commits"/commitID/"Data";
-        filesystem::path staging = filesystem::current_path()/".Minivcs"/"staging_area";
-
-
-        for (auto &entry : filesystem::recursive_directory_iterator(staging)) {
-            auto relative = filesystem::relative(entry.path(), staging);
-            auto dest = dataPath / relative;
-
-            if (filesystem::is_directory(entry)) {
-                filesystem::create_directories(dest);
-            } else {
-                filesystem::copy_file(entry, dest, filesystem::copy_options::overwrite_existing);
-            }
-        }
-
-        // create NextCommit.txt and PrevCommit.txt with "NA"
-        filesystem::path nextPath = filesystem::current_path()/".Minivcs"/"commits"/commitID/"NextCommit.txt";
-        filesystem::path prevPath = filesystem::current_path()/".Minivcs"/"commits"/commitID/"PrevCommit.txt";
-
-            ofstream n(nextPath.string());
-            n << "NA";
-
-
-            ofstream p(prevPath.string());
-            p << "NA";
-        n.close();
-        p.close();
-        nextCommitID = "NA";
-        prevCommitID = "NA";
+        // copy and hash in one pipelined pass, the manifest saves later comparisons from reopening Data
+        CommitPipeline::copy(stagingArea, dataPath).save(Layout::commitDir(commitsDir, commitID)/"Manifest.txt");
 
     }catch (filesystem::filesystem_error& e) {
-        cerr<<"Error occured while creating directory: "<<e.what()<<endl;
-        throw;
+        throw runtime_error(string("Error occured while creating directory: ") + e.what());
     }
 }
 
-void CommitNode::revertCommitData(string id) {
-    try{
-        filesystem::create_directories(filesystem::current_path()/".Minivcs"/"commits"/commitID/"Data");
+void CommitNode::saveRecord(const filesystem::path& commitsDir) {
+    TRACE_SPAN("CommitNode::saveRecord");
 
-        filesystem::path infoPath = filesystem::current_path()/".Minivcs"/"commits"/commitID/"info.txt";
-
-        ofstream file(infoPath.string());
-
-        if (!file) {
-            throw runtime_error("Failed to open file");
-        }
-        time_t timestamp; //this is just to get the current time
-        time(&timestamp);
-        string ts = ctime(&timestamp);
-        file<<"1. COMMIT ID: " + commitID + "\n2. COMMIT MESSAGE: " + commitMsg + "\n3. DATE & TIME OF COMMIT: " + ts + "\n";
-
-        filesystem::path OldPath = filesystem::current_path()/".Minivcs"/"commits"/id/"Data";
-
-        if (!filesystem::exists(OldPath)) {
-            throw runtime_error("Old directory doesn't exist");
-        }
-
-        filesystem::path newDataPath = filesystem::current_path()/".Minivcs"/"commits"/commitID/"Data";
-
-        for (auto &entry : filesystem::recursive_directory_iterator(OldPath)) {
-            auto relative = filesystem::relative(entry.path(), OldPath);
-            auto dest = newDataPath / relative;
-
-            if (filesystem::is_directory(entry)) {
-                filesystem::create_directories(dest);
-            } else {
-                filesystem::copy_file(entry, dest, filesystem::copy_options::overwrite_existing);
-            }
-
-        }
-    }catch (filesystem::filesystem_error& e) {
-        cerr<<"Something went wrong while creating the directory: "<<e.what()<<endl;
-    }
+    CommitRecord::write(Layout::commitDir(commitsDir, commitID), commitID, prevCommitID, commitMsg);
 }
-void CommitNode::loadNodeInfo() {
 
-    filesystem::path infoPath = filesystem::current_path()/".Minivcs"/"commits"/commitID/"info.txt";
+void CommitNode::loadNodeInfo(const filesystem::path& commitsDir) {
 
-    if (!filesystem::exists(infoPath)) {
-        throw runtime_error("Could not find specified path!");
-    }
-
-    ifstream fileInfo(infoPath);
-    if (!fileInfo) {
-        throw runtime_error("Could not find specified file!");
-    }
-    string line;
-    while (getline(fileInfo, line)) {
-
-        if (line.find("1. COMMIT ID: ") == 0) {
-            commitID = line.substr(strlen("1. COMMIT ID: "));
-        }
-        else if (line.find("2. COMMIT MESSAGE: ") == 0) {
-            commitMsg = line.substr(strlen("2. COMMIT MESSAGE: "));
-        }else {
-            continue;
-        }
+    CommitRecord record;
+    if (!record.read(Layout::commitDir(commitsDir, commitID))) {
+        throw runtime_error("Could not read the record of commit " + string(commitID));
     }
-
-    filesystem::path nextPath = filesystem::current_path()/".Minivcs"/"commits"/commitID/"NextCommit.txt";
-    if (filesystem::exists(nextPath)) {
-        ifstream f(nextPath);
-        getline(f, nextCommitID);
-    } else {
-        nextCommitID = "NA";
+    // a record copied or moved into the wrong folder would otherwise swap commits without a word
+    if (record.id() != commitID) {
+        throw runtime_error("The record of commit " + string(commitID) + " names commit " + string(record.id()));
     }
 
-    filesystem::path prevPath = filesystem::current_path()/".Minivcs"/"commits"/commitID/"PrevCommit.txt";
-    if (filesystem::exists(prevPath)) {
-        ifstream f(prevPath);
-        getline(f, prevCommitID);
-    } else {
-        prevCommitID = "NA";
-    }
+    commitMsg = record.message();
+    prevCommitID = record.parent();
 }
 
 
 
 
 
-void CommitNode::setCommitID(string i) {
+void CommitNode::setCommitID(string_view i) {
 
     commitID = i;
 }
 
-void CommitNode::setCommitMsg(string m) {
+void CommitNode::setCommitMsg(string_view m) {
 
     commitMsg = m;
 }
 
-void CommitNode::setNextID(string n) {
-
-    nextCommitID = n;
-
-}
-
 void CommitNode::setNextNode(CommitNode*n) {
 
     nextNode = n;
 }
 
-void CommitNode::setPrevID(string n) {
+void CommitNode::setPrevID(string_view n) {
 
     prevCommitID = n;
 
@@ -235,23 +141,19 @@ void CommitNode::setPrevNode(CommitNode*n) {
     prevNode = n;
 }
 
-string CommitNode::getCommitID() {
+string_view CommitNode::getCommitID() const {
     return commitID;
 }
 
-string CommitNode::getCommitMsg() {
+string_view CommitNode::getCommitMsg() const {
     return commitMsg;
 }
 
-string CommitNode::getNextID() {
-    return nextCommitID;
-}
-
 CommitNode* CommitNode::getNextNode() {
     return nextNode;
 }
 
-string CommitNode::getPrevID() {
+string_view CommitNode::getPrevID() const {
     return prevCommitID;
 }
 
@@ -259,35 +161,3 @@ CommitNode* CommitNode::getPrevNode() {
     return prevNode;
 }
 
-
-
-
-void CommitNode::saveNextID(string id) {
-
-
-    filesystem::path path = filesystem::current_path()/".Minivcs"/"commits"/commitID/"NextCommit.txt";
-
-    ofstream file(path.string());
-    if (!file) {
-        throw runtime_error("Could not save id to prevcommit.txt");
-    }
-
-    file<<id;
-    file.close();
-
-}
-
-void CommitNode::savePrevID(string id) {
-
-
-    filesystem::path path = filesystem::current_path()/".Minivcs"/"commits"/commitID/"PrevCommit.txt";
-
-    ofstream file(path.string());
-    if (!file) {
-        throw runtime_error("Could not save id to nextcommit.txt");
-    }
-
-    file<<id;
-    file.close();
-
-}
@@ -0,0 +1,219 @@
+#include "CommitPipeline.h"
+#include "SpscQueue.h"
+#include "HashingHelper.h"
+#include "Trace.h"
+#include "Stats.h"
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+using namespace std;
+
+struct PipelineFile {
+    filesystem::path source;
+    filesystem::path dest;
+    string key;             // manifest path, relative to the source with '/' separators
+};
+
+// buffers are plain char arrays, a string or vector would zero every block before it's read into
+typedef unique_ptr<char[]> BlockBuffer;
+
+struct PipelineBlock {
+    shared_ptr<PipelineFile> file;   // nullptr marks the end of the stream
+    BlockBuffer data;
+    size_t length;
+    bool first;
+    bool last;
+};
+
+/*
+Shared between the stages of one copy: the abort flag every queue wait checks,
+and the first error message (later ones are usually just consequences of it)
+*/
+struct PipelineState {
+    atomic<bool> failed;
+    mutex errorLock;
+    string error;
+
+    PipelineState() : failed(false) {}
+
+    void fail(const string& message) {
+        lock_guard<mutex> guard(errorLock);
+        if (!failed.load()) {
+            error = message;
+            failed.store(true);
+        }
+    }
+};
+
+//----------------------------------------------------------------------------------------------------------------------------
+// STAGES
+//----------------------------------------------------------------------------------------------------------------------------
+
+static void scanStage(const filesystem::path& source, const filesystem::path& dest,
+                      SpscQueue<shared_ptr<PipelineFile>>& files, PipelineState& state) {
+    TRACE_SPAN("scan stage");
+    try {
+        for (auto& entry : filesystem::recursive_directory_iterator(source)) {
+            if (state.failed.load()) {
+                return;
+            }
+
+            filesystem::path relative = filesystem::relative(entry.path(), source);
+
+            if (entry.is_directory()) {
+                if (filesystem::create_directories(dest / relative)) {
+                    Stats::add(STAT_DIRS_CREATED);
+                }
+            } else if (entry.is_regular_file()) {
+                shared_ptr<PipelineFile> file(new PipelineFile{entry.path(), dest / relative, relative.generic_string()});
+                if (!files.push(file, state.failed)) {
+                    return;
+                }
+            }
+        }
+    } catch (const exception& e) {
+        state.fail(e.what());
+    }
+    files.push(nullptr, state.failed);
+}
+
+static void readStage(SpscQueue<shared_ptr<PipelineFile>>& files, SpscQueue<PipelineBlock>& blocks,
+                      SpscQueue<BlockBuffer>& spare, PipelineState& state) {
+    Trace::setThreadName("pipeline read");
+    shared_ptr<PipelineFile> file;
+
+    while (files.pop(file, state.failed) && file) {
+        TRACE_SPAN_DETAIL("read_file", file->key);
+        ifstream in(file->source, ios::binary);
+        if (!in) {
+            state.fail("Could not read '" + file->source.string() + "'");
+            return;
+        }
+        Stats::add(STAT_FILES_OPENED);
+
+        bool first = true;
+        bool last = false;
+        while (!last) {
+            PipelineBlock block = {file, nullptr, 0, first, false};
+            if (!spare.tryPop(block.data)) {
+                block.data.reset(new char[CommitPipeline::BLOCK_SIZE]);
+            }
+
+            in.read(block.data.get(), CommitPipeline::BLOCK_SIZE);
+            block.length = in.gcount();
+            Stats::add(STAT_BYTES_READ, block.length);
+            if (in.bad()) {
+                state.fail("Could not read '" + file->source.string() + "'");
+                return;
+            }
+
+            // a short read means end of file, so a file is always closed by exactly one last block (empty files too)
+            last = block.length < CommitPipeline::BLOCK_SIZE || in.peek() == EOF;
+            block.last = last;
+            first = false;
+
+            if (!blocks.push(move(block), state.failed)) {
+                return;
+            }
+        }
+    }
+
+    blocks.push(PipelineBlock{nullptr, nullptr, 0, false, true}, state.failed);
+}
+
+static void hashStage(SpscQueue<PipelineBlock>& in, SpscQueue<PipelineBlock>& out,
+                      Manifest& manifest, PipelineState& state) {
+    Trace::setThreadName("pipeline hash");
+    TRACE_SPAN("hash stage");
+    PipelineBlock block;
+    uint64_t hash = FNV_OFFSET;
+    uintmax_t size = 0;
+
+    while (in.pop(block, state.failed)) {
+        if (!block.file) {
+            out.push(move(block), state.failed);
+            return;
+        }
+
+        if (block.first) {
+            hash = FNV_OFFSET;
+            size = 0;
+        }
+        hash = hashUpdate(hash, block.data.get(), block.length);
+        size += block.length;
+
+        if (block.last) {
+            manifest.add(block.file->key, ManifestEntry(formatHash(hash), size));
+        }
+
+        if (!out.push(move(block), state.failed)) {
+            return;
+        }
+    }
+}
+
+static void writeStage(SpscQueue<PipelineBlock>& blocks, SpscQueue<BlockBuffer>& spare, PipelineState& state) {
+    Trace::setThreadName("pipeline write");
+    TRACE_SPAN("write stage");
+    PipelineBlock block;
+    ofstream out;
+
+    while (blocks.pop(block, state.failed) && block.file) {
+        if (block.first) {
+            out.open(block.file->dest, ios::binary | ios::trunc);
+            Stats::add(STAT_FILES_OPENED);
+        }
+
+        out.write(block.data.get(), block.length);
+        Stats::add(STAT_BYTES_WRITTEN, block.length);
+
+        if (block.last) {
+            out.close();
+        }
+        if (out.fail()) {
+            state.fail("Could not write '" + block.file->dest.string() + "'");
+            return;
+        }
+
+        // hand the buffer back to the reader, if its spare queue is full the buffer is just freed
+        spare.tryPush(block.data);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// COPY
+// The calling thread does the scan, the other three stages get a thread each
+//----------------------------------------------------------------------------------------------------------------------------
+
+Manifest CommitPipeline::copy(const filesystem::path& source, const filesystem::path& dest) {
+    TRACE_SPAN("CommitPipeline::copy");
+    Manifest manifest;
+    filesystem::create_directories(dest);
+
+    if (!filesystem::exists(source)) {
+        return manifest;
+    }
+
+    PipelineState state;
+    SpscQueue<shared_ptr<PipelineFile>> files(QUEUE_DEPTH * 4);
+    SpscQueue<PipelineBlock> readBlocks(QUEUE_DEPTH);
+    SpscQueue<PipelineBlock> hashedBlocks(QUEUE_DEPTH);
+    SpscQueue<BlockBuffer> spare(QUEUE_DEPTH * 2);
+
+    thread reader(readStage, ref(files), ref(readBlocks), ref(spare), ref(state));
+    thread hasher(hashStage, ref(readBlocks), ref(hashedBlocks), ref(manifest), ref(state));
+    thread writer(writeStage, ref(hashedBlocks), ref(spare), ref(state));
+
+    scanStage(source, dest, files, state);
+
+    reader.join();
+    hasher.join();
+    writer.join();
+
+    if (state.failed.load()) {
+        throw runtime_error(state.error);
+    }
+    return manifest;
+}
@@ -0,0 +1,308 @@
+#include "CommitRecord.h"
+#include "HashingHelper.h"
+#include "Manifest.h"
+#include "FileUtils.h"
+#include "Layout.h"
+#include "Stats.h"
+#include "Trace.h"
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <iomanip>
+#include <sstream>
+#else
+#include <unistd.h>
+#include <pwd.h>
+#endif
+
+using namespace std;
+
+const char* const CommitRecord::FILE_NAME = "commit.bin";
+
+static const char MAGIC[4] = {'M', 'G', 'C', 'R'};
+
+// fixed width ID fields aren't terminated, a zero byte only ever pads
+static string_view idField(const char (&field)[COMMIT_ID_SIZE]) {
+    return string_view(field, strnlen(field, COMMIT_ID_SIZE));
+}
+
+static void setIdField(char (&field)[COMMIT_ID_SIZE], string_view value) {
+    if (value.size() > COMMIT_ID_SIZE) {
+        throw runtime_error("'" + string(value) + "' is too long for a commit record");
+    }
+    memset(field, 0, COMMIT_ID_SIZE);
+    memcpy(field, value.data(), value.size());
+}
+
+// the raw file calls read() needs, binary on Windows so nothing gets translated
+#ifdef _WIN32
+static int openRecord(const filesystem::path& file) {
+    return _wopen(file.c_str(), _O_RDONLY | _O_BINARY);
+}
+static long long readSome(int fd, char* into, size_t size) {
+    return _read(fd, into, (unsigned)size);
+}
+static long long fileSize(int fd) {
+    struct _stat64 info;
+    return _fstat64(fd, &info) == 0 ? info.st_size : -1;
+}
+static void closeRecord(int fd) {
+    _close(fd);
+}
+#else
+static int openRecord(const filesystem::path& file) {
+    return open(file.c_str(), O_RDONLY | O_CLOEXEC);
+}
+static long long readSome(int fd, char* into, size_t size) {
+    return ::read(fd, into, size);
+}
+static long long fileSize(int fd) {
+    struct stat info;
+    return fstat(fd, &info) == 0 ? info.st_size : -1;
+}
+static void closeRecord(int fd) {
+    close(fd);
+}
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------------
+// READ
+// Usually one read() fills the inline buffer with everything. If it came back full the file may be bigger, then (and
+// only then) the whole file goes into a string
+//----------------------------------------------------------------------------------------------------------------------------
+
+bool CommitRecord::read(const filesystem::path& commitDir) {
+    overflow.clear();
+
+    int fd = openRecord(commitDir / FILE_NAME);
+    if (fd < 0) {
+        return false;
+    }
+    Stats::add(STAT_FILES_OPENED);
+
+    long long got = readSome(fd, buffer, INLINE_SIZE);
+    size_t size = got < 0 ? 0 : got;
+
+    if (got == (long long)INLINE_SIZE) {
+        long long total = fileSize(fd);
+        if (total < (long long)size) {
+            closeRecord(fd);
+            return false;
+        }
+        overflow.resize(total);
+        memcpy(overflow.data(), buffer, size);
+        while (size < overflow.size()) {
+            got = readSome(fd, overflow.data() + size, overflow.size() - size);
+            if (got <= 0) {
+                break;
+            }
+            size += got;
+        }
+    }
+    closeRecord(fd);
+    Stats::add(STAT_BYTES_READ, size);
+
+    if (size < sizeof(CommitRecordHeader)) {
+        return false;
+    }
+    memcpy(&header, buffer, sizeof(header));
+
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version == 0 || header.version > VERSION ||
+        header.headerSize < sizeof(CommitRecordHeader)) {
+        return false;
+    }
+    return (uintmax_t)header.headerSize + header.authorSize + header.messageSize == size;
+}
+
+const char* CommitRecord::text() const {
+    return (overflow.empty() ? buffer : overflow.data()) + header.headerSize;
+}
+
+string_view CommitRecord::id() const {
+    return idField(header.id);
+}
+
+string_view CommitRecord::parent() const {
+    string_view parent = idField(header.parent);
+    return parent.empty() ? "NA" : parent;
+}
+
+string_view CommitRecord::tree() const {
+    return idField(header.tree);
+}
+
+time_t CommitRecord::timestamp() const {
+    return header.timestamp;
+}
+
+string_view CommitRecord::author() const {
+    return string_view(text(), header.authorSize);
+}
+
+string_view CommitRecord::message() const {
+    return string_view(text() + header.authorSize, header.messageSize);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// WRITE
+//----------------------------------------------------------------------------------------------------------------------------
+
+static void writeRecord(const filesystem::path& commitDir, string_view id, string_view parent, time_t timestamp,
+                        const string& author, string_view message) {
+    CommitRecordHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = CommitRecord::VERSION;
+    header.headerSize = sizeof(CommitRecordHeader);
+    header.timestamp = timestamp;
+    setIdField(header.id, id);
+    setIdField(header.parent, parent == "NA" ? "" : parent);
+    setIdField(header.tree, hashFileContents(commitDir / "Manifest.txt"));
+    header.authorSize = author.size();
+    header.messageSize = message.size();
+
+    string contents(reinterpret_cast<const char*>(&header), sizeof(header));
+    contents.append(author).append(message);
+    writeFileAtomically(commitDir / CommitRecord::FILE_NAME, contents);
+}
+
+void CommitRecord::write(const filesystem::path& commitDir, string_view id, string_view parent, string_view message) {
+    writeRecord(commitDir, id, parent, time(nullptr), defaultAuthor(), message);
+}
+
+string CommitRecord::defaultAuthor() {
+    if (const char* author = getenv("MINIGIT_AUTHOR")) {
+        return author;
+    }
+#ifdef _WIN32
+    if (const char* user = getenv("USERNAME")) {
+        return user;
+    }
+#else
+    if (const passwd* user = getpwuid(getuid())) {
+        return user->pw_name;
+    }
+#endif
+    return "";
+}
+
+string CommitRecord::formatDate(time_t timestamp) {
+    char text[64];
+    tm local;
+#ifdef _WIN32
+    localtime_s(&local, &timestamp);
+#else
+    localtime_r(&timestamp, &local);
+#endif
+    strftime(text, sizeof(text), "%a %b %e %H:%M:%S %Y", &local);
+    return text;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// OLDER REPOSITORIES
+// info.txt is "1. COMMIT ID: ", "2. COMMIT MESSAGE: " and "3. DATE & TIME OF COMMIT: " (ctime) lines, the list is
+// TAIL.txt and every commit's NextCommit.txt
+//----------------------------------------------------------------------------------------------------------------------------
+
+static const char* LEGACY_FILES[] = {"info.txt", "NextCommit.txt", "PrevCommit.txt"};
+
+bool CommitRecord::isLegacy(const filesystem::path& commitsDir) {
+    if (filesystem::exists(commitsDir / "TIP.txt")) {
+        return false;
+    }
+    string tail = readMetadataFile(commitsDir / "TAIL.txt");
+    return tail != "NA" && !tail.empty();
+}
+
+void CommitRecord::writeFromLegacy(const filesystem::path& commitDir, const string& id, const string& parent) {
+    ifstream info(commitDir / "info.txt");
+    if (!info) {
+        throw runtime_error("commit " + id + " has no info.txt");
+    }
+
+    string line, message, date;
+    while (getline(info, line)) {
+        if (line.rfind("2. COMMIT MESSAGE: ", 0) == 0) {
+            message = line.substr(strlen("2. COMMIT MESSAGE: "));
+        } else if (line.rfind("3. DATE & TIME OF COMMIT: ", 0) == 0) {
+            date = line.substr(strlen("3. DATE & TIME OF COMMIT: "));
+        }
+    }
+
+    // ctime wrote local time, mktime reads it back the same way. The file's own age is the fallback
+    tm parsed = {};
+    parsed.tm_isdst = -1;
+    time_t timestamp = -1;
+#ifdef _WIN32
+    istringstream in(date);
+    in >> get_time(&parsed, "%a %b %d %H:%M:%S %Y");
+    if (!in.fail()) {
+        timestamp = mktime(&parsed);
+    }
+    if (timestamp == -1) {
+        struct _stat64 status;
+        timestamp = _wstat64((commitDir / "info.txt").c_str(), &status) == 0 ? status.st_mtime : time(nullptr);
+    }
+#else
+    if (strptime(date.c_str(), "%a %b %d %H:%M:%S %Y", &parsed)) {
+        timestamp = mktime(&parsed);
+    }
+    if (timestamp == -1) {
+        struct stat status;
+        timestamp = stat((commitDir / "info.txt").c_str(), &status) == 0 ? status.st_mtime : time(nullptr);
+    }
+#endif
+
+    // older commits may not have a manifest yet, the record names its hash
+    if (!filesystem::exists(commitDir / "Manifest.txt")) {
+        Manifest::build(commitDir / "Data").save(commitDir / "Manifest.txt");
+    }
+    writeRecord(commitDir, id, parent, timestamp, "", message);
+}
+
+void CommitRecord::removeLegacy(const filesystem::path& commitDir) {
+    error_code ec;
+    for (const char* name : LEGACY_FILES) {
+        filesystem::remove(commitDir / name, ec);
+    }
+}
+
+int CommitRecord::convertLegacy(const filesystem::path& commitsDir) {
+    TRACE_SPAN("CommitRecord::convertLegacy");
+    flushMetadataWrites();
+
+    vector<string> ids;
+    unordered_set<string> seen;
+    for (string id = readMetadataFile(commitsDir / "TAIL.txt"); id != "NA" && !id.empty();
+         id = readMetadataFile(Layout::commitDir(commitsDir, id) / "NextCommit.txt")) {
+        if (!seen.insert(id).second) {
+            throw runtime_error("the history loops back on itself at " + id + " (see minigit fsck)");
+        }
+        if (!filesystem::is_directory(Layout::commitDir(commitsDir, id))) {
+            throw runtime_error("commit " + id + " is missing, the history can't be converted (see minigit fsck)");
+        }
+        ids.push_back(id);
+    }
+
+    for (size_t i = 0; i < ids.size(); i++) {
+        writeFromLegacy(Layout::commitDir(commitsDir, ids[i]), ids[i], i == 0 ? "NA" : ids[i - 1]);
+    }
+
+    // from here on it's a converted repository, the commit graph is rebuilt from the records
+    writeFileAtomically(commitsDir / "TIP.txt", ids.empty() ? "NA" : ids.back());
+    error_code ec;
+    filesystem::remove(commitsDir / "commit-graph.txt", ec);
+
+    for (const string& id : ids) {
+        removeLegacy(Layout::commitDir(commitsDir, id));
+    }
+    return ids.size();
+}
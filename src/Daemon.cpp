@@ -0,0 +1,371 @@
+#include "Daemon.h"
+#include "Commands.h"
+#include "RepoLock.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstdint>
+#include <chrono>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+using namespace std;
+
+// relative to the repository root so the 108 byte sun_path limit never bites
+filesystem::path Daemon::socketPath() {
+    return filesystem::path(".Minivcs") / "daemon.sock";
+}
+
+#ifdef _WIN32
+
+bool Daemon::forward(const vector<string>&, int&) {
+    return false;
+}
+
+int Daemon::serve() {
+    cerr << RED << "fatal: daemon mode needs unix domain sockets and is not supported on windows" << END << endl;
+    return 1;
+}
+
+int Daemon::stop() {
+    cerr << RED << "fatal: daemon mode is not supported on windows" << END << endl;
+    return 1;
+}
+
+#else
+
+static volatile sig_atomic_t stopRequested = 0;
+
+// a client gets this long to send its request, the daemon this long to take one on (see forward)
+static const int REQUEST_TIMEOUT_MS = 2000;
+static const int ACCEPT_TIMEOUT_MS = 5000;
+
+using Deadline = chrono::steady_clock::time_point;
+static const Deadline NO_DEADLINE = Deadline::max();
+
+static Deadline inMilliseconds(int ms) {
+    return chrono::steady_clock::now() + chrono::milliseconds(ms);
+}
+
+static void onSignal(int) {
+    stopRequested = 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// SOCKET HELPERS
+// read/write the exact number of bytes, retrying on EINTR and short transfers. Reads with a deadline give up once
+// it passes, so a peer that stalls can't hold the other side forever
+//----------------------------------------------------------------------------------------------------------------------------
+
+static bool waitReadable(int fd, Deadline deadline) {
+    if (deadline == NO_DEADLINE) {
+        return true;
+    }
+    while (true) {
+        auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        if (left <= 0) {
+            return false;
+        }
+        pollfd p = {fd, POLLIN, 0};
+        int ready = poll(&p, 1, (int)left);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        return ready > 0;
+    }
+}
+
+// writes that block this long fail, for a peer that stopped reading
+static void setSendTimeout(int fd, int ms) {
+    timeval timeout = {ms / 1000, (ms % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+static bool writeAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, char* data, size_t len, Deadline deadline = NO_DEADLINE) {
+    while (len > 0) {
+        if (!waitReadable(fd, deadline)) {
+            return false;
+        }
+        ssize_t n = read(fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void appendU32(string& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        out += (char)((v >> (8 * i)) & 0xff);
+    }
+}
+
+static bool readU32(int fd, uint32_t& v, Deadline deadline = NO_DEADLINE) {
+    unsigned char b[4];
+    if (!readAll(fd, (char*)b, 4, deadline)) {
+        return false;
+    }
+    v = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+    return true;
+}
+
+static bool sendFrame(int fd, char type, const string& payload) {
+    string frame(1, type);
+    appendU32(frame, payload.size());
+    frame += payload;
+    return writeAll(fd, frame.data(), frame.size());
+}
+
+static int connectToDaemon() {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, Daemon::socketPath().c_str(), sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// FORWARD (client side)
+//----------------------------------------------------------------------------------------------------------------------------
+
+bool Daemon::forward(const vector<string>& args, int& exitCode) {
+    if (getenv("MINIGIT_NO_DAEMON") || args.empty() || !filesystem::exists(socketPath())) {
+        return false;
+    }
+
+    // bundles stream through this process's stdin / stdout
+    if (args[0] == "init" || args[0] == "bundle" || args[0] == "archive" || args[0] == "show" || args[0] == "worktree" || (args[0] == "daemon" && (args.size() < 2 || args[1] != "stop"))) {
+        return false;
+    }
+
+    int fd = connectToDaemon();
+    if (fd < 0) {
+        return false;       // stale socket, run locally
+    }
+
+    string request = "MGD2";
+    appendU32(request, args.size());
+    for (const string& arg : args) {
+        appendU32(request, arg.size());
+        request += arg;
+    }
+
+    // a daemon busy (or stuck) elsewhere doesn't get to hold this command up, it runs locally instead. Nothing runs
+    // over there until the 'g' below, so once we stop waiting it can't run twice
+    setSendTimeout(fd, ACCEPT_TIMEOUT_MS);
+    char type;
+    uint32_t len;
+    Deadline deadline = inMilliseconds(ACCEPT_TIMEOUT_MS);
+    if (!writeAll(fd, request.data(), request.size()) || !readAll(fd, &type, 1, deadline) ||
+        !readU32(fd, len, deadline) || type != 'a' || len != 0 || !writeAll(fd, "g", 1)) {
+        close(fd);
+        return false;
+    }
+
+    exitCode = 1;
+    while (true) {
+        if (!readAll(fd, &type, 1) || !readU32(fd, len)) {
+            cerr << RED << "error: lost connection to minigit daemon" << END << endl;
+            break;
+        }
+
+        string payload(len, '\0');
+        if (len > 0 && !readAll(fd, &payload[0], len)) {
+            cerr << RED << "error: lost connection to minigit daemon" << END << endl;
+            break;
+        }
+
+        if (type == 'o') {
+            cout << payload << flush;
+        } else if (type == 'e') {
+            cerr << payload << flush;
+        } else if (type == 'x') {
+            exitCode = atoi(payload.c_str());
+            break;
+        }
+    }
+
+    close(fd);
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// SERVE
+/*
+    -refuse to start if another daemon already answers on the socket, otherwise remove the stale socket
+    -load the session once
+    -for every connection: read the arguments, take the repository lock, reload if someone else changed
+     the repository, run the command printing into buffers, send the output and exit code back
+    -SIGINT/SIGTERM or "minigit daemon stop" end the loop and remove the socket
+*/
+//----------------------------------------------------------------------------------------------------------------------------
+
+int Daemon::serve() {
+    int existing = connectToDaemon();
+    if (existing >= 0) {
+        close(existing);
+        cerr << YEL << "A minigit daemon is already running for this repository" << END << endl;
+        return 1;
+    }
+
+    filesystem::remove(socketPath());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath().c_str(), sizeof(addr.sun_path) - 1);
+
+    if (listener < 0 || bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 64) != 0) {
+        cerr << RED << "fatal: could not listen on " << socketPath() << ": " << strerror(errno) << END << endl;
+        return 1;
+    }
+    chmod(socketPath().c_str(), 0600);
+
+    struct sigaction sa = {};
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    Session session;
+    {
+        RepoLock lock(session.repo.getVcsRoot(), RepoLock::Shared);
+        session.load();
+    }
+    string stamp = session.stamp();
+
+    cout << GRN << "minigit daemon listening on " << socketPath().string() << END << endl;
+
+    while (!stopRequested) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            continue;       // EINTR from a signal, loop condition decides
+        }
+
+        // a client that stalls is dropped, everyone else is waiting behind it
+        setSendTimeout(client, REQUEST_TIMEOUT_MS);
+        Deadline deadline = inMilliseconds(REQUEST_TIMEOUT_MS);
+
+        char magic[4];
+        uint32_t count = 0;
+        vector<string> args;
+        bool ok = readAll(client, magic, 4, deadline) && string(magic, 4) == "MGD2" &&
+                  readU32(client, count, deadline) && count < 65536;
+
+        for (uint32_t i = 0; ok && i < count; i++) {
+            uint32_t len;
+            ok = readU32(client, len, deadline) && len < (1u << 24);
+            if (ok) {
+                string arg(len, '\0');
+                ok = len == 0 || readAll(client, &arg[0], len, deadline);
+                args.push_back(arg);
+            }
+        }
+
+        // taken on only if the client still wants it (it may have given up waiting and run the command itself)
+        char go = 0;
+        ok = ok && !args.empty() && sendFrame(client, 'a', "") &&
+             readAll(client, &go, 1, inMilliseconds(REQUEST_TIMEOUT_MS)) && go == 'g';
+
+        if (!ok) {
+            close(client);
+            continue;
+        }
+
+        if (args[0] == "daemon") {
+            sendFrame(client, 'o', "minigit daemon stopped\n");
+            sendFrame(client, 'x', "0");
+            close(client);
+            break;
+        }
+
+        ostringstream out, err;
+        int exitCode = 1;
+        {
+            RepoLock lock(session.repo.getVcsRoot(), isReadOnlyCommand(args) ? RepoLock::Shared : RepoLock::Exclusive,
+                          true, err);
+
+            if (session.stamp() != stamp) {
+                session.load();
+            }
+
+            session.repo.setOutput(out, err);
+
+            try {
+                exitCode = runCommand(session, args);
+                session.statCache->save();
+            } catch (const exception& e) {
+                err << RED << "error: " << e.what() << END << endl;
+                session.load();     // whatever was in memory may be half updated
+            }
+
+            session.repo.setOutput(cout, cerr);
+
+            stamp = session.stamp();
+        }
+
+        if (!out.str().empty()) {
+            sendFrame(client, 'o', out.str());
+        }
+        if (!err.str().empty()) {
+            sendFrame(client, 'e', err.str());
+        }
+        sendFrame(client, 'x', to_string(exitCode));
+        close(client);
+    }
+
+    close(listener);
+    filesystem::remove(socketPath());
+    return 0;
+}
+
+int Daemon::stop() {
+    int exitCode = 0;
+    if (!forward({"daemon", "stop"}, exitCode)) {
+        cout << YEL << "No minigit daemon is running" << END << endl;
+        return 1;
+    }
+    return exitCode;
+}
+
+#endif
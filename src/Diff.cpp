@@ -0,0 +1,233 @@
+#include "Diff.h"
+#include "HashingHelper.h"
+#include "Repository.h"
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// READ LINES
+// Splits a file into lines without the trailing '\n' (and '\r' for files written on windows)
+// Missing files read as empty so "file added" and "file deleted" are just diffs against nothing
+//----------------------------------------------------------------------------------------------------------------------------
+
+vector<string> Diff::readLines(const filesystem::path& file) {
+    vector<string> lines;
+
+    ifstream in(file, ios::binary);
+    if (!in) {
+        return lines;
+    }
+
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        lines.push_back(line);
+    }
+
+    return lines;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// COMPUTE
+/*
+Myers' algorithm finds the shortest edit script by exploring diagonals k = x - y.
+v[k] holds the furthest x reached on diagonal k after d edits, and we follow "snakes"
+(runs of equal lines) for free. The first d where we reach (N, M) is the edit distance.
+
+To keep it fast:
+    - the common prefix and suffix are stripped first since most edits are local
+    - lines are compared by their FNV-1a hash, then by content only when the hashes match
+    - for backtracking we only keep v[-d..d] for every d, so memory is O(D^2) instead of O(D*(N+M))
+*/
+//----------------------------------------------------------------------------------------------------------------------------
+
+vector<DiffEdit> Diff::compute(const vector<string>& oldLines, const vector<string>& newLines) {
+    vector<DiffEdit> edits;
+
+    int n = static_cast<int>(oldLines.size());
+    int m = static_cast<int>(newLines.size());
+
+    int prefix = 0;
+    while (prefix < n && prefix < m && oldLines[prefix] == newLines[prefix]) {
+        prefix++;
+    }
+
+    int suffix = 0;
+    while (suffix < n - prefix && suffix < m - prefix &&
+           oldLines[n - 1 - suffix] == newLines[m - 1 - suffix]) {
+        suffix++;
+    }
+
+    for (int i = 0; i < prefix; i++) {
+        edits.push_back(DiffEdit(' ', i, i));
+    }
+
+    int N = n - prefix - suffix;
+    int M = m - prefix - suffix;
+
+    vector<uint64_t> a(N), b(M);
+    for (int i = 0; i < N; i++) a[i] = hashString(oldLines[prefix + i]);
+    for (int i = 0; i < M; i++) b[i] = hashString(newLines[prefix + i]);
+
+    auto same = [&](int x, int y) {
+        return a[x] == b[y] && oldLines[prefix + x] == newLines[prefix + y];
+    };
+
+    int maxD = N + M;
+    int offset = maxD + 1;
+    vector<int> v(2 * maxD + 3, 0);
+    vector<vector<int>> trace;   // trace[d][k + d] = v[k] after step d
+
+    for (int d = 0; d <= maxD; d++) {
+        bool done = false;
+
+        for (int k = -d; k <= d; k += 2) {
+            int x;
+            if (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) {
+                x = v[offset + k + 1];          // step down (insertion)
+            } else {
+                x = v[offset + k - 1] + 1;      // step right (deletion)
+            }
+
+            int y = x - k;
+            while (x < N && y < M && same(x, y)) {
+                x++;
+                y++;
+            }
+
+            v[offset + k] = x;
+            if (x >= N && y >= M) {
+                done = true;
+            }
+        }
+
+        trace.push_back(vector<int>(v.begin() + offset - d, v.begin() + offset + d + 1));
+        if (done) {
+            break;
+        }
+    }
+
+    // walk the trace backwards from (N, M) to recover the script
+    vector<DiffEdit> middle;
+    int x = N;
+    int y = M;
+
+    for (int d = static_cast<int>(trace.size()) - 1; d > 0; d--) {
+        const vector<int>& prev = trace[d - 1];
+        int k = x - y;
+
+        int prevK;
+        if (k == -d || (k != d && prev[k - 1 + d - 1] < prev[k + 1 + d - 1])) {
+            prevK = k + 1;
+        } else {
+            prevK = k - 1;
+        }
+
+        int prevX = prev[prevK + d - 1];
+        int prevY = prevX - prevK;
+
+        while (x > prevX && y > prevY) {
+            middle.push_back(DiffEdit(' ', prefix + x - 1, prefix + y - 1));
+            x--;
+            y--;
+        }
+
+        if (x == prevX) {
+            middle.push_back(DiffEdit('+', -1, prefix + prevY));
+        } else {
+            middle.push_back(DiffEdit('-', prefix + prevX, -1));
+        }
+
+        x = prevX;
+        y = prevY;
+    }
+
+    while (x > 0 && y > 0) {
+        middle.push_back(DiffEdit(' ', prefix + x - 1, prefix + y - 1));
+        x--;
+        y--;
+    }
+
+    edits.insert(edits.end(), middle.rbegin(), middle.rend());
+
+    for (int i = 0; i < suffix; i++) {
+        edits.push_back(DiffEdit(' ', n - suffix + i, m - suffix + i));
+    }
+
+    return edits;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// PRINT UNIFIED
+// Prints the edit script as "@@ -a,b +c,d @@" hunks with `context` unchanged lines around each change.
+// Changes closer than 2*context lines apart are merged into one hunk
+//----------------------------------------------------------------------------------------------------------------------------
+
+void Diff::printUnified(const vector<string>& oldLines, const vector<string>& newLines,
+                        const vector<DiffEdit>& edits, ostream& out, int context) {
+    int total = static_cast<int>(edits.size());
+
+    // oldBefore[i] / newBefore[i] = how many old/new lines come before edit i
+    vector<int> oldBefore(total + 1, 0), newBefore(total + 1, 0);
+    for (int i = 0; i < total; i++) {
+        oldBefore[i + 1] = oldBefore[i] + (edits[i].type != '+');
+        newBefore[i + 1] = newBefore[i] + (edits[i].type != '-');
+    }
+
+    int i = 0;
+    while (i < total) {
+        if (edits[i].type == ' ') {
+            i++;
+            continue;
+        }
+
+        int start = max(0, i - context);
+        int lastChange = i;
+        int j = i;
+
+        while (j < total) {
+            if (edits[j].type != ' ') {
+                lastChange = j;
+                j++;
+                continue;
+            }
+
+            int run = j;
+            while (run < total && edits[run].type == ' ') {
+                run++;
+            }
+
+            if (run < total && run - j <= 2 * context) {
+                j = run;
+                continue;
+            }
+            break;
+        }
+
+        int stop = min(total, lastChange + 1 + context);
+
+        int oldLen = oldBefore[stop] - oldBefore[start];
+        int newLen = newBefore[stop] - newBefore[start];
+
+        out << CYN << "@@ -" << (oldLen ? oldBefore[start] + 1 : oldBefore[start]) << "," << oldLen
+             << " +" << (newLen ? newBefore[start] + 1 : newBefore[start]) << "," << newLen << " @@" << END << "\n";
+
+        for (int e = start; e < stop; e++) {
+            if (edits[e].type == ' ') {
+                out << " " << oldLines[edits[e].oldLine] << "\n";
+            } else if (edits[e].type == '-') {
+                out << RED << "-" << oldLines[edits[e].oldLine] << END << "\n";
+            } else {
+                out << GRN << "+" << newLines[edits[e].newLine] << END << "\n";
+            }
+        }
+
+        i = stop;
+    }
+}
@@ -0,0 +1,204 @@
+#include "FileUtils.h"
+#include "HashingHelper.h"
+#include "Trace.h"
+#include "Stats.h"
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <cstring>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+using namespace std;
+
+/*==============================================
+writeFileAtomically
+Return type: void
+Parameters: filesystem::path&, string&
+Purpose: replace a small metadata file (HEAD.txt, manifests, filters, caches) without readers ever seeing it half written
+
+1. the temporary name gets a fresh random ID (same generator as commit IDs) so two processes
+   writing the same file at once never share a temporary file
+2. rename() replaces the target in one step on the same filesystem
+3. if anything fails the temporary file is removed and the old contents stay untouched
+================================================*/
+
+void writeFileAtomically(const filesystem::path& file, const string& contents) {
+    TRACE_SPAN_DETAIL("writeFileAtomically", file.filename().string());
+    filesystem::path tmp = file;
+    tmp += ".tmp-" + generateCommitID(file.string());
+
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        if (!out) {
+            throw runtime_error("Could not write " + file.string());
+        }
+        out.write(contents.data(), contents.size());
+        Stats::add(STAT_FILES_OPENED);
+        Stats::add(STAT_BYTES_WRITTEN, contents.size());
+        if (!out) {
+            out.close();
+            filesystem::remove(tmp);
+            throw runtime_error("Could not write " + file.string());
+        }
+    }
+
+    error_code ec;
+    filesystem::rename(tmp, file, ec);
+    if (ec) {
+        filesystem::remove(tmp, ec);
+        throw runtime_error("Could not replace " + file.string());
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// DEFERRED METADATA WRITES
+// A batch of a thousand commits would otherwise rewrite HEAD.txt a thousand times.
+// While deferred, each file keeps only its newest contents and is written once at flush time.
+// Files are flushed in the order they were last changed. Commit records are never deferred, so TIP.txt can't land
+// before a commit it names and a crash mid-flush leaves the list readable (TIP and HEAD may just lag behind)
+//----------------------------------------------------------------------------------------------------------------------------
+
+struct PendingWrite {
+    long sequence;
+    string contents;
+};
+
+static bool deferring = false;
+static bool suppressing = false;
+static long writeSequence = 0;
+static map<filesystem::path, PendingWrite> pendingWrites;
+
+void deferMetadataWrites(bool defer) {
+    deferring = defer;
+    if (!defer) {
+        flushMetadataWrites();
+    }
+}
+
+bool metadataWritesDeferred() {
+    return deferring;
+}
+
+void suppressWrites(bool suppress) {
+    suppressing = suppress;
+}
+
+bool writesSuppressed() {
+    return suppressing;
+}
+
+void writeMetadataFile(const filesystem::path& file, const string& contents) {
+    if (!deferring) {
+        writeFileAtomically(file, contents);
+        return;
+    }
+
+    pendingWrites[file] = {writeSequence++, contents};
+}
+
+string readMetadataFile(const filesystem::path& file) {
+    auto it = pendingWrites.find(file);
+    if (it != pendingWrites.end()) {
+        return it->second.contents.substr(0, it->second.contents.find('\n'));
+    }
+
+    if (!filesystem::exists(file)) {
+        return "NA";
+    }
+
+    ifstream in(file);
+    string line;
+    getline(in, line);
+    Stats::add(STAT_FILES_OPENED);
+    return line;
+}
+
+void flushMetadataWrites() {
+    TRACE_SPAN("flushMetadataWrites");
+    vector<pair<long, filesystem::path>> order;
+    for (auto& [file, pending] : pendingWrites) {
+        order.push_back({pending.sequence, file});
+    }
+    sort(order.begin(), order.end());
+
+    // dropped one by one as they're written, so a failure half way keeps the rest for the next flush
+    for (auto& [sequence, file] : order) {
+        writeFileAtomically(file, pendingWrites[file].contents);
+        pendingWrites.erase(file);
+    }
+}
+
+/*==============================================
+copyToDescriptor
+Return type: void
+Parameters: int, int, uintmax_t
+Purpose: stream a stored file to stdout or an archive without copying it through a user space buffer
+
+1. sendfile() moves the bytes inside the kernel, page cache to output. It takes any output since linux 2.6.33
+2. EINVAL / ENOSYS mean this pair of descriptors can't do it, the rest goes through a plain read/write loop
+================================================*/
+
+static void writeAll(int out, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = ::write(out, data, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw runtime_error(string("write failed: ") + strerror(errno));
+        }
+        data += n;
+        length -= n;
+    }
+}
+
+void copyToDescriptor(int in, int out, uintmax_t size) {
+    uintmax_t left = size;
+
+#ifdef __linux__
+    while (left > 0) {
+        ssize_t n = sendfile(out, in, nullptr, min<uintmax_t>(left, 1 << 30));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            break;
+        }
+        if (n < 0) {
+            throw runtime_error(string("write failed: ") + strerror(errno));
+        }
+        if (n == 0) {
+            throw runtime_error("file ended early (did it change while being read?)");
+        }
+        left -= n;
+        Stats::add(STAT_BYTES_COPIED, n);
+    }
+#endif
+
+    vector<char> buffer(left > 0 ? min<uintmax_t>(left, 256 * 1024) : 0);
+    while (left > 0) {
+        ssize_t n = ::read(in, buffer.data(), min<uintmax_t>(left, buffer.size()));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw runtime_error("file ended early (did it change while being read?)");
+        }
+        writeAll(out, buffer.data(), n);
+        Stats::add(STAT_BYTES_READ, n);
+        Stats::add(STAT_BYTES_WRITTEN, n);
+        left -= n;
+    }
+}
@@ -0,0 +1,320 @@
+#include "Fsck.h"
+#include "Manifest.h"
+#include "HashingHelper.h"
+#include "FileUtils.h"
+#include "Parallel.h"
+#include "Trace.h"
+#include "Layout.h"
+#include "CommitRecord.h"
+#include <iostream>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <atomic>
+
+using namespace std;
+
+static const size_t COMMITS_PER_BATCH = 256;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CONSTRUCTOR
+//----------------------------------------------------------------------------------------------------------------------------
+
+Fsck::Fsck(Repository* repository) : repo(repository) {
+    vcsRoot = repo->getVcsRoot();
+    sharedRoot = repo->getSharedRoot();
+    commitsDir = repo->getCommitsDir();
+}
+
+void Fsck::report(bool error, const string& subject, const string& message) {
+    lock_guard<mutex> guard(problemsLock);
+    problems.push_back({error, subject, message});
+}
+
+static unsigned hashWorkers() {
+    // hashing is cpu bound, one worker per core
+    return max(1u, thread::hardware_concurrency());
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// HISTORY
+// Returns the commits of the history oldest first, as far as the links hold
+//----------------------------------------------------------------------------------------------------------------------------
+
+struct FolderCheck {
+    bool hasRecord = false;
+    string recordID;
+    string parent;
+    string tree;
+    string manifestHash;
+    bool hasData = false;
+    bool hasManifest = false;
+};
+
+vector<string> Fsck::checkHistory(FsckResult& result) {
+    TRACE_SPAN("fsck history");
+
+    vector<string> ids;
+    for (const filesystem::path& folder : Layout::commitFolders(commitsDir)) {
+        ids.push_back(folder.filename().string());
+    }
+
+    // every folder's metadata, read in parallel
+    vector<FolderCheck> records(ids.size());
+    runOnWorkers(ids.size(), hashWorkers() * 2, "fsck worker", [&](size_t i) {
+        filesystem::path folder = Layout::commitDir(commitsDir, ids[i]);
+        FolderCheck& record = records[i];
+
+        CommitRecord commit;
+        record.hasRecord = commit.read(folder);
+        if (record.hasRecord) {
+            record.recordID = commit.id();
+            record.parent = commit.parent();
+            record.tree = commit.tree();
+        }
+
+        error_code ec;
+        record.hasData = filesystem::is_directory(folder / "Data", ec);
+        record.hasManifest = filesystem::exists(folder / "Manifest.txt", ec);
+        if (record.hasManifest) {
+            record.manifestHash = hashFileContents(folder / "Manifest.txt");
+        }
+    });
+
+    unordered_map<string, size_t> index;
+    for (size_t i = 0; i < ids.size(); i++) {
+        index[ids[i]] = i;
+    }
+
+    // the list, followed back from the tip in memory
+    vector<string> history;
+    unordered_set<string> inHistory;
+
+    string tip = readMetadataFile(commitsDir / "TIP.txt");
+    string tail = readMetadataFile(commitsDir / "TAIL.txt");
+    string head = readMetadataFile(Repository::headFileFor(vcsRoot));
+    string source = "TIP.txt";
+    bool complete = false;
+
+    for (string id = tip; !id.empty();) {
+        if (id == "NA") {
+            complete = true;
+            break;
+        }
+
+        auto found = index.find(id);
+        if (found == index.end()) {
+            report(true, id, "named by " + source + " but its folder is missing, everything before it is lost");
+            break;
+        }
+        if (inHistory.count(id)) {
+            report(true, id, "named again by " + source + ", the history loops back on itself here");
+            break;
+        }
+
+        const FolderCheck& record = records[found->second];
+        if (!record.hasData) {
+            report(true, id, "Data folder is missing");
+        }
+        if (!record.hasManifest) {
+            report(false, id, "has no Manifest.txt, its files can't be verified (any command that reads it recreates one)");
+        }
+
+        history.push_back(id);
+        inHistory.insert(id);
+
+        if (!record.hasRecord) {
+            report(true, id, "commit.bin is missing or damaged, everything before it is lost");
+            break;
+        }
+        if (record.recordID != id) {
+            report(true, id, "commit.bin says it is commit '" + record.recordID + "'");
+        }
+        if (record.hasManifest && record.manifestHash != record.tree) {
+            report(true, id, "Manifest.txt has changed since the commit was made");
+        }
+        source = id + "/commit.bin";
+        id = record.parent;
+    }
+    reverse(history.begin(), history.end());
+
+    if (complete && (history.empty() ? tail != "NA" : history.front() != tail)) {
+        report(true, "TAIL.txt", "names '" + tail + "' but the history starts at '" +
+                                 (history.empty() ? string("NA") : history.front()) + "'");
+    }
+    if (tip == "NA" && !ids.empty()) {
+        report(true, "TIP.txt", "says the history is empty but " + to_string(ids.size()) + " commit folder(s) exist");
+    }
+    if (head != "NA" && !inHistory.count(head)) {
+        report(true, "HEAD.txt", "names '" + head + "' which isn't in the history");
+    }
+
+    size_t loose = ids.size() - min(ids.size(), inHistory.size());
+    if (loose > 0) {
+        report(false, "commits", to_string(loose) + " folder(s) aren't part of the history (minigit gc removes them)");
+    }
+
+    // undo/redo targets have to exist, restore would fail on them
+    for (const char* file : {"restore_state.txt", "restore_journal.txt"}) {
+        ifstream in(vcsRoot / file);
+        string line;
+        while (getline(in, line)) {
+            size_t colon = line.find(':');
+            string key = line.substr(0, colon);
+            string id = colon == string::npos ? "" : line.substr(colon + 1);
+
+            bool namesCommit = key == "CURRENT" || key == "UNDO" || key == "REDO" || key == "COMMIT";
+            if (namesCommit && id != "NA" && !id.empty() && !inHistory.count(id)) {
+                report(false, file, "names commit '" + id + "' which isn't in the history");
+            }
+        }
+    }
+
+    result.commits = history.size();
+    return history;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CONTENTS
+//----------------------------------------------------------------------------------------------------------------------------
+
+struct FileCheck {
+    filesystem::path file;
+    const ManifestEntry* entry;
+    string subject;
+    string path;
+};
+
+// one file against its manifest entry, returns the problem or "" if it's fine
+static string checkFile(const FileCheck& check, bool quick, atomic<uintmax_t>& bytes) {
+    error_code ec;
+    uintmax_t size = filesystem::file_size(check.file, ec);
+    if (ec) {
+        return "'" + check.path + "' is missing";
+    }
+    if (size != check.entry->size) {
+        return "'" + check.path + "' is " + to_string(size) + " bytes, the manifest says " + to_string(check.entry->size);
+    }
+    if (quick) {
+        return "";
+    }
+
+    try {
+        string hash = hashFileContents(check.file);
+        bytes += size;
+        if (hash != check.entry->hash) {
+            return "'" + check.path + "' doesn't match its content hash (damaged on disk)";
+        }
+    } catch (const exception& e) {
+        return "'" + check.path + "' can't be read";
+    }
+    return "";
+}
+
+void Fsck::checkContents(const vector<string>& history, bool quick, FsckResult& result) {
+    TRACE_SPAN("fsck contents");
+    atomic<uintmax_t> bytes(0);
+    atomic<int> files(0);
+
+    for (size_t start = 0; start < history.size(); start += COMMITS_PER_BATCH) {
+        size_t end = min(history.size(), start + COMMITS_PER_BATCH);
+
+        vector<Manifest> manifests(end - start);
+        vector<FileCheck> checks;
+        for (size_t i = start; i < end; i++) {
+            filesystem::path folder = Layout::commitDir(commitsDir, history[i]);
+            Manifest& manifest = manifests[i - start];
+            if (!manifest.load(folder / "Manifest.txt")) {
+                continue;
+            }
+            for (const auto& [path, entry] : manifest.getEntries()) {
+                checks.push_back({folder / "Data" / path, &entry, history[i], path});
+            }
+        }
+
+        runOnWorkers(checks.size(), hashWorkers(), "fsck worker", [&](size_t i) {
+            string problem = checkFile(checks[i], quick, bytes);
+            if (!problem.empty()) {
+                report(true, checks[i].subject, problem);
+            }
+            files++;
+        });
+    }
+
+    result.files += files;
+    result.bytes += bytes;
+}
+
+// stashes keep their contents in the object store, named by hash
+void Fsck::checkStashes(bool quick, FsckResult& result) {
+    TRACE_SPAN("fsck stashes");
+    error_code ec;
+
+    vector<Manifest> manifests;
+    vector<string> owners;
+    for (auto& entry : filesystem::directory_iterator(sharedRoot / "stash", ec)) {
+        string name = entry.path().filename().string();
+        if (!entry.is_directory() || name.find(".tmp") != string::npos) {
+            continue;
+        }
+        for (const char* file : {"worktree.txt", "staging.txt"}) {
+            Manifest manifest;
+            if (!manifest.load(entry.path() / file)) {
+                report(true, "stash " + name, string(file) + " is missing");
+                continue;
+            }
+            manifests.push_back(manifest);
+            owners.push_back("stash " + name);
+        }
+    }
+
+    vector<FileCheck> checks;
+    unordered_set<string> seen;
+    for (size_t m = 0; m < manifests.size(); m++) {
+        for (const auto& [path, entry] : manifests[m].getEntries()) {
+            if (seen.insert(entry.hash).second) {
+                checks.push_back({Layout::objectPath(sharedRoot / "objects", entry.hash), &entry, owners[m], "object " + entry.hash + " (" + path + ")"});
+            }
+        }
+    }
+
+    atomic<uintmax_t> bytes(0);
+    runOnWorkers(checks.size(), hashWorkers(), "fsck worker", [&](size_t i) {
+        string problem = checkFile(checks[i], quick, bytes);
+        if (!problem.empty()) {
+            report(true, checks[i].subject, problem);
+        }
+    });
+
+    result.files += checks.size();
+    result.bytes += bytes;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// RUN
+//----------------------------------------------------------------------------------------------------------------------------
+
+FsckResult Fsck::run(bool quick) {
+    TRACE_SPAN("fsck");
+    flushMetadataWrites();
+
+    FsckResult result;
+    problems.clear();
+
+    vector<string> history = checkHistory(result);
+    checkContents(history, quick, result);
+    checkStashes(quick, result);
+
+    // workers report in whatever order they finish
+    stable_sort(problems.begin(), problems.end(), [](const Problem& a, const Problem& b) {
+        return a.subject < b.subject;
+    });
+
+    for (const Problem& problem : problems) {
+        (problem.error ? result.errors : result.warnings)++;
+        repo->out() << (problem.error ? RED "error: " : YEL "warning: ") << problem.subject << ": " << problem.message
+             << END << "\n";
+    }
+    return result;
+}
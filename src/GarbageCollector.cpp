@@ -0,0 +1,314 @@
+#include "GarbageCollector.h"
+#include "CommitManager.h"
+#include "Manifest.h"
+#include "FileUtils.h"
+#include "Parallel.h"
+#include "Trace.h"
+#include "Worktree.h"
+#include "Layout.h"
+#include <iostream>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CONSTRUCTOR
+//----------------------------------------------------------------------------------------------------------------------------
+
+GarbageCollector::GarbageCollector(Repository* repository, Restore* restoreState)
+    : repo(repository), restore(restoreState) {
+    vcsRoot = repo->getVcsRoot();
+    sharedRoot = repo->getSharedRoot();
+    commitsDir = repo->getCommitsDir();
+}
+
+static unsigned gcWorkers() {
+    // deleting is mostly waiting on the filesystem, same sizing as the io thread pool
+    return max(4u, min(16u, thread::hardware_concurrency() * 2));
+}
+
+static bool isTemporary(const string& name) {
+    return name.find(".tmp") != string::npos || name.rfind(".incoming-", 0) == 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// MARK: COMMITS
+// The list itself, plus every ID any of the state files mention. "KEY:<id>" lines (restore state and journal,
+// stash info) and bare IDs (HEAD.txt, TAIL.txt) are all taken, values that aren't commits just never match a folder
+//----------------------------------------------------------------------------------------------------------------------------
+
+static void addNamedCommits(const filesystem::path& file, unordered_set<string>& ids) {
+    ifstream in(file);
+    string line;
+    while (getline(in, line)) {
+        size_t colon = line.find(':');
+        ids.insert(colon == string::npos ? line : line.substr(colon + 1));
+    }
+}
+
+unordered_set<string> GarbageCollector::liveCommits() const {
+    TRACE_SPAN("gc mark commits");
+    unordered_set<string> live;
+
+    CommitManager manager(repo);
+    for (CommitNode* node = manager.getHead(); node; node = node->getPrevNode()) {
+        live.insert(string(node->getCommitID()));
+    }
+
+    // a list that stops early would make the rest of the history look like garbage
+    string tailID = readMetadataFile(commitsDir / "TAIL.txt");
+    CommitNode* tip = manager.getHead();
+    bool complete = tip ? manager.getTail() && manager.getTail()->getCommitID() == tailID &&
+                          readMetadataFile(commitsDir / "TIP.txt") == tip->getCommitID()
+                        : tailID == "NA";
+    if (!complete) {
+        throw runtime_error("the commit list doesn't load completely, not collecting anything");
+    }
+
+    addNamedCommits(commitsDir / "TAIL.txt", live);
+
+    // every worktree has its own checked out commit and undo/redo history
+    for (const WorktreeInfo& worktree : Worktree::list(vcsRoot)) {
+        filesystem::path worktreeVcs = worktree.root / ".Minivcs";
+        addNamedCommits(Repository::headFileFor(worktreeVcs), live);
+        addNamedCommits(worktreeVcs / "restore_state.txt", live);
+        addNamedCommits(worktreeVcs / "restore_journal.txt", live);
+    }
+
+    error_code ec;
+    for (auto& entry : filesystem::directory_iterator(sharedRoot / "stash", ec)) {
+        addNamedCommits(entry.path() / "info.txt", live);
+    }
+    return live;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// COLLECT
+//----------------------------------------------------------------------------------------------------------------------------
+
+enum GarbageKind { GARBAGE_COMMIT, GARBAGE_OBJECT, GARBAGE_CACHE, GARBAGE_TEMPORARY };
+
+struct Garbage {
+    filesystem::path path;
+    GarbageKind kind;
+};
+
+// bytes a delete gives back: files that are still linked from somewhere else (other commits, a clone) free nothing
+static uintmax_t freedBytes(const filesystem::path& path) {
+    error_code ec;
+    uintmax_t bytes = 0;
+
+    auto count = [&](const filesystem::path& file) {
+        if (filesystem::is_regular_file(file, ec) && filesystem::hard_link_count(file, ec) == 1) {
+            uintmax_t size = filesystem::file_size(file, ec);
+            bytes += ec ? 0 : size;
+        }
+    };
+
+    if (filesystem::is_directory(path, ec)) {
+        for (auto& entry : filesystem::recursive_directory_iterator(path, ec)) {
+            count(entry.path());
+        }
+    } else {
+        count(path);
+    }
+    return bytes;
+}
+
+GcResult GarbageCollector::collect(int graceMinutes, bool dryRun) {
+    TRACE_SPAN("gc");
+
+    // batch mode may hold pointer files and journal lines in memory, the mark phase reads them from disk
+    flushMetadataWrites();
+    restore->flushJournal();
+
+    unsigned workers = gcWorkers();
+    vector<Garbage> garbage;
+    error_code ec;
+
+    // ----------------------------------------- MARK + LIST -----------------------------------------
+    unordered_set<string> live = liveCommits();
+
+    for (const filesystem::path& path : Layout::temporaries(commitsDir)) {
+        garbage.push_back({path, GARBAGE_TEMPORARY});
+    }
+    for (const filesystem::path& folder : Layout::commitFolders(commitsDir)) {
+        if (!live.count(folder.filename().string())) {
+            garbage.push_back({folder, GARBAGE_COMMIT});
+        }
+    }
+
+    for (auto& entry : filesystem::directory_iterator(vcsRoot)) {
+        if (!entry.is_directory() && isTemporary(entry.path().filename().string())) {
+            garbage.push_back({entry.path(), GARBAGE_TEMPORARY});
+        }
+    }
+
+    // objects are only used by stashes, both of a stash's manifests name them by hash
+    {
+        TRACE_SPAN("gc mark objects");
+        vector<filesystem::path> stashes;
+        for (auto& entry : filesystem::directory_iterator(sharedRoot / "stash", ec)) {
+            string name = entry.path().filename().string();
+            if (isTemporary(name)) {
+                garbage.push_back({entry.path(), GARBAGE_TEMPORARY});
+            } else if (entry.is_directory()) {
+                stashes.push_back(entry.path());
+            }
+        }
+
+        unordered_set<string> usedObjects;
+        mutex usedLock;
+        runOnWorkers(stashes.size(), workers, "gc worker", [&](size_t i) {
+            Manifest workTree, staged;
+            workTree.load(stashes[i] / "worktree.txt");
+            staged.load(stashes[i] / "staging.txt");
+
+            lock_guard<mutex> guard(usedLock);
+            for (const Manifest* manifest : {&workTree, &staged}) {
+                for (const auto& [path, entry] : manifest->getEntries()) {
+                    usedObjects.insert(entry.hash);
+                }
+            }
+        });
+
+        for (const filesystem::path& path : Layout::temporaries(sharedRoot / "objects")) {
+            garbage.push_back({path, GARBAGE_TEMPORARY});
+        }
+        for (const filesystem::path& object : Layout::objectFiles(sharedRoot / "objects")) {
+            if (!usedObjects.count(object.filename().string())) {
+                garbage.push_back({object, GARBAGE_OBJECT});
+            }
+        }
+    }
+
+    // a blame cache file is "<commit>:<path>" and then one owning commit per line, all of them have to exist
+    {
+        TRACE_SPAN("gc mark blame cache");
+        vector<filesystem::path> entries;
+        for (auto& entry : filesystem::directory_iterator(sharedRoot / "cache" / "blame", ec)) {
+            entries.push_back(entry.path());
+        }
+
+        vector<char> stale(entries.size(), 0);
+        runOnWorkers(entries.size(), workers, "gc worker", [&](size_t i) {
+            string name = entries[i].filename().string();
+            if (isTemporary(name)) {
+                stale[i] = 1;
+                return;
+            }
+
+            ifstream in(entries[i]);
+            string line;
+            if (!getline(in, line) || !live.count(line.substr(0, line.find(':')))) {
+                stale[i] = 1;
+                return;
+            }
+            while (getline(in, line)) {
+                if (!live.count(line)) {
+                    stale[i] = 1;
+                    return;
+                }
+            }
+        });
+
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (stale[i]) {
+                garbage.push_back({entries[i], GARBAGE_CACHE});
+            }
+        }
+    }
+
+    // ----------------------------------------- SWEEP -----------------------------------------
+    TRACE_SPAN_DETAIL("gc sweep", to_string(garbage.size()) + " candidates");
+
+    auto cutoff = filesystem::file_time_type::clock::now() - chrono::minutes(graceMinutes);
+    atomic<int> removed[4] = {};
+    atomic<int> spared(0);
+    atomic<uintmax_t> bytes(0);
+
+    runOnWorkers(garbage.size(), workers, "gc worker", [&](size_t i) {
+        error_code ec;
+        const Garbage& item = garbage[i];
+
+        filesystem::file_time_type modified = filesystem::last_write_time(item.path, ec);
+        if (ec) {
+            return;     // gone already
+        }
+        if (modified > cutoff) {
+            spared++;
+            return;
+        }
+
+        bytes += freedBytes(item.path);
+        if (!dryRun) {
+            filesystem::remove_all(item.path, ec);
+            if (ec) {
+                return;
+            }
+        }
+        removed[item.kind]++;
+    });
+
+    GcResult result;
+    result.commits = removed[GARBAGE_COMMIT];
+    result.objects = removed[GARBAGE_OBJECT];
+    result.cacheEntries = removed[GARBAGE_CACHE];
+    result.temporary = removed[GARBAGE_TEMPORARY];
+    result.spared = spared;
+    result.bytes = bytes;
+
+    // stale undo/redo lines only live in the journal until the next snapshot
+    if (!dryRun) {
+        restore->saveStateToDisk();
+    }
+    return result;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// AUTO
+// gc_check.txt only exists for its timestamp, so the check itself costs one stat on almost every command
+//----------------------------------------------------------------------------------------------------------------------------
+
+bool GarbageCollector::autoCollect() {
+    const char* setting = getenv("MINIGIT_GC_AUTO");
+    long threshold = setting ? atol(setting) : 256;
+    if (threshold <= 0) {
+        return false;
+    }
+
+    filesystem::path marker = vcsRoot / "gc_check.txt";
+    error_code ec;
+    filesystem::file_time_type lastCheck = filesystem::last_write_time(marker, ec);
+    if (!ec && lastCheck > filesystem::file_time_type::clock::now() - chrono::hours(1)) {
+        return false;
+    }
+    ofstream(marker, ios::trunc) << time(nullptr) << "\n";
+
+    TRACE_SPAN("gc auto check");
+    unordered_set<string> live = liveCommits();
+    long loose = 0;
+    for (const filesystem::path& folder : Layout::commitFolders(commitsDir)) {
+        loose += live.count(folder.filename().string()) ? 0 : 1;
+    }
+
+    if (!filesystem::exists(sharedRoot / "stash") || filesystem::is_empty(sharedRoot / "stash", ec)) {
+        loose += Layout::objectFiles(sharedRoot / "objects").size();
+    }
+
+    if (loose <= threshold) {
+        return false;
+    }
+
+    repo->err() << YEL << "Auto gc: " << loose << " loose entries under .Minivcs, running minigit gc" << END << endl;
+    GcResult result = collect(DEFAULT_GRACE_MINUTES, false);
+    repo->err() << YEL << "Auto gc: removed " << result.commits + result.objects + result.cacheEntries + result.temporary
+         << " entries (" << result.bytes << " bytes)" << END << endl;
+    return true;
+}
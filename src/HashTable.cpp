@@ -1,4 +1,5 @@
 #include "HashTable.h"
+#include "Stats.h"
 #include <iostream>
 
 using namespace std;
@@ -9,15 +10,25 @@ using namespace std;
 // All chain pointers are set to nullptr
 //----------------------------------------------------------------------------------------------------------------------------
 
-HashTable::HashTable(int initialSize) {
+HashTable::HashTable(int initialSize, pmr::memory_resource* resource) {
     tableSize = initialSize;
     numElements = 0;
     loadFactorThreshold = 0.75;
+    memory = resource;
 
-    table = new ChainNode*[tableSize];
-    for (int i = 0; i < tableSize; i++) {
-        table[i] = nullptr;
+    table = newBuckets(tableSize);
+}
+
+ChainNode** HashTable::newBuckets(int size) {
+    ChainNode** buckets = static_cast<ChainNode**>(memory->allocate(size * sizeof(ChainNode*), alignof(ChainNode*)));
+    for (int i = 0; i < size; i++) {
+        buckets[i] = nullptr;
     }
+    return buckets;
+}
+
+void HashTable::freeBuckets(ChainNode** buckets, int size) {
+    memory->deallocate(buckets, size * sizeof(ChainNode*), alignof(ChainNode*));
 }
 
 //----------------------------------------------------------------------------------------------------------------------------
@@ -31,10 +42,10 @@ HashTable::~HashTable() {
         while (current != nullptr) {
             ChainNode* temp = current;
             current = current->next;
-            delete temp;
+            memory->deallocate(temp, sizeof(ChainNode), alignof(ChainNode));
         }
     }
-    delete[] table;
+    freeBuckets(table, tableSize);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------
@@ -44,7 +55,7 @@ HashTable::~HashTable() {
 //we take the mod of the hash with the size of the table to ensure the index is always in bounds
 //----------------------------------------------------------------------------------------------------------------------------
 
-int HashTable::hashFunction(const string& commitID) const {
+int HashTable::hashFunction(string_view commitID) const {
     if (commitID.empty()) {
         return 0;
     }
@@ -67,10 +78,11 @@ int HashTable::hashFunction(const string& commitID) const {
 //once all clear, we insert into the table
 //----------------------------------------------------------------------------------------------------------------------------
 
-void HashTable::insert(const string& commitID, CommitNode* nodePtr) {
-    if (commitID.empty() || nodePtr == nullptr) {
+void HashTable::insert(CommitNode* nodePtr) {
+    if (nodePtr == nullptr || nodePtr->getCommitID().empty()) {
         return;
     }
+    string_view commitID = nodePtr->getCommitID();
 
     if (getLoadFactor() >= loadFactorThreshold) {
         resize();
@@ -80,7 +92,7 @@ void HashTable::insert(const string& commitID, CommitNode* nodePtr) {
         return;
     }
 
-    insertIntoTable(table, tableSize, commitID, nodePtr);
+    insertIntoTable(table, tableSize, nodePtr);
     numElements++;
 }
 
@@ -90,7 +102,8 @@ void HashTable::insert(const string& commitID, CommitNode* nodePtr) {
 //we tried doing direct insertion but there seemed to be some sort of ambiguity while inserting, so we decided to create a seperate function
 //----------------------------------------------------------------------------------------------------------------------------
 
-void HashTable::insertIntoTable(ChainNode** targetTable, int targetSize, const string& commitID, CommitNode* nodePtr) {
+void HashTable::insertIntoTable(ChainNode** targetTable, int targetSize, CommitNode* nodePtr) {
+    string_view commitID = nodePtr->getCommitID();
 
     unsigned long hash = 0;
     const unsigned long prime = 31;
@@ -100,7 +113,7 @@ void HashTable::insertIntoTable(ChainNode** targetTable, int targetSize, const s
 
     int index = static_cast<int>(hash % targetSize);
 
-    ChainNode* newNode = new ChainNode(commitID, nodePtr);
+    ChainNode* newNode = new (memory->allocate(sizeof(ChainNode), alignof(ChainNode))) ChainNode(commitID, nodePtr);
 
     newNode->next = targetTable[index];
     targetTable[index] = newNode;
@@ -113,15 +126,17 @@ void HashTable::insertIntoTable(ChainNode** targetTable, int targetSize, const s
 // (O(n) would occur if somehow we got a really long chain )
 //----------------------------------------------------------------------------------------------------------------------------
 
-CommitNode* HashTable::search(const string& commitID) const {
+CommitNode* HashTable::search(string_view commitID) const {
     if (commitID.empty()) {
         return nullptr;
     }
 
     int index = hashFunction(commitID);
     ChainNode* current = table[index];
+    Stats::add(STAT_HASH_LOOKUPS);
 
     while (current != nullptr) {
+        Stats::add(STAT_HASH_PROBES);
         if (current->commitID == commitID) {
             return current->commitNodePtr;
         }
@@ -136,7 +151,7 @@ CommitNode* HashTable::search(const string& commitID) const {
 // Checks if a commit exists in the hash table
 //----------------------------------------------------------------------------------------------------------------------------
 
-bool HashTable::exists(const string& commitID) const {
+bool HashTable::exists(string_view commitID) const {
     return search(commitID) != nullptr;
 }
 
@@ -146,7 +161,7 @@ bool HashTable::exists(const string& commitID) const {
 // we use the two pointer approach for deleting nodes in a given chain
 //----------------------------------------------------------------------------------------------------------------------------
 
-bool HashTable::remove(const string& commitID) {
+bool HashTable::remove(string_view commitID) {
     if (commitID.empty()) {
         return false;
     }
@@ -163,7 +178,7 @@ bool HashTable::remove(const string& commitID) {
                 prev->next = current->next;
             }
 
-            delete current;
+            memory->deallocate(current, sizeof(ChainNode), alignof(ChainNode));
             numElements--;
             return true;
         }
@@ -181,13 +196,13 @@ bool HashTable::remove(const string& commitID) {
 //----------------------------------------------------------------------------------------------------------------------------
 
 void HashTable::resize() {
+    rehash(tableSize * 2);
+}
 
-    int newSize = tableSize * 2;
-    ChainNode** newTable = new ChainNode*[newSize];
+void HashTable::rehash(int newSize) {
+    Stats::add(STAT_HASH_RESIZES);
 
-    for (int i = 0; i < newSize; i++) {
-        newTable[i] = nullptr;
-    }
+    ChainNode** newTable = newBuckets(newSize);
 
     for (int i = 0; i < tableSize; i++) {
         ChainNode* current = table[i];
@@ -209,12 +224,30 @@ void HashTable::resize() {
         }
     }
 
-    delete[] table;
+    freeBuckets(table, tableSize);
 
     table = newTable;
     tableSize = newSize;
 }
 
+//----------------------------------------------------------------------------------------------------------------------------
+// RESERVE
+// Doubles until `expected` elements fit under the load factor, then rehashes once.
+// Loading a graph of a million commits would otherwise resize (and rehash everything) about fifteen times
+//----------------------------------------------------------------------------------------------------------------------------
+
+void HashTable::reserve(int expected) {
+    int newSize = tableSize;
+    while (expected >= newSize * loadFactorThreshold) {
+        newSize *= 2;
+    }
+    if (newSize == tableSize) {
+        return;
+    }
+
+    rehash(newSize);
+}
+
 //----------------------------------------------------------------------------------------------------------------------------
 // GET LOAD FACTOR
 // Returns the current load factor (numElements / tableSize)
@@ -1,9 +1,12 @@
 #include "HashingHelper.h"
+#include "Stats.h"
 #include <random> //will use it to generate rnadm 64 bit numbers
 #include <chrono> //used to get the current time
 #include <sstream> //used to create a combined string
 #include <iomanip> //used so that all IDs will have the same full length
 #include <cstdint> //we use this for our unsined 64 bit integr data type
+#include <fstream> //used to read file contents for content hashes
+#include <stdexcept> //runtime_error when a file can't be hashed
 
 using namespace std;
 /*==============================================
@@ -75,3 +78,63 @@ string generateCommitID(const string &data) {
     return generatedID.str();
 }
 
+/*==============================================
+hashString
+Return type: unsigned 64 bit integer
+Parameters: string&
+Purpose: public wrapper over FNV1A so other classes (bloom filters etc) can hash paths
+================================================*/
+
+uint64_t hashString(const string& data) {
+    return FNV1A(data);
+}
+
+/*==============================================
+hashFileContents
+Return type: string
+Parameters: filesystem::path&
+Purpose: hash the contents of a file so two files can be compared without reading both
+
+1. we read the file in 64KB chunks so big files don't get loaded into memory at once
+2. every byte goes through the same XOR + multiply step as FNV1A above
+3. the result is formatted the same way as commit IDs (16 hex characters)
+
+throws runtime_error if the file can't be opened
+================================================*/
+
+string hashFileContents(const filesystem::path& path) {
+
+    ifstream file(path, ios::binary);
+    if (!file) {
+        throw runtime_error("Could not open '" + path.string() + "' for hashing");
+    }
+
+    uint64_t generatedHash = FNV_OFFSET;
+    Stats::add(STAT_FILES_OPENED);
+
+    char buffer[65536];
+    while (file) {
+        file.read(buffer, sizeof(buffer));
+        generatedHash = hashUpdate(generatedHash, buffer, file.gcount());
+        Stats::add(STAT_BYTES_READ, file.gcount());
+    }
+
+    return formatHash(generatedHash);
+}
+
+uint64_t hashUpdate(uint64_t state, const char* data, size_t length) {
+    const uint64_t prime = 1099511628211ULL;
+
+    for (size_t i = 0; i < length; i++) {
+        state = state ^ (unsigned char)data[i];
+        state = state * prime;
+    }
+    return state;
+}
+
+string formatHash(uint64_t state) {
+    stringstream hexHash;
+    hexHash<<hex<<setw(16)<<setfill('0')<<state;
+
+    return hexHash.str();
+}
@@ -0,0 +1,195 @@
+#include "Layout.h"
+#include "FileUtils.h"
+#include "Trace.h"
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <stdexcept>
+
+using namespace std;
+
+enum LayoutState { LAYOUT_FLAT, LAYOUT_SHARDED, LAYOUT_MIGRATING };
+
+static mutex statesLock;
+static unordered_map<string, LayoutState> states;      // per commits folder, fsck and gc look things up from workers
+
+static LayoutState stateOf(const filesystem::path& commitsDir) {
+    lock_guard<mutex> guard(statesLock);
+    auto found = states.find(commitsDir.string());
+    if (found != states.end()) {
+        return found->second;
+    }
+
+    ifstream in(commitsDir / "LAYOUT.txt");
+    string line;
+    getline(in, line);
+    LayoutState state = line == "sharded" ? LAYOUT_SHARDED : line == "migrating" ? LAYOUT_MIGRATING : LAYOUT_FLAT;
+    states[commitsDir.string()] = state;
+    return state;
+}
+
+static void setState(const filesystem::path& commitsDir, LayoutState state) {
+    writeFileAtomically(commitsDir / "LAYOUT.txt", state == LAYOUT_SHARDED ? "sharded\n" : "migrating\n");
+    lock_guard<mutex> guard(statesLock);
+    states[commitsDir.string()] = state;
+}
+
+static bool isTemporary(const string& name) {
+    return name.empty() || name[0] == '.' || name.find(".tmp") != string::npos;
+}
+
+static bool isShard(const string& name) {
+    return name.size() == 2;
+}
+
+// sharded path, or while migrating the flat one if that's where it still is
+static filesystem::path locate(const filesystem::path& dir, string_view name, LayoutState state) {
+    if (state == LAYOUT_FLAT || name.size() < 2) {
+        return dir / name;
+    }
+
+    filesystem::path sharded = dir / name.substr(0, 2) / name;
+    if (state == LAYOUT_MIGRATING && !filesystem::exists(sharded) && filesystem::exists(dir / name)) {
+        return dir / name;
+    }
+    return sharded;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// LOOKUP
+//----------------------------------------------------------------------------------------------------------------------------
+
+filesystem::path Layout::commitDir(const filesystem::path& commitsDir, string_view commitID) {
+    return locate(commitsDir, commitID, stateOf(commitsDir));
+}
+
+filesystem::path Layout::objectPath(const filesystem::path& objectsDir, string_view hash) {
+    return locate(objectsDir, hash, stateOf(objectsDir.parent_path() / "commits"));
+}
+
+bool Layout::isSharded(const filesystem::path& commitsDir) {
+    return stateOf(commitsDir) == LAYOUT_SHARDED;
+}
+
+void Layout::setSharded(const filesystem::path& commitsDir) {
+    setState(commitsDir, LAYOUT_SHARDED);
+}
+
+void Layout::forget(const filesystem::path& commitsDir) {
+    lock_guard<mutex> guard(statesLock);
+    states.erase(commitsDir.string());
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// LISTING
+// Two levels when sharded. A flat entry next to the shards only exists halfway through a migration
+//----------------------------------------------------------------------------------------------------------------------------
+
+static vector<filesystem::path> listStored(const filesystem::path& dir, LayoutState state, bool folders) {
+    vector<filesystem::path> found;
+    error_code ec;
+
+    for (auto& entry : filesystem::directory_iterator(dir, ec)) {
+        string name = entry.path().filename().string();
+        if (isTemporary(name)) {
+            continue;
+        }
+
+        bool isDirectory = entry.is_directory(ec);
+        if (state != LAYOUT_FLAT && isDirectory && isShard(name)) {
+            for (auto& inner : filesystem::directory_iterator(entry.path(), ec)) {
+                if (!isTemporary(inner.path().filename().string()) && inner.is_directory(ec) == folders) {
+                    found.push_back(inner.path());
+                }
+            }
+        } else if (isDirectory == folders) {
+            found.push_back(entry.path());
+        }
+    }
+    return found;
+}
+
+vector<filesystem::path> Layout::commitFolders(const filesystem::path& commitsDir) {
+    return listStored(commitsDir, stateOf(commitsDir), true);
+}
+
+vector<filesystem::path> Layout::objectFiles(const filesystem::path& objectsDir) {
+    return listStored(objectsDir, stateOf(objectsDir.parent_path() / "commits"), false);
+}
+
+vector<filesystem::path> Layout::temporaries(const filesystem::path& dir) {
+    vector<filesystem::path> found;
+    error_code ec;
+
+    for (auto& entry : filesystem::directory_iterator(dir, ec)) {
+        string name = entry.path().filename().string();
+        if (isTemporary(name)) {
+            found.push_back(entry.path());
+        } else if (isShard(name) && entry.is_directory(ec)) {
+            for (auto& inner : filesystem::directory_iterator(entry.path(), ec)) {
+                if (isTemporary(inner.path().filename().string())) {
+                    found.push_back(inner.path());
+                }
+            }
+        }
+    }
+    return found;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// MIGRATE
+/*
+    1. LAYOUT.txt says "migrating": from here on lookups try the shard first and the old place second
+    2. the commit graph goes, readers without the lock rely on it and it's rebuilt by the next load anyway
+    3. every flat commit folder and object is renamed into its shard (a rename, nothing is copied)
+    4. LAYOUT.txt says "sharded"
+*/
+//----------------------------------------------------------------------------------------------------------------------------
+
+LayoutMigration Layout::migrate(const filesystem::path& vcsRoot) {
+    TRACE_SPAN("Layout::migrate");
+    filesystem::path commitsDir = vcsRoot / "commits";
+    filesystem::path objectsDir = vcsRoot / "objects";
+
+    LayoutMigration result;
+    if (stateOf(commitsDir) == LAYOUT_SHARDED) {
+        return result;
+    }
+
+    setState(commitsDir, LAYOUT_MIGRATING);
+    error_code ec;
+    filesystem::remove(commitsDir / "commit-graph.txt", ec);
+
+    auto moveIntoShard = [](const filesystem::path& dir, const filesystem::path& entry) {
+        string name = entry.filename().string();
+        filesystem::create_directories(dir / name.substr(0, 2));
+        filesystem::rename(entry, dir / name.substr(0, 2) / name);
+    };
+
+    // listed first, the folders being iterated shouldn't change under the iterator
+    vector<filesystem::path> commits, objects;
+    for (auto& entry : filesystem::directory_iterator(commitsDir)) {
+        string name = entry.path().filename().string();
+        if (entry.is_directory() && !isTemporary(name) && !isShard(name)) {
+            commits.push_back(entry.path());
+        }
+    }
+    for (auto& entry : filesystem::directory_iterator(objectsDir, ec)) {
+        string name = entry.path().filename().string();
+        if (!entry.is_directory() && !isTemporary(name) && !isShard(name)) {
+            objects.push_back(entry.path());
+        }
+    }
+
+    for (const filesystem::path& commit : commits) {
+        moveIntoShard(commitsDir, commit);
+        result.commits++;
+    }
+    for (const filesystem::path& object : objects) {
+        moveIntoShard(objectsDir, object);
+        result.objects++;
+    }
+
+    setState(commitsDir, LAYOUT_SHARDED);
+    return result;
+}
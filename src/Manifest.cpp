@@ -0,0 +1,274 @@
+#include "Manifest.h"
+#include "BulkIO.h"
+#include "HashingHelper.h"
+#include "StatCache.h"
+#include "FileUtils.h"
+#include "Trace.h"
+#include "SparseCheckout.h"
+#include "Layout.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CONSTRUCTOR
+// An empty manifest, used for the parent of the first commit
+//----------------------------------------------------------------------------------------------------------------------------
+
+Manifest::Manifest() {
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// BUILD
+// Walks a Data folder and hashes every regular file in it.
+// Paths are made relative to the Data folder and converted to '/' so manifests from windows and linux compare equal
+//----------------------------------------------------------------------------------------------------------------------------
+
+Manifest Manifest::build(const filesystem::path& dataDir) {
+    Manifest manifest;
+
+    if (!filesystem::exists(dataDir)) {
+        return manifest;
+    }
+
+    for (auto& entry : filesystem::recursive_directory_iterator(dataDir)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+
+        string relative = filesystem::relative(entry.path(), dataDir).generic_string();
+        manifest.add(relative, ManifestEntry(hashFileContents(entry.path()), entry.file_size()));
+    }
+
+    return manifest;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// FOR COMMIT
+// Loads commits/<id>/Manifest.txt.
+// Commits made before manifests existed don't have one, so we build it from their Data folder and save it
+// so the next lookup is just a file read
+//----------------------------------------------------------------------------------------------------------------------------
+
+Manifest Manifest::forCommit(const filesystem::path& commitsDir, string_view commitID) {
+    Manifest manifest;
+
+    if (commitID.empty() || commitID == "NA") {
+        return manifest;
+    }
+
+    filesystem::path commitPath = Layout::commitDir(commitsDir, commitID);
+
+    if (manifest.load(commitPath / "Manifest.txt")) {
+        return manifest;
+    }
+
+    manifest = build(commitPath / "Data");
+
+    if (!writesSuppressed() && filesystem::exists(commitPath / "Data")) {
+        manifest.save(commitPath / "Manifest.txt");
+    }
+
+    return manifest;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// SCAN WORKING TREE
+// Same as build() but for the working directory: .Minivcs, .git and directories outside a sparse checkout are skipped,
+// and hashes come from the stat cache so only files that changed since the last scan are read
+//----------------------------------------------------------------------------------------------------------------------------
+
+Manifest Manifest::scanWorkingTree(const filesystem::path& root, StatCache& cache) {
+    TRACE_SPAN("Manifest::scanWorkingTree");
+    Manifest manifest;
+    vector<filesystem::path> files;
+    vector<string> keys;
+    SparseCheckout sparse = SparseCheckout::load(root);
+
+    auto it = filesystem::recursive_directory_iterator(root);
+    for (; it != filesystem::recursive_directory_iterator(); ++it) {
+        string name = it->path().filename().string();
+
+        if (it->is_directory()) {
+            if (name == ".Minivcs" || name == ".git" ||
+                (sparse.isEnabled() && !sparse.includesDirectory(filesystem::relative(it->path(), root).generic_string()))) {
+                it.disable_recursion_pending();
+            }
+            continue;
+        }
+
+        if (!it->is_regular_file()) {
+            continue;
+        }
+
+        string key = filesystem::relative(it->path(), root).generic_string();
+        if (!sparse.includesFile(key)) {
+            continue;
+        }
+        files.push_back(it->path());
+        keys.push_back(key);
+    }
+
+    // stat everything in one bulk call, only files whose size or mtime changed get read
+    vector<FileStat> stats = BulkIO::get().statFiles(files);
+
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!stats[i].ok) {
+            continue;       // deleted while we were scanning
+        }
+        manifest.add(keys[i], ManifestEntry(cache.hashFor(files[i], keys[i], stats[i].size, stats[i].mtime), stats[i].size));
+    }
+
+    return manifest;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// NORMALIZE PATH
+// Turns whatever the user typed into the form we use as keys: ./a/../b -> b, trailing slashes removed,
+// absolute paths made relative to the working tree's root, '/' separators
+//----------------------------------------------------------------------------------------------------------------------------
+
+string Manifest::normalizePath(const string& userPath, const filesystem::path& root) {
+    filesystem::path normalized = filesystem::path(userPath).lexically_normal();
+    if (normalized.is_absolute()) {
+        normalized = normalized.lexically_relative(root);
+    }
+
+    string key = normalized.generic_string();
+    while (key.size() > 1 && key.back() == '/') {
+        key.pop_back();
+    }
+    return key;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// LOAD / SAVE
+// one "<hash> <size> <path>" line per file. The path goes last since it may contain spaces
+//----------------------------------------------------------------------------------------------------------------------------
+
+bool Manifest::load(const filesystem::path& file) {
+    ifstream in(file);
+    if (!in) {
+        return false;
+    }
+
+    entries.clear();
+
+    string line;
+    while (getline(in, line)) {
+        size_t firstSpace = line.find(' ');
+        size_t secondSpace = (firstSpace == string::npos) ? string::npos : line.find(' ', firstSpace + 1);
+
+        if (secondSpace == string::npos) {
+            continue;
+        }
+
+        string hash = line.substr(0, firstSpace);
+        uintmax_t size = stoull(line.substr(firstSpace + 1, secondSpace - firstSpace - 1));
+        entries[line.substr(secondSpace + 1)] = ManifestEntry(hash, size);
+    }
+
+    return true;
+}
+
+void Manifest::save(const filesystem::path& file) const {
+    ostringstream out;
+
+    for (auto& entry : entries) {
+        out << entry.second.hash << " " << entry.second.size << " " << entry.first << "\n";
+    }
+
+    writeFileAtomically(file, out.str());
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// ADD / FIND
+//----------------------------------------------------------------------------------------------------------------------------
+
+void Manifest::add(const string& path, const ManifestEntry& entry) {
+    entries[path] = entry;
+}
+
+const ManifestEntry* Manifest::find(const string& path) const {
+    auto it = entries.find(path);
+    if (it == entries.end()) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// TOUCHES
+// True if this manifest and the parent's differ at the given path.
+// The path can be a file or a directory, for directories we compare everything under "<path>/".
+// Since the map is sorted, everything under a directory is one contiguous range
+//----------------------------------------------------------------------------------------------------------------------------
+
+bool Manifest::touches(const Manifest& parent, const string& path) const {
+    const ManifestEntry* mine = find(path);
+    const ManifestEntry* theirs = parent.find(path);
+
+    if (mine || theirs) {
+        return !mine || !theirs || mine->hash != theirs->hash;
+    }
+
+    string prefix = path + "/";
+
+    auto a = entries.lower_bound(prefix);
+    auto b = parent.entries.lower_bound(prefix);
+
+    while (true) {
+        bool aIn = a != entries.end() && a->first.compare(0, prefix.size(), prefix) == 0;
+        bool bIn = b != parent.entries.end() && b->first.compare(0, prefix.size(), prefix) == 0;
+
+        if (!aIn || !bIn) {
+            return aIn != bIn;
+        }
+        if (a->first != b->first || a->second.hash != b->second.hash) {
+            return true;
+        }
+        ++a;
+        ++b;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CHANGED PATHS
+// Merge-walks both sorted maps and collects every path that was added, deleted or modified.
+// O(n + m) in the number of files, no file contents are read
+//----------------------------------------------------------------------------------------------------------------------------
+
+vector<string> Manifest::changedPaths(const Manifest& parent) const {
+    vector<string> changed;
+
+    auto a = entries.begin();
+    auto b = parent.entries.begin();
+
+    while (a != entries.end() || b != parent.entries.end()) {
+        if (b == parent.entries.end() || (a != entries.end() && a->first < b->first)) {
+            changed.push_back(a->first);
+            ++a;
+        } else if (a == entries.end() || b->first < a->first) {
+            changed.push_back(b->first);
+            ++b;
+        } else {
+            if (a->second.hash != b->second.hash) {
+                changed.push_back(a->first);
+            }
+            ++a;
+            ++b;
+        }
+    }
+
+    return changed;
+}
+
+const map<string, ManifestEntry>& Manifest::getEntries() const {
+    return entries;
+}
+
+int Manifest::size() const {
+    return static_cast<int>(entries.size());
+}
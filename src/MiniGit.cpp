@@ -0,0 +1,366 @@
+#include "MiniGit.h"
+#include "Commands.h"
+#include "RepoLock.h"
+#include "Manifest.h"
+#include "SparseCheckout.h"
+#include "Layout.h"
+#include "CommitRecord.h"
+#include "CommitGraph.h"
+#include "TreeDiff.h"
+#include "FileUtils.h"
+#include <iostream>
+#include <sstream>
+#include <mutex>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CALL PLUMBING
+// The I/O backend and the deferred metadata writes are process wide, so one mutex covers every MiniGit object
+//----------------------------------------------------------------------------------------------------------------------------
+
+static mutex apiMutex;
+
+// a loaded session between calls, whatever might still print goes nowhere instead of to a finished call's buffers
+static ostream nowhere(nullptr);
+
+// the engine colors its messages, API users get plain text
+static string stripColors(const string& text) {
+    string plain;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '\033' && i + 1 < text.size() && text[i + 1] == '[') {
+            size_t end = text.find('m', i);
+            if (end != string::npos) {
+                i = end;
+                continue;
+            }
+        }
+        plain += text[i];
+    }
+    while (!plain.empty() && (plain.back() == '\n' || plain.back() == ' ')) {
+        plain.pop_back();
+    }
+    return plain;
+}
+
+// the kept session pointed at this call's streams, (re)loaded if it's missing or another process changed the repository
+Session& MiniGit::attach(ostream& out, ostream& err) {
+    if (!session) {
+        session.reset(new Session(root));
+        session->repo.setOutput(out, err);
+        session->load();
+    } else {
+        session->repo.setOutput(out, err);
+        if (session->stamp() != sessionStamp) {
+            session->load();
+        }
+    }
+    return *session;
+}
+
+void MiniGit::detach() {
+    if (session) {
+        session->repo.setOutput(nowhere, nowhere);
+    }
+}
+
+/*
+run
+    -take the repository lock and attach the session to string streams of this call
+    -run the body, which returns the error code
+    -exceptions become MG_IO_ERROR and drop the session, since the in-memory state may be half updated
+*/
+template <typename Body>
+MiniGitResult MiniGit::run(bool writes, Body body) {
+    lock_guard<mutex> guard(apiMutex);
+
+    MiniGitResult result = {MG_OK, ""};
+    ostringstream out, err;
+
+    try {
+        Repository repo(root);
+        if (!repo.isInitialized()) {
+            return {MG_NOT_A_REPOSITORY, "not a minigit repository: " + root.string()};
+        }
+        if (CommitRecord::isLegacy(repo.getCommitsDir())) {
+            return {MG_IO_ERROR, "repository uses the older commit format, run minigit migrate-layout once"};
+        }
+
+        RepoLock lock(repo.getVcsRoot(), writes ? RepoLock::Exclusive : RepoLock::Shared, true, err);
+        Session& s = attach(out, err);
+
+        result.error = body(s);
+
+        s.statCache->save();
+        sessionStamp = s.stamp();
+    } catch (const exception& e) {
+        result.error = MG_IO_ERROR;
+        result.message = e.what();
+        session.reset();
+    }
+    detach();
+
+    if (!result.ok() && result.message.empty()) {
+        result.message = stripColors(err.str());
+    }
+    return result;
+}
+
+/*
+execute
+    -the checks, lock choice and auto gc of the command line, around runCommand
+    -writers lock exclusively, readers share the lock, or skip it when a current commit-graph snapshot exists
+     since everything they read is then either immutable or replaced atomically. Without the lock nothing may be
+     written either (suppressWrites), not even the files reads leave behind as caches
+*/
+int MiniGit::execute(const vector<string>& args, ostream& out, ostream& err) {
+    lock_guard<mutex> guard(apiMutex);
+
+    const string cmd = args.empty() ? "" : args[0];
+    if (cmd == "init" || cmd == "clone" || cmd == "batch" || cmd == "daemon") {
+        err << RED << "fatal: '" << cmd << "' can't be run on an open repository" << END << "\n";
+        return 1;
+    }
+
+    Repository repo(root);
+    repo.setOutput(out, err);
+    if (args.empty()) {
+        printUsage(out);
+        return 0;
+    }
+    if (!checkRepository(repo, cmd)) {
+        return 1;
+    }
+
+    int exitCode = 1;
+    try {
+        bool readOnly = isReadOnlyCommand(args);
+        bool lockFree = readOnly && CommitGraph::isCurrent(repo.getCommitsDir());
+
+        unique_ptr<RepoLock> lock;
+        if (!lockFree) {
+            lock.reset(new RepoLock(repo.getVcsRoot(), readOnly ? RepoLock::Shared : RepoLock::Exclusive, true, err));
+        }
+        suppressWrites(lockFree);
+
+        Session& s = attach(out, err);
+
+        exitCode = runCommand(s, args);
+        if (exitCode == 0 && !readOnly && cmd != "gc") {
+            autoCollect(s);
+        }
+
+        s.statCache->save();
+        sessionStamp = s.stamp();
+    } catch (const exception& e) {
+        err << RED << "fatal: " << e.what() << END << endl;
+        exitCode = 1;
+        session.reset();
+    }
+    suppressWrites(false);
+    detach();
+    return exitCode;
+}
+
+MiniGit::MiniGit(const filesystem::path& repositoryRoot) : root(filesystem::absolute(repositoryRoot)) {
+}
+
+MiniGit::~MiniGit() {
+    lock_guard<mutex> guard(apiMutex);
+    session.reset();
+}
+
+const char* MiniGit::errorName(MiniGitError error) {
+    switch (error) {
+        case MG_OK: return "ok";
+        case MG_NOT_A_REPOSITORY: return "not a repository";
+        case MG_ALREADY_INITIALIZED: return "already initialized";
+        case MG_INVALID_ARGUMENT: return "invalid argument";
+        case MG_PATH_NOT_FOUND: return "path not found";
+        case MG_COMMIT_NOT_FOUND: return "commit not found";
+        case MG_NOTHING_TO_UNDO: return "nothing to undo";
+        case MG_NOTHING_TO_REDO: return "nothing to redo";
+        case MG_IO_ERROR: return "i/o error";
+    }
+    return "unknown error";
+}
+
+static CommitInfo describe(const CommitManager& manager, CommitNode* node) {
+    return {string(node->getCommitID()), string(node->getCommitMsg()), manager.readCommitDate(node->getCommitID()),
+            string(node->getPrevID())};
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// WRITE OPERATIONS
+//----------------------------------------------------------------------------------------------------------------------------
+
+MiniGitResult MiniGit::init() {
+    lock_guard<mutex> guard(apiMutex);
+    ostringstream out;
+
+    try {
+        filesystem::create_directories(root);
+
+        Repository repo(root);
+        repo.setOutput(out, out);
+        if (repo.isInitialized()) {
+            return {MG_ALREADY_INITIALIZED, "already a minigit repository: " + root.string()};
+        }
+        repo.init();
+    } catch (const exception& e) {
+        return {MG_IO_ERROR, e.what()};
+    }
+    return {MG_OK, ""};
+}
+
+MiniGitResult MiniGit::add(const vector<string>& paths) {
+    if (paths.empty()) {
+        return {MG_INVALID_ARGUMENT, "no paths given"};
+    }
+
+    return run(true, [&](Session& s) {
+        for (const string& path : paths) {
+            if (!filesystem::exists(root / path)) {
+                s.repo.err() << "pathspec '" << path << "' did not match any files\n";
+                return MG_PATH_NOT_FOUND;
+            }
+        }
+        return s.repo.add(paths) == 0 ? MG_OK : MG_IO_ERROR;
+    });
+}
+
+MiniGitResult MiniGit::addAll() {
+    return run(true, [&](Session& s) {
+        return s.repo.addAll() == 0 ? MG_OK : MG_IO_ERROR;
+    });
+}
+
+MiniGitResult MiniGit::commit(const string& message, CommitInfo* created) {
+    if (message.empty()) {
+        return {MG_INVALID_ARGUMENT, "empty commit message"};
+    }
+
+    return run(true, [&](Session& s) {
+        s.manager->addCommit(message);
+        s.restore->recordCommit(s.repo.getHead());
+        s.repo.clearStaging();
+
+        if (created) {
+            *created = describe(*s.manager, s.manager->getHead());
+        }
+        return MG_OK;
+    });
+}
+
+MiniGitResult MiniGit::revert(const string& commitID, CommitInfo* created) {
+    return run(true, [&](Session& s) {
+        if (!s.manager->commitExists(commitID)) {
+            s.repo.err() << "commit '" << commitID << "' not found\n";
+            return MG_COMMIT_NOT_FOUND;
+        }
+
+        s.manager->revert(commitID);
+        s.restore->recordCommit(s.repo.getHead());
+
+        if (created) {
+            *created = describe(*s.manager, s.manager->getHead());
+        }
+        return MG_OK;
+    });
+}
+
+MiniGitResult MiniGit::undo(string* checkedOut) {
+    return run(true, [&](Session& s) {
+        if (!s.restore->undo()) {
+            s.repo.err() << "no previous commit to undo to\n";
+            return MG_NOTHING_TO_UNDO;
+        }
+        if (checkedOut) {
+            *checkedOut = s.restore->getCurrentCommit();
+        }
+        return MG_OK;
+    });
+}
+
+MiniGitResult MiniGit::redo(string* checkedOut) {
+    return run(true, [&](Session& s) {
+        if (!s.restore->redo()) {
+            s.repo.err() << "no undone commit to redo\n";
+            return MG_NOTHING_TO_REDO;
+        }
+        if (checkedOut) {
+            *checkedOut = s.restore->getCurrentCommit();
+        }
+        return MG_OK;
+    });
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// READ OPERATIONS
+//----------------------------------------------------------------------------------------------------------------------------
+
+MiniGitResult MiniGit::head(string& commitID) {
+    return run(false, [&](Session& s) {
+        commitID = s.repo.getHead();
+        return MG_OK;
+    });
+}
+
+MiniGitResult MiniGit::log(vector<CommitInfo>& commits, const string& path) {
+    commits.clear();
+
+    return run(false, [&](Session& s) {
+        string key = path.empty() ? "" : Manifest::normalizePath(path, root);
+
+        for (CommitNode* curr = s.manager->getHead(); curr; curr = curr->getPrevNode()) {
+            if (key.empty() || s.manager->commitTouchesPath(curr, key)) {
+                commits.push_back(describe(*s.manager, curr));
+            }
+        }
+        return MG_OK;
+    });
+}
+
+MiniGitResult MiniGit::changes(vector<FileChange>& out, const string& fromCommit, const string& toCommit) {
+    out.clear();
+
+    return run(false, [&](Session& s) {
+        string from = fromCommit.empty() ? s.repo.getHead() : fromCommit;
+
+        // a repository without commits yet compares the working tree against nothing
+        bool fromNothing = fromCommit.empty() && from == "NA";
+
+        if (!fromNothing && !s.manager->commitExists(from)) {
+            s.repo.err() << "commit '" << from << "' not found\n";
+            return MG_COMMIT_NOT_FOUND;
+        }
+        if (!toCommit.empty() && !s.manager->commitExists(toCommit)) {
+            s.repo.err() << "commit '" << toCommit << "' not found\n";
+            return MG_COMMIT_NOT_FOUND;
+        }
+
+        fs::path oldRoot = Layout::commitDir(s.repo.getCommitsDir(), from) / "Data";
+        Manifest oldTree = Manifest::forCommit(s.repo.getCommitsDir(), from);
+        if (toCommit.empty()) {
+            oldTree = SparseCheckout::load(root).visible(oldTree);
+        }
+
+        fs::path newRoot = toCommit.empty() ? root : Layout::commitDir(s.repo.getCommitsDir(), toCommit) / "Data";
+        Manifest newTree = toCommit.empty() ? Manifest::scanWorkingTree(newRoot, *s.statCache)
+                                            : Manifest::forCommit(s.repo.getCommitsDir(), toCommit);
+
+        out = TreeDiff::compare(oldTree, oldRoot, newTree, newRoot);
+        return MG_OK;
+    });
+}
+
+MiniGitResult MiniGit::restoreState(RestoreInfo& out) {
+    return run(false, [&](Session& s) {
+        out.current = s.restore->getCurrentCommit();
+        out.undoTarget = s.restore->getUndoTarget();
+        out.redoTarget = s.restore->getRedoTarget();
+        out.undoDepth = s.restore->getUndoStackSize();
+        out.redoDepth = s.restore->getRedoStackSize();
+        return MG_OK;
+    });
+}
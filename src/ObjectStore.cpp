@@ -0,0 +1,93 @@
+#include "ObjectStore.h"
+#include "Layout.h"
+#include <stdexcept>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CONSTRUCTOR
+//----------------------------------------------------------------------------------------------------------------------------
+
+ObjectStore::ObjectStore(const filesystem::path& vcsRoot) {
+    objectsDir = vcsRoot / "objects";
+}
+
+bool ObjectStore::has(const string& hash) const {
+    if (known.count(hash)) {
+        return true;
+    }
+
+    if (!filesystem::exists(pathFor(hash))) {
+        return false;
+    }
+
+    known.insert(hash);
+    return true;
+}
+
+filesystem::path ObjectStore::pathFor(const string& hash) const {
+    return Layout::objectPath(objectsDir, hash);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// STORE
+// Copies a file into the store under its hash. Returns how many bytes were written (0 if we already had it).
+// We copy to a temporary name first and rename, so a half copied object is never visible under its hash
+//----------------------------------------------------------------------------------------------------------------------------
+
+uintmax_t ObjectStore::store(const filesystem::path& source, const string& hash) {
+    if (has(hash)) {
+        return 0;
+    }
+
+    filesystem::create_directories(pathFor(hash).parent_path());
+
+    filesystem::path tmp = pathFor(hash);
+    tmp += ".tmp";
+
+    filesystem::copy_file(source, tmp, filesystem::copy_options::overwrite_existing);
+    filesystem::rename(tmp, pathFor(hash));
+    known.insert(hash);
+
+    return filesystem::file_size(pathFor(hash));
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// ADOPT
+// Same as store, but for files inside a commit's Data folder: those are immutable, so a hardlink is enough.
+// Falls back to a copy when the filesystem doesn't support hardlinks
+//----------------------------------------------------------------------------------------------------------------------------
+
+uintmax_t ObjectStore::adopt(const filesystem::path& committedFile, const string& hash) {
+    if (has(hash)) {
+        return 0;
+    }
+
+    filesystem::create_directories(pathFor(hash).parent_path());
+
+    error_code ec;
+    filesystem::create_hard_link(committedFile, pathFor(hash), ec);
+    if (!ec) {
+        known.insert(hash);
+        return 0;
+    }
+
+    return store(committedFile, hash);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// COPY OUT
+// Objects are shared, so they're always copied (never linked) into the working tree or staging area
+//----------------------------------------------------------------------------------------------------------------------------
+
+void ObjectStore::copyOut(const string& hash, const filesystem::path& dest) const {
+    if (!has(hash)) {
+        throw runtime_error("object " + hash + " is missing from the store");
+    }
+
+    if (dest.has_parent_path()) {
+        filesystem::create_directories(dest.parent_path());
+    }
+
+    filesystem::copy_file(pathFor(hash), dest, filesystem::copy_options::overwrite_existing);
+}
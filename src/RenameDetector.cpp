@@ -0,0 +1,242 @@
+#include "RenameDetector.h"
+#include "HashingHelper.h"
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// MIX
+// splitmix64 finalizer, turns one line hash into SKETCH_SIZE independent looking hashes
+//----------------------------------------------------------------------------------------------------------------------------
+
+static uint64_t mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static string baseName(const string& path) {
+    size_t slash = path.rfind('/');
+    return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CONSTRUCTOR
+//----------------------------------------------------------------------------------------------------------------------------
+
+RenameDetector::RenameDetector(int minSimilarityPercent) : minSimilarity(minSimilarityPercent) {
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// SKETCH
+// Every line (long lines are cut into 64 byte pieces, so binary files still give several shingles) is hashed,
+// and for each of the SKETCH_SIZE hash functions we keep the minimum over the whole file
+//----------------------------------------------------------------------------------------------------------------------------
+
+vector<uint64_t> RenameDetector::sketch(const filesystem::path& file) const {
+    vector<uint64_t> mins(SKETCH_SIZE, numeric_limits<uint64_t>::max());
+
+    ifstream in(file, ios::binary);
+    string line;
+
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        for (size_t pos = 0; pos < line.size() || pos == 0; pos += 64) {
+            uint64_t h = hashString(line.substr(pos, 64));
+            for (int i = 0; i < SKETCH_SIZE; i++) {
+                mins[i] = min(mins[i], mix(h + i * 0xD6E8FEB86659FD93ULL));
+            }
+            if (line.size() <= 64) {
+                break;
+            }
+        }
+    }
+
+    return mins;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// DETECT
+/*
+    PART 1 => exact matches
+        -deleted files are grouped by content hash
+        -an added file with the same hash as a deleted one is a 100% rename (same file name preferred)
+        -an added file with the same hash as any other old file is a 100% copy
+
+    PART 2 => near matches
+        -sources are the remaining deleted files (renames, used once) and modified files (copies, reusable)
+        -each sketch is cut into BANDS bands, and a band's rows are hashed into a bucket key
+        -an added file is only compared with sources that share at least one bucket
+        -files whose sizes are too far apart to reach minSimilarity are skipped without comparing
+        -candidates are sorted by similarity and assigned greedily, best first
+*/
+//----------------------------------------------------------------------------------------------------------------------------
+
+vector<RenamePair> RenameDetector::detect(const Manifest& oldTree, const filesystem::path& oldRoot,
+                                          const Manifest& newTree, const filesystem::path& newRoot,
+                                          const vector<string>& deleted, const vector<string>& added,
+                                          const vector<string>& modified) const {
+    vector<RenamePair> pairs;
+
+    // ----------------------------------------- PART 1 -----------------------------------------
+    unordered_map<string, vector<string>> deletedByHash;
+    for (const string& d : deleted) {
+        deletedByHash[oldTree.find(d)->hash].push_back(d);
+    }
+
+    unordered_map<string, string> oldByHash;
+    for (auto& entry : oldTree.getEntries()) {
+        oldByHash.emplace(entry.second.hash, entry.first);
+    }
+
+    unordered_set<string> usedDeleted;
+    vector<string> remainingAdded;
+
+    for (const string& a : added) {
+        const string& hash = newTree.find(a)->hash;
+
+        auto it = deletedByHash.find(hash);
+        if (it != deletedByHash.end() && !it->second.empty()) {
+            vector<string>& candidates = it->second;
+
+            size_t pick = candidates.size() - 1;
+            for (size_t i = 0; i < candidates.size(); i++) {
+                if (baseName(candidates[i]) == baseName(a)) {
+                    pick = i;
+                    break;
+                }
+            }
+
+            pairs.push_back({candidates[pick], a, 100, false});
+            usedDeleted.insert(candidates[pick]);
+            candidates.erase(candidates.begin() + pick);
+            continue;
+        }
+
+        auto copied = oldByHash.find(hash);
+        if (copied != oldByHash.end()) {
+            pairs.push_back({copied->second, a, 100, true});
+            continue;
+        }
+
+        remainingAdded.push_back(a);
+    }
+
+    // ----------------------------------------- PART 2 -----------------------------------------
+    struct Source {
+        string path;
+        uintmax_t size;
+        bool copy;
+        vector<uint64_t> mins;
+    };
+
+    vector<Source> sources;
+    for (const string& d : deleted) {
+        if (!usedDeleted.count(d) && oldTree.find(d)->size > 0) {
+            sources.push_back({d, oldTree.find(d)->size, false, {}});
+        }
+    }
+    for (const string& m : modified) {
+        if (oldTree.find(m)->size > 0) {
+            sources.push_back({m, oldTree.find(m)->size, true, {}});
+        }
+    }
+
+    if (sources.empty() || remainingAdded.empty()) {
+        return pairs;
+    }
+
+    const int rows = SKETCH_SIZE / BANDS;
+    unordered_map<uint64_t, vector<int>> buckets;
+
+    auto bandKey = [&](const vector<uint64_t>& mins, int band) {
+        uint64_t key = mix(band);
+        for (int r = 0; r < rows; r++) {
+            key = mix(key ^ mins[band * rows + r]);
+        }
+        return key;
+    };
+
+    for (int s = 0; s < (int)sources.size(); s++) {
+        sources[s].mins = sketch(oldRoot / sources[s].path);
+        for (int band = 0; band < BANDS; band++) {
+            buckets[bandKey(sources[s].mins, band)].push_back(s);
+        }
+    }
+
+    struct Candidate {
+        int score;
+        int source;
+        int target;
+    };
+    vector<Candidate> candidates;
+
+    for (int t = 0; t < (int)remainingAdded.size(); t++) {
+        uintmax_t targetSize = newTree.find(remainingAdded[t])->size;
+        if (targetSize == 0) {
+            continue;
+        }
+
+        vector<uint64_t> mins = sketch(newRoot / remainingAdded[t]);
+        unordered_set<int> seen;
+
+        for (int band = 0; band < BANDS; band++) {
+            auto bucket = buckets.find(bandKey(mins, band));
+            if (bucket == buckets.end()) {
+                continue;
+            }
+
+            for (int s : bucket->second) {
+                if (!seen.insert(s).second) {
+                    continue;
+                }
+
+                uintmax_t small = min(targetSize, sources[s].size);
+                uintmax_t big = max(targetSize, sources[s].size);
+                if (small * 100 < big * (uintmax_t)minSimilarity) {
+                    continue;
+                }
+
+                int same = 0;
+                for (int i = 0; i < SKETCH_SIZE; i++) {
+                    same += (mins[i] == sources[s].mins[i]);
+                }
+
+                // identical content was already paired in part 1, so a full sketch match is "almost"
+                int score = min(99, same * 100 / SKETCH_SIZE);
+                if (score >= minSimilarity) {
+                    candidates.push_back({score, s, t});
+                }
+            }
+        }
+    }
+
+    sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.score > b.score;
+    });
+
+    vector<bool> targetUsed(remainingAdded.size(), false);
+    vector<bool> sourceUsed(sources.size(), false);
+
+    for (const Candidate& c : candidates) {
+        if (targetUsed[c.target]) {
+            continue;
+        }
+
+        bool copy = sources[c.source].copy || sourceUsed[c.source];
+        pairs.push_back({sources[c.source].path, remainingAdded[c.target], c.score, copy});
+
+        targetUsed[c.target] = true;
+        sourceUsed[c.source] = true;
+    }
+
+    return pairs;
+}
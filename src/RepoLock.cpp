@@ -0,0 +1,97 @@
+#include "RepoLock.h"
+#include "Repository.h"
+#include "Worktree.h"
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CONSTRUCTOR
+// Blocks until the lock is granted (unless wait is false). If the lock file can't be opened (read-only media etc)
+// we carry on unlocked with a warning rather than refusing to run
+//----------------------------------------------------------------------------------------------------------------------------
+
+RepoLock::RepoLock(const filesystem::path& vcsRoot, Mode mode, bool wait, ostream& warnings) : held(false), busy(false) {
+    filesystem::path lockPath = Worktree::mainVcsRoot(vcsRoot) / "lock";
+
+#ifdef _WIN32
+    handle = CreateFileW(lockPath.wstring().c_str(), GENERIC_READ | GENERIC_WRITE,
+                         FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS,
+                         FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        warnings << YEL << "warning: could not open " << lockPath << ", running without a repository lock" << END << endl;
+        return;
+    }
+
+    OVERLAPPED overlapped = {};
+    DWORD flags = (mode == Exclusive) ? LOCKFILE_EXCLUSIVE_LOCK : 0;
+    if (!wait) {
+        flags |= LOCKFILE_FAIL_IMMEDIATELY;
+    }
+    held = LockFileEx((HANDLE)handle, flags, 0, MAXDWORD, MAXDWORD, &overlapped);
+    busy = !held && GetLastError() == ERROR_LOCK_VIOLATION;
+#else
+    fd = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        warnings << YEL << "warning: could not open " << lockPath << ", running without a repository lock" << END << endl;
+        return;
+    }
+
+    int op = (mode == Exclusive) ? LOCK_EX : LOCK_SH;
+    if (!wait) {
+        op |= LOCK_NB;
+    }
+    int rc;
+    do {
+        rc = flock(fd, op);
+    } while (rc != 0 && errno == EINTR);
+
+    held = (rc == 0);
+    busy = !held && errno == EWOULDBLOCK;
+#endif
+
+    if (busy) {
+        return;
+    }
+    if (!held) {
+        warnings << YEL << "warning: could not lock " << lockPath << ", running without a repository lock" << END << endl;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// DESTRUCTOR
+// Closing the file releases the lock
+//----------------------------------------------------------------------------------------------------------------------------
+
+RepoLock::~RepoLock() {
+#ifdef _WIN32
+    if (handle != INVALID_HANDLE_VALUE) {
+        if (held) {
+            OVERLAPPED overlapped = {};
+            UnlockFileEx((HANDLE)handle, 0, MAXDWORD, MAXDWORD, &overlapped);
+        }
+        CloseHandle((HANDLE)handle);
+    }
+#else
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+}
+
+bool RepoLock::isHeld() const {
+    return held;
+}
+
+bool RepoLock::isBusy() const {
+    return busy;
+}
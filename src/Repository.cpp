@@ -1,26 +1,40 @@
 #include "Repository.h"
+#include "FileUtils.h"
+#include "BulkIO.h"
+#include "Manifest.h"
+#include "Trace.h"
+#include "Stats.h"
+#include "SparseCheckout.h"
+#include "Worktree.h"
+#include "Layout.h"
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
 
 using namespace std;
 
-Repository::Repository() {
-    vcsRoot = fs::current_path() / ".Minivcs";
+Repository::Repository(const fs::path& root) : root(root), outStream(&cout), errStream(&cerr) {
+    vcsRoot = root / ".Minivcs";
+    sharedRoot = Worktree::mainVcsRoot(vcsRoot);
     stagingArea = vcsRoot / "staging_area";
-    commitsDir = vcsRoot / "commits";
-    headFile = commitsDir / "HEAD.txt";
+    commitsDir = sharedRoot / "commits";
+    headFile = headFileFor(vcsRoot);
+}
+
+fs::path Repository::headFileFor(const fs::path& vcsRoot) {
+    return Worktree::isLinked(vcsRoot) ? vcsRoot / "HEAD.txt" : vcsRoot / "commits" / "HEAD.txt";
 }
 
 void Repository::init() {
     try {
         if (isInitialized()) {
-            cout << YEL << "Repository already initialized in " << vcsRoot << END << endl;
+            out() << YEL << "Repository already initialized in " << vcsRoot << END << endl;
             return;
         }
 
         fs::create_directories(stagingArea);
         fs::create_directories(commitsDir);
+        Layout::setSharded(commitsDir);
 
         // Create HEAD file pointing to no commit initially
         ofstream head(headFile);
@@ -30,11 +44,14 @@ void Repository::init() {
         head << "NA";
         head.close();
 
-        cout << GRN << "Initialized empty Minivcs repository in "
+        // the newest commit of the history, commits only point back at their parent
+        writeFileAtomically(commitsDir / "TIP.txt", "NA");
+
+        out() << GRN << "Initialized empty Minivcs repository in "
              << vcsRoot << END << endl;
 
     } catch (const fs::filesystem_error& e) {
-        cerr << RED << "Error initializing repository: " << e.what() << END << endl;
+        err() << RED << "Error initializing repository: " << e.what() << END << endl;
         throw;
     }
 }
@@ -47,41 +64,66 @@ bool Repository::isInitialized() const {
            fs::exists(headFile);
 }
 
-void Repository::add(const vector<string>& files) {
+int Repository::add(const vector<string>& files) {
+    TRACE_SPAN("Repository::add");
     if (!isInitialized()) {
-        cerr << RED << "fatal: not a Minivcs repository (or any parent up to mount point /)"
+        err() << RED << "fatal: not a Minivcs repository (or any parent up to mount point /)"
              << END << endl;
-        cerr << YEL << "Hint: Use 'init' to create a repository" << END << endl;
-        return;
+        err() << YEL << "Hint: Use 'init' to create a repository" << END << endl;
+        return (int)files.size();
     }
 
     if (files.empty()) {
-        cout << YEL << "Nothing specified, nothing added." << END << endl;
-        return;
+        out() << YEL << "Nothing specified, nothing added." << END << endl;
+        return 0;
     }
 
     int successCount = 0;
     int failCount = 0;
 
-    for (const auto& file : files) {
+    // collect the copies for every argument first, then copy them all in one bulk call
+    vector<CopyJob> jobs;
+    vector<size_t> owner;           // which argument each job came from
+    vector<string> errors(files.size());
+    SparseCheckout sparse = SparseCheckout::load(root);
+
+    {
+        TRACE_SPAN("Repository::add walk");
+        for (size_t i = 0; i < files.size(); i++) {
+            try {
+                addSingleFile(files[i], jobs, sparse);
+            } catch (const exception& e) {
+                errors[i] = e.what();
+            }
+            owner.resize(jobs.size(), i);
+        }
+    }
 
-        try {
-            addSingleFile(file);
-            cout << GRN << "add '" << file << "'" << END << endl;
+    vector<string> copyErrors = BulkIO::get().copyFiles(jobs);
+    for (size_t j = 0; j < jobs.size(); j++) {
+        if (!copyErrors[j].empty() && errors[owner[j]].empty()) {
+            errors[owner[j]] = copyErrors[j];
+        }
+    }
+
+    for (size_t i = 0; i < files.size(); i++) {
+        if (errors[i].empty()) {
+            out() << GRN << "add '" << files[i] << "'" << END << endl;
             successCount++;
-        } catch (const exception& e) {
-            cerr << RED << "error: '" << file << "': " << e.what() << END << endl;
+        } else {
+            err() << RED << "error: '" << files[i] << "': " << errors[i] << END << endl;
             failCount++;
         }
     }
 
     if (successCount > 0) {
-        cout << GRN << "Successfully added " << successCount << " file(s)" << END << endl;
+        out() << GRN << "Successfully added " << successCount << " file(s)" << END << endl;
     }
+    return failCount;
 }
 
-void Repository::addSingleFile(const string& filepath) {
-    fs::path sourcePath = fs::current_path() / filepath;
+void Repository::addSingleFile(const string& filepath, vector<CopyJob>& jobs, const SparseCheckout& sparse) {
+    fs::path sourcePath = root / filepath;
 
     // Check if file exists
     if (!fs::exists(sourcePath)) {
@@ -93,32 +135,42 @@ void Repository::addSingleFile(const string& filepath) {
         throw runtime_error("cannot add '.Minivcs' directory");
     }
 
+    // Nor anything the sparse checkout leaves out, the commit takes those from the checked out commit
+    string key = Manifest::normalizePath(filepath, root);
+    bool isDirectory = fs::is_directory(sourcePath);
+    if (key != "." && !(isDirectory ? sparse.includesDirectory(key) : sparse.includesFile(key))) {
+        throw runtime_error("'" + filepath + "' is outside the sparse checkout");
+    }
+
     // Compute destination path preserving directory structure
     fs::path destPath = stagingArea / filepath;
 
     // Create parent directories if needed
     if (destPath.has_parent_path()) {
-        fs::create_directories(destPath.parent_path());
+        if (fs::create_directories(destPath.parent_path())) {
+            Stats::add(STAT_DIRS_CREATED);
+        }
     }
 
-    // Copy file or directory
-    if (fs::is_directory(sourcePath)) {
-        copyRecursive(sourcePath, destPath);
+    // Queue the file, or everything under the directory
+    if (isDirectory) {
+        copyRecursive(sourcePath, destPath, jobs, sparse);
     } else {
-        fs::copy_file(sourcePath, destPath, fs::copy_options::overwrite_existing);
+        jobs.push_back({sourcePath, destPath});
     }
 }
 
-void Repository::addAll() {
+int Repository::addAll() {
+    TRACE_SPAN("Repository::addAll");
     if (!isInitialized()) {
-        cerr << RED << "fatal: not a Minivcs repository" << END << endl;
-        return;
+        err() << RED << "fatal: not a Minivcs repository" << END << endl;
+        return 1;
     }
 
     vector<string> allFiles;
 
     // Collect all files in current directory (non-recursively at top level)
-    for (const auto& entry : fs::directory_iterator(fs::current_path())) {
+    for (const auto& entry : fs::directory_iterator(root)) {
         string filename = entry.path().filename().string();
 
         // Skip VCS directories and hidden files
@@ -130,15 +182,15 @@ void Repository::addAll() {
     }
 
     if (allFiles.empty()) {
-        cout << YEL << "No files to add" << END << endl;
-        return;
+        out() << YEL << "No files to add" << END << endl;
+        return 0;
     }
 
-    cout << BLU << "Adding all files..." << END << endl;
-    add(allFiles);
+    out() << BLU << "Adding all files..." << END << endl;
+    return add(allFiles);
 }
 
-void Repository::copyRecursive(const fs::path& src, const fs::path& dest) {
+void Repository::copyRecursive(const fs::path& src, const fs::path& dest, vector<CopyJob>& jobs, const SparseCheckout& sparse) {
 
     for (auto &part : src) {
         if (part == ".Minivcs" || part == ".git") {
@@ -146,18 +198,108 @@ void Repository::copyRecursive(const fs::path& src, const fs::path& dest) {
         }
     }
 
-    if (fs::is_directory(src)) {
-        fs::create_directories(dest);
+    bool isDirectory = fs::is_directory(src);
+    if (sparse.isEnabled()) {
+        string key = src.lexically_relative(root).generic_string();
+        if (!(isDirectory ? sparse.includesDirectory(key) : sparse.includesFile(key))) {
+            return;  // outside the sparse checkout, never walked
+        }
+    }
+
+    if (isDirectory) {
+        if (fs::create_directories(dest)) {
+            Stats::add(STAT_DIRS_CREATED);
+        }
 
         for (const auto& entry : fs::directory_iterator(src)) {
             fs::path srcPath = entry.path();
             fs::path destPath = dest / srcPath.filename();
 
-            copyRecursive(srcPath, destPath);
+            copyRecursive(srcPath, destPath, jobs, sparse);
         }
     } else {
-        fs::copy_file(src, dest, fs::copy_options::overwrite_existing);
+        jobs.push_back({src, dest});
+    }
+}
+
+/*
+restorePaths
+    -"restore --source <commit> <paths...>": only the named files (or everything under a named directory) are
+     rewritten from the commit, the rest of the working tree, the staging area and HEAD stay as they are
+    -each path is looked up as Data/<path> directly, so finding it costs one path walk however big the commit is
+*/
+fs::path Repository::pathInCommit(const string& commitID, const string& path) const {
+    string key = Manifest::normalizePath(path, root);
+    string top = key.substr(0, key.find('/'));
+    if (key.empty() || key == "." || top == ".." || top == ".Minivcs" || top == ".git") {
+        throw runtime_error("'" + path + "' is outside the repository");
+    }
+
+    fs::path stored = Layout::commitDir(commitsDir, commitID) / "Data" / key;
+    Stats::add(STAT_FILES_STATED);
+    if (!fs::exists(stored)) {
+        throw runtime_error("pathspec '" + path + "' did not match any file in commit " + commitID);
     }
+    return stored;
+}
+
+int Repository::restorePaths(const string& commitID, const vector<string>& paths) {
+    TRACE_SPAN_DETAIL("Repository::restorePaths", commitID);
+
+    vector<CopyJob> jobs;
+    vector<size_t> owner;           // which argument each job came from
+    vector<string> errors(paths.size());
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        try {
+            fs::path stored = pathInCommit(commitID, paths[i]);
+            fs::path destPath = root / Manifest::normalizePath(paths[i], root);
+
+            if (fs::is_directory(stored)) {
+                // copyRecursive would skip it, everything stored sits under .Minivcs
+                fs::create_directories(destPath);
+                for (const auto& entry : fs::recursive_directory_iterator(stored)) {
+                    fs::path target = destPath / fs::relative(entry.path(), stored);
+                    if (entry.is_directory()) {
+                        if (fs::create_directories(target)) {
+                            Stats::add(STAT_DIRS_CREATED);
+                        }
+                    } else {
+                        jobs.push_back({entry.path(), target});
+                    }
+                }
+            } else {
+                if (fs::is_directory(destPath)) {
+                    throw runtime_error("'" + paths[i] + "' is a directory in the working tree");
+                }
+                if (fs::create_directories(destPath.parent_path())) {
+                    Stats::add(STAT_DIRS_CREATED);
+                }
+                jobs.push_back({stored, destPath});
+            }
+        } catch (const exception& e) {
+            errors[i] = e.what();
+        }
+        owner.resize(jobs.size(), i);
+    }
+
+    vector<string> copyErrors = BulkIO::get().copyFiles(jobs);
+    for (size_t j = 0; j < jobs.size(); j++) {
+        if (!copyErrors[j].empty() && errors[owner[j]].empty()) {
+            errors[owner[j]] = copyErrors[j];
+        }
+    }
+
+    int failCount = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (errors[i].empty()) {
+            out() << GRN << "restored '" << paths[i] << "' from " << commitID << END << endl;
+        } else {
+            err() << RED << "error: " << errors[i] << END << endl;
+            failCount++;
+        }
+    }
+    return failCount;
 }
 
 bool Repository::isVcsDirectory(const fs::path& path) const {
@@ -167,6 +309,7 @@ bool Repository::isVcsDirectory(const fs::path& path) const {
 }
 
 void Repository::clearStaging() {
+    TRACE_SPAN("Repository::clearStaging");
     if (!isInitialized()) {
         return;
     }
@@ -176,10 +319,10 @@ void Repository::clearStaging() {
             for (const auto& entry : fs::directory_iterator(stagingArea)) {
                 fs::remove_all(entry);
             }
-            cout << GRN << "Staging area cleared" << END << endl;
+            out() << GRN << "Staging area cleared" << END << endl;
         }
     } catch (const fs::filesystem_error& e) {
-        cerr << RED << "Error clearing staging area: " << e.what() << END << endl;
+        err() << RED << "Error clearing staging area: " << e.what() << END << endl;
     }
 }
 
@@ -198,7 +341,7 @@ vector<string> Repository::getStagedFiles() const {
             }
         }
     } catch (const fs::filesystem_error& e) {
-        cerr << RED << "Error reading staged files: " << e.what() << END << endl;
+        err() << RED << "Error reading staged files: " << e.what() << END << endl;
     }
 
     return stagedFiles;
@@ -212,10 +355,18 @@ bool Repository::isStagingEmpty() const {
     return fs::is_empty(stagingArea);
 }
 
+fs::path Repository::getRoot() const {
+    return root;
+}
+
 fs::path Repository::getVcsRoot() const {
     return vcsRoot;
 }
 
+fs::path Repository::getSharedRoot() const {
+    return sharedRoot;
+}
+
 fs::path Repository::getStagingArea() const {
     return stagingArea;
 }
@@ -225,80 +376,75 @@ fs::path Repository::getCommitsDir() const {
 }
 
 string Repository::getHead() const {
-    if (!fs::exists(headFile)) {
-        return "NA";
-    }
+    return readMetadataFile(headFile);
+}
 
-    ifstream head(headFile);
-    string commitID;
-    getline(head, commitID);
-    head.close();
+ostream& Repository::out() const {
+    return *outStream;
+}
+
+ostream& Repository::err() const {
+    return *errStream;
+}
 
-    return commitID;
+void Repository::setOutput(ostream& out, ostream& err) {
+    outStream = &out;
+    errStream = &err;
 }
 
 void Repository::setHead(const string& commitID) {
-    ofstream head(headFile);
-    if (!head) {
+    TRACE_SPAN("Repository::setHead");
+    try {
+        writeMetadataFile(headFile, commitID);
+    } catch (const exception&) {
         throw runtime_error("Failed to update HEAD");
     }
-    head << commitID;
-    head.close();
 }
 
 void Repository::checkout(const string& commitID) {
+    TRACE_SPAN_DETAIL("Repository::checkout", commitID);
     if (!isInitialized()) {
-        cerr << RED << "fatal: not a Minivcs repository" << END << endl;
+        err() << RED << "fatal: not a Minivcs repository" << END << endl;
         return;
     }
 
-    fs::path commitPath = commitsDir / commitID;
+    fs::path commitPath = Layout::commitDir(commitsDir, commitID);
     fs::path commitDataPath = commitPath / "Data";
 
     if (!fs::exists(commitDataPath)) {
-        cerr << RED << "fatal: commit '" << commitID << "' does not exist" << END << endl;
+        err() << RED << "fatal: commit '" << commitID << "' does not exist" << END << endl;
         return;
     }
 
     try {
         // STEP 1: Remove all files in working directory (except .Minivcs)
-        for (const auto& entry : fs::directory_iterator(fs::current_path())) {
-            string filename = entry.path().filename().string();
-
-            // Skip .Minivcs directory
-            if (filename == ".Minivcs" || filename == ".git") {
-                continue;
-            }
-
-            // Remove everything else
-            fs::remove_all(entry);
-        }
-
-        // STEP 2: Copy all files from commit's Data folder to working directory
-        for (const auto& entry : fs::recursive_directory_iterator(commitDataPath)) {
-            fs::path relativePath = fs::relative(entry.path(), commitDataPath);
-            fs::path destPath = fs::current_path() / relativePath;
-
-            if (fs::is_directory(entry)) {
-                fs::create_directories(destPath);
-            } else {
-                // Create parent directories if needed
-                if (destPath.has_parent_path()) {
-                    fs::create_directories(destPath.parent_path());
+        {
+            TRACE_SPAN("Repository::checkout clear");
+            for (const auto& entry : fs::directory_iterator(root)) {
+                string filename = entry.path().filename().string();
+
+                // Skip .Minivcs directory
+                if (filename == ".Minivcs" || filename == ".git") {
+                    continue;
                 }
 
-                // Copy the file
-                fs::copy_file(entry, destPath, fs::copy_options::overwrite_existing);
+                // Remove everything else
+                fs::remove_all(entry);
             }
         }
 
+        // STEP 2: Copy all files from commit's Data folder to working directory (in one bulk call),
+        // only the sparse checkout's cones if there is one
+        SparseCheckout sparse = SparseCheckout::load(root);
+        BulkIO::get().copyTree(commitDataPath, root, &sparse);
+
         // Update HEAD to point to this commit
         setHead(commitID);
 
-        cout << GRN << "Checked out commit: " << commitID << END << endl;
+        out() << GRN << "Checked out commit: " << commitID << END << endl;
 
-    } catch (const fs::filesystem_error& e) {
-        cerr << RED << "Error during checkout: " << e.what() << END << endl;
+    } catch (const exception& e) {
+        err() << RED << "Error during checkout: " << e.what() << END << endl;
         throw;
     }
 }
\ No newline at end of file
@@ -1,12 +1,22 @@
 #include "Restore.h"
+#include "FileUtils.h"
+#include "Trace.h"
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <cstdlib>
+#include <algorithm>
 
 using namespace std;
 namespace fs = filesystem;
 //constructor for knowing what repo we are working on//
-Restore::Restore(Repository* repository) : repo(repository), currentCommitID("NA") {
+Restore::Restore(Repository* repository) : repo(repository), currentCommitID("NA"),
+                                           maxDepth(0), generation(0), journalEntries(0), pendingEntries(0) {
+    const char* depth = getenv("MINIGIT_UNDO_DEPTH");
+    if (depth) {
+        maxDepth = max(0, atoi(depth));
+    }
+
     if (repo && repo->isInitialized()) {
         loadStateFromDisk();
 
@@ -15,75 +25,107 @@ Restore::Restore(Repository* repository) : repo(repository), currentCommitID("NA
             string headCommit = repo->getHead();
             if (headCommit != "NA") {
                 currentCommitID = headCommit;
-                saveStateToDisk();
+                if (!writesSuppressed()) {
+                    saveStateToDisk();
+                }
             }
         }
     }
 }
-//destructor, to save restore-able states to file
+//destructor, nothing left to save since every operation is journaled as it happens
 Restore::~Restore() {
-    saveStateToDisk();
 }
 
-void Restore::recordCommit(const string& commitID) {
+//----------------------------------------------------------------------------------------------------------------------------
+// STATE TRANSITIONS
+// The in-memory part of each operation, shared by the public functions and by journal replay
+//----------------------------------------------------------------------------------------------------------------------------
+
+void Restore::applyCommit(const string& commitID) {
     // When a new commit is made, push current state to undo stack
     if (currentCommitID != "NA") {
         undoStack.push(currentCommitID);
+        enforceDepth(undoStack);
     }
 
     // Clear redo stack since we're creating a new branch
-    while (!redoStack.isEmpty()) {
-        redoStack.pop();
-    }
-//set the current id and save everything to file
+    redoStack.clear();
+
     currentCommitID = commitID;
-    saveStateToDisk();
+}
+
+void Restore::applyUndo() {
+    // Push current commit to redo stack, pop the previous commit from undo stack
+    redoStack.push(currentCommitID);
+    enforceDepth(redoStack);
+    currentCommitID = undoStack.pop();
+}
+
+void Restore::applyRedo() {
+    // Push current commit back to undo stack, pop the next commit from redo stack
+    undoStack.push(currentCommitID);
+    enforceDepth(undoStack);
+    currentCommitID = redoStack.pop();
+}
+
+void Restore::applyClear() {
+    undoStack.clear();
+    redoStack.clear();
+    currentCommitID = "NA";
+}
+
+void Restore::enforceDepth(Stack& stack) {
+    while (maxDepth > 0 && stack.size() > maxDepth) {
+        stack.dropBottom();
+    }
+}
+
+void Restore::setMaxDepth(int depth) {
+    maxDepth = max(0, depth);
+    enforceDepth(undoStack);
+    enforceDepth(redoStack);
+}
+
+void Restore::recordCommit(const string& commitID) {
+    TRACE_SPAN("Restore::recordCommit");
+    applyCommit(commitID);
+    appendToJournal("COMMIT:" + commitID);
 }
 
 bool Restore::undo() {
+    TRACE_SPAN("Restore::undo");
     // Can't undo if there's nothing in the undo stack
     if (undoStack.isEmpty()) {
-        cout << "Cannot undo! No previous commits available." << endl;
+        repo->out() << "Cannot undo! No previous commits available." << endl;
         return false;
     }
 
-    string previousCurrent = currentCommitID;
-
-    // Push current commit to redo stack
-    redoStack.push(currentCommitID);
+    applyUndo();
 
-    // Pop the previous commit from undo stack
-    currentCommitID = undoStack.pop();
+    // Record it before touching the working directory so the state matches even if checkout fails halfway
+    appendToJournal("UNDO:" + currentCommitID);
 
     // Checkout to the previous commit (this updates working directory)
     repo->checkout(currentCommitID);
 
-    // Save the new state immediately
-    saveStateToDisk();
-
     return true;
 }
 
 bool Restore::redo() {
+    TRACE_SPAN("Restore::redo");
 
     // Can't redo if there's nothing in the redo stack
     if (redoStack.isEmpty()) {
-        cout << "Cannot redo! No forward commits available." << endl;
+        repo->out() << "Cannot redo! No forward commits available." << endl;
         return false;
     }
 
-    // Push current commit back to undo stack
-    undoStack.push(currentCommitID);
+    applyRedo();
+    appendToJournal("REDO:" + currentCommitID);
 
-    // Pop the next commit from redo stack
-    currentCommitID = redoStack.pop();
     // Checkout to the next commit
     repo->checkout(currentCommitID);
 
-    // Save the new state immediately
-    saveStateToDisk();
-
-
     return true;
 }
 
@@ -122,23 +164,18 @@ int Restore::getRedoStackSize() const {
 }
 
 void Restore::clear() {
-    while (!undoStack.isEmpty()) {
-        undoStack.pop();
-    }
-    while (!redoStack.isEmpty()) {
-        redoStack.pop();
-    }
-    currentCommitID = "NA";
-    saveStateToDisk();
+    applyClear();
+    appendToJournal("CLEAR");
 }
 
 void Restore::loadHistory(CommitNode* head) {
+    TRACE_SPAN("Restore::loadHistory");
     if (!head) {
         return;
     }
 
     // Clear existing stacks
-    clear();
+    applyClear();
 
     // Build undo stack from commit history (oldest to newest, excluding head)
     vector<string> commits;
@@ -146,12 +183,16 @@ void Restore::loadHistory(CommitNode* head) {
 
     // Collect all commits from head to tail
     while (curr) {
-        commits.push_back(curr->getCommitID());
+        commits.emplace_back(curr->getCommitID());
         curr = curr->getPrevNode();
     }
 
-    // Push them in reverse order (oldest first) to undo stack
-    for (int i = commits.size() - 1; i >= 1; i--) {
+    // Push them in reverse order (oldest first) to undo stack, only the newest maxDepth if bounded
+    int oldest = commits.size() - 1;
+    if (maxDepth > 0 && oldest > maxDepth) {
+        oldest = maxDepth;
+    }
+    for (int i = oldest; i >= 1; i--) {
         undoStack.push(commits[i]);
     }
 
@@ -164,61 +205,120 @@ void Restore::loadHistory(CommitNode* head) {
 }
 
 void Restore::printStatus() const {
-    cout << "========================================\n"
+    repo->out() << "========================================\n"
          << "Restore Status:\n"
          << "========================================\n"
          << "Current: " << (currentCommitID == "NA" ? "None" : currentCommitID) << "\n"
          << "Undo Stack: " << getUndoStackSize() << " commits | Can Undo: " << (canUndo() ? "Yes" : "No") << "\n"
          << "Redo Stack: " << getRedoStackSize() << " commits | Can Redo: " << (canRedo() ? "Yes" : "No") << "\n";
 
-    if (canUndo()) cout << "Next Undo → " << getUndoTarget() << "\n";
-    if (canRedo()) cout << "Next Redo → " << getRedoTarget() << "\n";
+    if (canUndo()) repo->out() << "Next Undo → " << getUndoTarget() << "\n";
+    if (canRedo()) repo->out() << "Next Redo → " << getRedoTarget() << "\n";
 
     // Show actual stack contents for debugging
     if (undoStack.size() > 0) {
-        cout << "\nUndo Stack (bottom -> top):\n";
+        repo->out() << "\nUndo Stack (bottom -> top):\n";
         for (int i = 0; i < undoStack.size(); i++) {
-            cout << "  [" << i << "] " << undoStack.data[i] << "\n";
+            repo->out() << "  [" << i << "] " << undoStack.data[i] << "\n";
         }
     }
     if (redoStack.size() > 0) {
-        cout << "\nRedo Stack (bottom -> top):\n";
+        repo->out() << "\nRedo Stack (bottom -> top):\n";
         for (int i = 0; i < redoStack.size(); i++) {
-            cout << "  [" << i << "] " << redoStack.data[i] << "\n";
+            repo->out() << "  [" << i << "] " << redoStack.data[i] << "\n";
         }
     }
 
-    cout << "========================================\n";
+    repo->out() << "========================================\n";
 }
 
 void Restore::viewHistory(CommitNode* head) const {
     if (!head) {
-        cout << "No commits found.\n";
+        repo->out() << "No commits found.\n";
         return;
     }
 
-    cout << "\n========== COMMIT HISTORY ==========\n";
+    repo->out() << "\n========== COMMIT HISTORY ==========\n";
     for (CommitNode* curr = head; curr; curr = curr->getPrevNode()) {
-        cout << (curr->getCommitID() == currentCommitID ? " -> [CURRENT] " : "             ")
+        repo->out() << (curr->getCommitID() == currentCommitID ? " -> [CURRENT] " : "             ")
              << "Commit: " << curr->getCommitID() << "\n";
     }
-    cout << "====================================\n";
+    repo->out() << "====================================\n";
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// JOURNAL
+// One line appended per operation. When the journal gets long we fold it into a new snapshot
+//----------------------------------------------------------------------------------------------------------------------------
+
+void Restore::appendToJournal(const string& entry) {
+    if (!repo || !repo->isInitialized()) {
+        return;
+    }
+
+    pendingJournal += entry + "\n";
+    pendingEntries++;
+
+    if (!metadataWritesDeferred()) {
+        flushJournal();
+    }
 }
 
-void Restore::saveStateToDisk() const {
+void Restore::flushJournal() {
+    TRACE_SPAN("Restore::flushJournal");
+    if (pendingEntries == 0 || !repo || !repo->isInitialized()) {
+        return;
+    }
+
+    // the snapshot already holds everything that's pending
+    if (journalEntries + pendingEntries > JOURNAL_COMPACT_LIMIT) {
+        saveStateToDisk();
+        return;
+    }
+
+    fs::path journalPath = repo->getVcsRoot() / "restore_journal.txt";
+    bool fresh = !fs::exists(journalPath);
+
+    ofstream file(journalPath, ios::app);
+    if (!file) {
+        repo->err() << "Failed to append to restore journal" << endl;
+        return;
+    }
+
+    if (fresh) {
+        file << "GENERATION:" << generation << "\n";
+    }
+    file << pendingJournal;
+    journalEntries += pendingEntries;
+    pendingJournal.clear();
+    pendingEntries = 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// SAVE (COMPACTION)
+// Writes the whole state as a new snapshot generation, then starts an empty journal for it.
+// The snapshot is written to a temporary file and renamed so a crash never leaves half of it
+//----------------------------------------------------------------------------------------------------------------------------
+
+void Restore::saveStateToDisk() {
+    TRACE_SPAN("Restore::saveStateToDisk");
     if (!repo || !repo->isInitialized()) {
         return;
     }
 
     fs::path restorePath = repo->getVcsRoot() / "restore_state.txt";
+    fs::path tmpPath = repo->getVcsRoot() / "restore_state.txt.tmp";
+    fs::path journalPath = repo->getVcsRoot() / "restore_journal.txt";
 
     try {
-        ofstream file(restorePath);
+        ofstream file(tmpPath);
         if (!file) {
-            cerr << "Failed to save restore state to disk" << endl;
+            repo->err() << "Failed to save restore state to disk" << endl;
             return;
         }
 
+        file << "GENERATION:" << generation + 1 << "\n";
+
         // Save current commit ID
         file << "CURRENT:" << currentCommitID << "\n";
 
@@ -235,37 +335,50 @@ void Restore::saveStateToDisk() const {
         }
 
         file.close();
+        fs::rename(tmpPath, restorePath);
+
+        generation++;
+
+        ofstream journal(journalPath, ios::trunc);
+        journal << "GENERATION:" << generation << "\n";
+        journalEntries = 0;
+        pendingJournal.clear();
+        pendingEntries = 0;
+
     } catch (const exception& e) {
-        cerr << "Error saving restore state: " << e.what() << endl;
+        repo->err() << "Error saving restore state: " << e.what() << endl;
     }
 }
 
+//----------------------------------------------------------------------------------------------------------------------------
+// LOAD
+// Snapshot first, then the journal entries recorded after it (only if the journal belongs to this snapshot).
+// No snapshot is generation 0 over an empty state, which is what a journal started before any snapshot belongs to
+//----------------------------------------------------------------------------------------------------------------------------
+
 void Restore::loadStateFromDisk() {
+    TRACE_SPAN("Restore::loadStateFromDisk");
     if (!repo || !repo->isInitialized()) {
         return;
     }
 
     fs::path restorePath = repo->getVcsRoot() / "restore_state.txt";
-
-    if (!fs::exists(restorePath)) {
-        // No saved state
-        return;
-    }
+    fs::path journalPath = repo->getVcsRoot() / "restore_journal.txt";
 
     try {
-        ifstream file(restorePath);
-        if (!file) {
-            return;
-        }
-
         string line;
 
         // Clear existing data
-        while (!undoStack.isEmpty()) undoStack.pop();
-        while (!redoStack.isEmpty()) redoStack.pop();
+        applyClear();
+        generation = 0;
+        journalEntries = 0;
 
-        while (getline(file, line)) {
-            if (line.find("CURRENT:") == 0) {
+        ifstream file(restorePath);
+        while (file && getline(file, line)) {
+            if (line.find("GENERATION:") == 0) {
+                generation = stol(line.substr(11));
+            }
+            else if (line.find("CURRENT:") == 0) {
                 currentCommitID = line.substr(8);
             }
             else if (line.find("UNDO:") == 0) {
@@ -277,7 +390,44 @@ void Restore::loadStateFromDisk() {
         }
 
         file.close();
+
+        enforceDepth(undoStack);
+        enforceDepth(redoStack);
+
+        ifstream journal(journalPath);
+        if (!journal || !getline(journal, line) || line != "GENERATION:" + to_string(generation)) {
+            return;     // no journal yet, or one left over from an older snapshot
+        }
+
+        while (getline(journal, line)) {
+            if (line.find("COMMIT:") == 0) {
+                applyCommit(line.substr(7));
+            }
+            // the target is recorded too, so replay lands on the same commit even if
+            // MINIGIT_UNDO_DEPTH changed and the stacks were trimmed differently this time
+            else if (line.find("UNDO:") == 0) {
+                if (undoStack.isEmpty()) {
+                    undoStack.push(line.substr(5));
+                }
+                applyUndo();
+                currentCommitID = line.substr(5);
+            }
+            else if (line.find("REDO:") == 0) {
+                if (redoStack.isEmpty()) {
+                    redoStack.push(line.substr(5));
+                }
+                applyRedo();
+                currentCommitID = line.substr(5);
+            }
+            else if (line == "CLEAR") {
+                applyClear();
+            }
+            else {
+                continue;
+            }
+            journalEntries++;
+        }
     } catch (const exception& e) {
-        cerr << "Error loading restore state: " << e.what() << endl;
+        repo->err() << "Error loading restore state: " << e.what() << endl;
     }
 }
@@ -0,0 +1,172 @@
+#include "SparseCheckout.h"
+#include "FileUtils.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "Layout.h"
+#include <fstream>
+#include <algorithm>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// LOAD / SAVE
+//----------------------------------------------------------------------------------------------------------------------------
+
+SparseCheckout SparseCheckout::load(const filesystem::path& root) {
+    SparseCheckout sparse;
+    ifstream in(root / ".Minivcs" / "sparse-checkout.txt");
+    string line;
+    vector<string> directories;
+    while (getline(in, line)) {
+        if (!line.empty() && line[0] != '#') {
+            directories.push_back(line);
+        }
+    }
+    sparse.setCones(directories, root);
+    return sparse;
+}
+
+void SparseCheckout::save(const filesystem::path& root) const {
+    filesystem::path file = root / ".Minivcs" / "sparse-checkout.txt";
+    if (cones.empty()) {
+        error_code ec;
+        filesystem::remove(file, ec);
+        return;
+    }
+
+    string contents;
+    for (const string& cone : cones) {
+        contents += cone + "\n";
+    }
+    writeFileAtomically(file, contents);
+}
+
+bool SparseCheckout::isEnabled() const {
+    return !cones.empty();
+}
+
+const vector<string>& SparseCheckout::getCones() const {
+    return cones;
+}
+
+// "./a/b/" and "a/b" are the same cone, and a cone inside another one adds nothing
+void SparseCheckout::setCones(const vector<string>& directories, const filesystem::path& root) {
+    vector<string> normalized;
+    for (const string& directory : directories) {
+        string cone = Manifest::normalizePath(directory, root);
+        if (cone.empty() || cone == ".") {
+            cones.clear();              // the whole tree
+            return;
+        }
+        normalized.push_back(cone);
+    }
+    sort(normalized.begin(), normalized.end());
+
+    cones.clear();
+    for (const string& cone : normalized) {
+        if (cones.empty() || (cone != cones.back() && cone.rfind(cones.back() + "/", 0) != 0)) {
+            cones.push_back(cone);
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// MATCHING
+// A handful of cones, so a linear scan beats anything fancier
+//----------------------------------------------------------------------------------------------------------------------------
+
+static bool isUnder(const string& path, const string& directory) {
+    return path.size() > directory.size() && path[directory.size()] == '/' && path.compare(0, directory.size(), directory) == 0;
+}
+
+bool SparseCheckout::includesFile(const string& path) const {
+    if (cones.empty()) {
+        return true;
+    }
+
+    size_t slash = path.rfind('/');
+    if (slash == string::npos) {
+        return true;        // top level files are always there
+    }
+
+    string parent = path.substr(0, slash);
+    for (const string& cone : cones) {
+        if (isUnder(path, cone) || isUnder(cone, parent)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SparseCheckout::includesDirectory(const string& path) const {
+    if (cones.empty()) {
+        return true;
+    }
+
+    for (const string& cone : cones) {
+        if (path == cone || isUnder(path, cone) || isUnder(cone, path)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Manifest SparseCheckout::visible(Manifest tree) const {
+    if (cones.empty()) {
+        return tree;
+    }
+
+    Manifest result;
+    for (const auto& [path, entry] : tree.getEntries()) {
+        if (includesFile(path)) {
+            result.add(path, entry);
+        }
+    }
+    return result;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CARRY OVER
+//----------------------------------------------------------------------------------------------------------------------------
+
+int SparseCheckout::carryOver(const filesystem::path& commitsDir, const string& fromCommit, const string& toCommit) const {
+    if (cones.empty() || fromCommit.empty() || fromCommit == "NA") {
+        return 0;
+    }
+    TRACE_SPAN_DETAIL("SparseCheckout::carryOver", fromCommit);
+
+    filesystem::path fromData = Layout::commitDir(commitsDir, fromCommit) / "Data";
+    filesystem::path toData = Layout::commitDir(commitsDir, toCommit) / "Data";
+
+    Manifest base = Manifest::forCommit(commitsDir, fromCommit);
+    Manifest created = Manifest::forCommit(commitsDir, toCommit);
+
+    int carried = 0;
+    for (const auto& [path, entry] : base.getEntries()) {
+        if (includesFile(path) || created.find(path)) {
+            continue;
+        }
+
+        filesystem::path dest = toData / path;
+        if (filesystem::create_directories(dest.parent_path())) {
+            Stats::add(STAT_DIRS_CREATED);
+        }
+
+        // commit Data is never changed once written, so both commits can share the file
+        error_code ec;
+        filesystem::create_hard_link(fromData / path, dest, ec);
+        if (ec) {
+            filesystem::copy_file(fromData / path, dest, filesystem::copy_options::overwrite_existing);
+            Stats::add(STAT_FILES_COPIED);
+            Stats::add(STAT_BYTES_COPIED, entry.size);
+        }
+
+        created.add(path, entry);
+        carried++;
+    }
+
+    if (carried > 0) {
+        created.save(Layout::commitDir(commitsDir, toCommit) / "Manifest.txt");
+    }
+    return carried;
+}
@@ -0,0 +1,275 @@
+#include "Stash.h"
+#include "SparseCheckout.h"
+#include "Layout.h"
+#include <iostream>
+#include <fstream>
+#include <unordered_map>
+#include <set>
+#include <algorithm>
+#include <ctime>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// HELPERS
+//----------------------------------------------------------------------------------------------------------------------------
+
+static bool sameEntry(const ManifestEntry* a, const ManifestEntry* b) {
+    if (!a || !b) {
+        return a == b;
+    }
+    return a->hash == b->hash;
+}
+
+// after deleting a file, remove the folders it leaves empty (but never root itself)
+static void removeFile(const filesystem::path& root, const string& relative) {
+    filesystem::path file = root / relative;
+    filesystem::remove(file);
+
+    for (filesystem::path dir = file.parent_path(); dir != root && dir.has_relative_path(); dir = dir.parent_path()) {
+        error_code ec;
+        if (!filesystem::is_empty(dir, ec) || ec || !filesystem::remove(dir, ec)) {
+            break;
+        }
+    }
+}
+
+static string readInfo(const filesystem::path& infoFile, const string& key) {
+    ifstream in(infoFile);
+    string line;
+    while (getline(in, line)) {
+        if (line.find(key + ":") == 0) {
+            return line.substr(key.size() + 1);
+        }
+    }
+    return "";
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CONSTRUCTOR
+//----------------------------------------------------------------------------------------------------------------------------
+
+Stash::Stash(Repository* repository, ObjectStore* objectStore, StatCache* cache)
+    : repo(repository), objects(*objectStore), statCache(*cache) {
+    stashDir = repo->getSharedRoot() / "stash";
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// ENTRIES
+// Stash folders are numbered in the order they were pushed, newest first in the returned list
+//----------------------------------------------------------------------------------------------------------------------------
+
+vector<int> Stash::entries() const {
+    vector<int> ids;
+
+    if (!filesystem::exists(stashDir)) {
+        return ids;
+    }
+
+    for (auto& entry : filesystem::directory_iterator(stashDir)) {
+        string name = entry.path().filename().string();
+        if (entry.is_directory() && !name.empty() && all_of(name.begin(), name.end(), ::isdigit)) {
+            ids.push_back(stoi(name));
+        }
+    }
+
+    sort(ids.rbegin(), ids.rend());
+    return ids;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// PUSH
+/*
+    -scan the working tree (through the stat cache) and the staging area
+    -put every file's content in the object store:
+        -already stored => nothing to do
+        -same content exists in the base commit => hardlink it from Data (no bytes copied)
+        -otherwise => copy it
+    -write the manifests into a temporary folder and rename it, so a crash never leaves a half written stash
+    -reset the working tree to the base commit, only touching files that differ from it, and empty the staging area
+*/
+//----------------------------------------------------------------------------------------------------------------------------
+
+bool Stash::push(const string& message) {
+    string base = repo->getHead();
+    if (base == "NA") {
+        repo->err() << RED << "fatal: cannot stash before the first commit" << END << endl;
+        return false;
+    }
+
+    filesystem::path workDir = repo->getRoot();
+    filesystem::path baseRoot = Layout::commitDir(repo->getCommitsDir(), base) / "Data";
+
+    Manifest workTree = Manifest::scanWorkingTree(workDir, statCache);
+    Manifest staged = Manifest::build(repo->getStagingArea());
+    Manifest baseTree = SparseCheckout::load(workDir).visible(Manifest::forCommit(repo->getCommitsDir(), base));
+
+    if (workTree.changedPaths(baseTree).empty() && staged.size() == 0) {
+        repo->out() << YEL << "No local changes to save" << END << endl;
+        return false;
+    }
+
+    unordered_map<string, string> baseByHash;
+    for (auto& entry : baseTree.getEntries()) {
+        baseByHash.emplace(entry.second.hash, entry.first);
+    }
+
+    uintmax_t bytesStored = 0;
+
+    auto storeTree = [&](const Manifest& tree, const filesystem::path& root) {
+        for (auto& entry : tree.getEntries()) {
+            const string& hash = entry.second.hash;
+            if (objects.has(hash)) {
+                continue;
+            }
+
+            auto committed = baseByHash.find(hash);
+            if (committed != baseByHash.end()) {
+                bytesStored += objects.adopt(baseRoot / committed->second, hash);
+            } else {
+                bytesStored += objects.store(root / entry.first, hash);
+            }
+        }
+    };
+
+    storeTree(workTree, workDir);
+    storeTree(staged, repo->getStagingArea());
+
+    vector<int> existing = entries();
+    int id = existing.empty() ? 0 : existing.front() + 1;
+
+    filesystem::path tmpEntry = stashDir / (to_string(id) + ".tmp");
+    filesystem::create_directories(tmpEntry);
+
+    workTree.save(tmpEntry / "worktree.txt");
+    staged.save(tmpEntry / "staging.txt");
+
+    time_t now = time(nullptr);
+    string date = ctime(&now);
+    date.pop_back();
+
+    ofstream info(tmpEntry / "info.txt");
+    info << "BASE:" << base << "\n" << "MESSAGE:" << message << "\n" << "DATE:" << date << "\n";
+    info.close();
+
+    filesystem::rename(tmpEntry, stashDir / to_string(id));
+
+    // back to the base commit, file by file
+    for (const string& path : workTree.changedPaths(baseTree)) {
+        const ManifestEntry* wanted = baseTree.find(path);
+        if (wanted) {
+            filesystem::create_directories((workDir / path).parent_path());
+            filesystem::copy_file(baseRoot / path, workDir / path, filesystem::copy_options::overwrite_existing);
+        } else {
+            removeFile(workDir, path);
+        }
+    }
+
+    for (auto& entry : filesystem::directory_iterator(repo->getStagingArea())) {
+        filesystem::remove_all(entry);
+    }
+
+    repo->out() << GRN << "Saved working directory and staging area as stash@{0} ("
+         << bytesStored << " new bytes stored)" << END << endl;
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// POP
+/*
+Applies the newest stash on top of whatever is in the working tree now.
+Only paths the stash changed (compared to its base commit) are looked at:
+    -if the file is still as it was in the base commit, or already matches the stash => safe
+    -otherwise it was edited again after stashing => conflict
+If anything conflicts nothing is written and the stash is kept.
+The staging area is restored as it was, then the stash folder is removed.
+*/
+//----------------------------------------------------------------------------------------------------------------------------
+
+bool Stash::pop() {
+    vector<int> ids = entries();
+    if (ids.empty()) {
+        repo->out() << YEL << "No stash entries found." << END << endl;
+        return false;
+    }
+
+    filesystem::path entryDir = stashDir / to_string(ids.front());
+    filesystem::path workDir = repo->getRoot();
+
+    Manifest stashedTree, stashedStaging;
+    if (!stashedTree.load(entryDir / "worktree.txt") || !stashedStaging.load(entryDir / "staging.txt")) {
+        repo->err() << RED << "fatal: stash entry " << ids.front() << " is damaged" << END << endl;
+        return false;
+    }
+
+    Manifest baseTree = SparseCheckout::load(workDir).visible(Manifest::forCommit(repo->getCommitsDir(), readInfo(entryDir / "info.txt", "BASE")));
+
+    Manifest current = Manifest::scanWorkingTree(workDir, statCache);
+
+    vector<string> changed = stashedTree.changedPaths(baseTree);
+    vector<string> conflicts;
+
+    for (const string& path : changed) {
+        const ManifestEntry* now = current.find(path);
+        if (!sameEntry(now, baseTree.find(path)) && !sameEntry(now, stashedTree.find(path))) {
+            conflicts.push_back(path);
+        }
+    }
+
+    if (!conflicts.empty()) {
+        repo->err() << RED << "error: your local changes to the following files would be overwritten:" << END << endl;
+        for (const string& path : conflicts) {
+            repo->err() << "    " << path << endl;
+        }
+        repo->err() << YEL << "The stash entry is kept." << END << endl;
+        return false;
+    }
+
+    int written = 0;
+    for (const string& path : changed) {
+        const ManifestEntry* wanted = stashedTree.find(path);
+        const ManifestEntry* now = current.find(path);
+
+        if (sameEntry(now, wanted)) {
+            continue;
+        }
+
+        if (wanted) {
+            objects.copyOut(wanted->hash, workDir / path);
+            written++;
+        } else {
+            removeFile(workDir, path);
+        }
+    }
+
+    Manifest currentStaging = Manifest::build(repo->getStagingArea());
+    for (const string& path : stashedStaging.changedPaths(currentStaging)) {
+        const ManifestEntry* wanted = stashedStaging.find(path);
+        if (wanted) {
+            objects.copyOut(wanted->hash, repo->getStagingArea() / path);
+        } else {
+            removeFile(repo->getStagingArea(), path);
+        }
+    }
+
+    filesystem::remove_all(entryDir);
+
+    repo->out() << GRN << "Restored stash (" << written << " file(s) written, "
+         << stashedStaging.size() << " staged)" << END << endl;
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// LIST
+// stash@{0} is the newest, same as git
+//----------------------------------------------------------------------------------------------------------------------------
+
+void Stash::list() const {
+    vector<int> ids = entries();
+
+    for (size_t i = 0; i < ids.size(); i++) {
+        filesystem::path info = stashDir / to_string(ids[i]) / "info.txt";
+        repo->out() << "stash@{" << i << "}: On " << readInfo(info, "BASE").substr(0, 8) << ": "
+             << readInfo(info, "MESSAGE") << " (" << readInfo(info, "DATE") << ")\n";
+    }
+}
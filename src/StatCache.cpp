@@ -0,0 +1,115 @@
+#include "StatCache.h"
+#include "HashingHelper.h"
+#include "FileUtils.h"
+#include "Stats.h"
+#include <fstream>
+#include <chrono>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// CONSTRUCTOR / DESTRUCTOR
+//----------------------------------------------------------------------------------------------------------------------------
+
+StatCache::StatCache(const filesystem::path& file) : cacheFile(file), dirty(false), loaded(false) {
+}
+
+StatCache::~StatCache() {
+    save();
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// LOAD
+// Reads the cache if there is one. A missing or unreadable cache just means everything gets hashed once
+//----------------------------------------------------------------------------------------------------------------------------
+
+void StatCache::load() {
+    loaded = true;
+
+    ifstream in(cacheFile);
+    string line;
+
+    while (getline(in, line)) {
+        size_t a = line.find(' ');
+        size_t b = (a == string::npos) ? a : line.find(' ', a + 1);
+        size_t c = (b == string::npos) ? b : line.find(' ', b + 1);
+
+        if (c == string::npos) {
+            continue;
+        }
+
+        StatEntry entry;
+        entry.size = stoull(line.substr(0, a));
+        entry.mtime = stoll(line.substr(a + 1, b - a - 1));
+        entry.hash = line.substr(b + 1, c - b - 1);
+        entries[line.substr(c + 1)] = entry;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// HASH FOR
+// Returns the content hash of a working tree file, reading it only if its size or mtime moved since last time
+//----------------------------------------------------------------------------------------------------------------------------
+
+string StatCache::hashFor(const filesystem::path& fullPath, const string& key) {
+    Stats::add(STAT_FILES_STATED);
+    return hashFor(fullPath, key, filesystem::file_size(fullPath), filesystem::last_write_time(fullPath));
+}
+
+// same, with size and mtime already known (status stats the whole tree in one bulk call first)
+string StatCache::hashFor(const filesystem::path& fullPath, const string& key,
+                          uintmax_t size, filesystem::file_time_type writeTime) {
+    if (!loaded) {
+        load();
+    }
+
+    int64_t mtime = writeTime.time_since_epoch().count();
+
+    auto it = entries.find(key);
+    if (it != entries.end() && it->second.size == size && it->second.mtime == mtime) {
+        Stats::add(STAT_CACHE_HITS);
+        return it->second.hash;
+    }
+    Stats::add(STAT_CACHE_MISSES);
+
+    string hash = hashFileContents(fullPath);
+
+    // racy files: modified so recently that a second edit could keep the same mtime
+    if (filesystem::file_time_type::clock::now() - writeTime > chrono::seconds(2)) {
+        entries[key] = {size, mtime, hash};
+        dirty = true;
+    } else if (it != entries.end()) {
+        entries.erase(it);
+        dirty = true;
+    }
+
+    return hash;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// SAVE
+// Written atomically so a crash (or another minigit reading it) never sees half a cache
+//----------------------------------------------------------------------------------------------------------------------------
+
+void StatCache::save() {
+    if (!dirty || !filesystem::exists(cacheFile.parent_path())) {
+        return;
+    }
+    if (writesSuppressed()) {
+        dirty = false;      // kept in memory only, a later save writes them along with its own changes
+        return;
+    }
+
+    string contents;
+    for (auto& entry : entries) {
+        contents += to_string(entry.second.size) + " " + to_string(entry.second.mtime) + " "
+                  + entry.second.hash + " " + entry.first + "\n";
+    }
+
+    try {
+        writeFileAtomically(cacheFile, contents);
+    } catch (const exception&) {
+        // the cache is only an optimization, next run just hashes again
+    }
+    dirty = false;
+}
@@ -0,0 +1,83 @@
+#include "Stats.h"
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <iomanip>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// REGISTRY
+// Live blocks are listed so total() can read them, a block's counts move into `retired` when its thread exits.
+// Never destroyed, thread_local blocks of detached or late threads may still unregister during exit
+//----------------------------------------------------------------------------------------------------------------------------
+
+struct StatRegistry {
+    mutex lock;
+    vector<StatBlock*> live;
+    uint64_t retired[STAT_COUNTER_COUNT] = {};
+};
+
+static StatRegistry& registry() {
+    static StatRegistry* r = new StatRegistry();
+    return *r;
+}
+
+StatBlock::StatBlock() {
+    for (atomic<uint64_t>& count : counts) {
+        count.store(0, memory_order_relaxed);
+    }
+    StatRegistry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    r.live.push_back(this);
+}
+
+StatBlock::~StatBlock() {
+    StatRegistry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    for (int i = 0; i < STAT_COUNTER_COUNT; i++) {
+        r.retired[i] += counts[i].load(memory_order_relaxed);
+    }
+    r.live.erase(find(r.live.begin(), r.live.end(), this));
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// READING
+//----------------------------------------------------------------------------------------------------------------------------
+
+const char* Stats::name(StatCounter counter) {
+    static const char* names[STAT_COUNTER_COUNT] = {
+        "files_stated", "files_opened", "files_copied", "bytes_read", "bytes_written", "bytes_copied",
+        "dirs_created", "hash_lookups", "hash_probes", "hash_resizes", "cache_hits", "cache_misses",
+        "arena_chunks", "arena_bytes", "heap_allocations"
+    };
+    return names[counter];
+}
+
+uint64_t Stats::total(StatCounter counter) {
+    StatRegistry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+
+    uint64_t sum = r.retired[counter];
+    for (StatBlock* block : r.live) {
+        sum += block->counts[counter].load(memory_order_relaxed);
+    }
+    return sum;
+}
+
+void Stats::print(ostream& out, bool json) {
+    if (json) {
+        out << "{";
+        for (int i = 0; i < STAT_COUNTER_COUNT; i++) {
+            out << (i ? ", " : "") << "\"" << name((StatCounter)i) << "\": " << total((StatCounter)i);
+        }
+        out << "}" << endl;
+        return;
+    }
+
+    out << "----------------------------------------" << endl;
+    for (int i = 0; i < STAT_COUNTER_COUNT; i++) {
+        out << left << setw(20) << name((StatCounter)i) << right << setw(20) << total((StatCounter)i) << endl;
+    }
+    out << "----------------------------------------" << endl;
+}
@@ -0,0 +1,181 @@
+#include "Trace.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <unistd.h>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// BUFFERS
+// Every thread appends to its own buffer, the lock is only ever contended while flush() copies it out.
+// Buffers outlive their threads (the pipeline stages are gone long before exit), so the registry owns them
+//----------------------------------------------------------------------------------------------------------------------------
+
+struct TraceEvent {
+    const char* name;
+    string detail;
+    uint64_t start;
+    uint64_t end;
+};
+
+struct ThreadBuffer {
+    int tid;
+    string threadName;
+    mutex lock;
+    vector<TraceEvent> events;
+};
+
+struct TraceRegistry {
+    mutex lock;
+    vector<shared_ptr<ThreadBuffer>> buffers;
+};
+
+// resolved before main so a relative MINIGIT_TRACE is relative to where minigit was started,
+// even if the trace is written while the library has changed into a repository
+static string resolveTracePath() {
+    const char* value = getenv("MINIGIT_TRACE");
+    if (value == nullptr || *value == '\0') {
+        return "";
+    }
+
+    string path = value;
+    size_t pid = path.find("%p");
+    if (pid != string::npos) {
+        path.replace(pid, 2, to_string(getpid()));
+    }
+
+    error_code ec;
+    filesystem::path absolute = filesystem::absolute(path, ec);
+    return ec ? path : absolute.string();
+}
+
+static const string tracePath = resolveTracePath();
+
+static void flushAtExit() {
+    Trace::flush();
+}
+
+// never destroyed: spans can still close while other static objects are torn down
+static TraceRegistry& registry() {
+    static TraceRegistry* r = []() {
+        TraceRegistry* created = new TraceRegistry();
+        atexit(flushAtExit);
+        return created;
+    }();
+    return *r;
+}
+
+static ThreadBuffer& threadBuffer() {
+    thread_local shared_ptr<ThreadBuffer> buffer;
+
+    if (!buffer) {
+        TraceRegistry& r = registry();
+        lock_guard<mutex> guard(r.lock);
+
+        buffer = make_shared<ThreadBuffer>();
+        buffer->tid = r.buffers.size() + 1;
+        buffer->threadName = buffer->tid == 1 ? "main" : "thread " + to_string(buffer->tid);
+        r.buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+uint64_t Trace::now() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(const char* name, const string& detail, uint64_t start, uint64_t end) {
+    ThreadBuffer& buffer = threadBuffer();
+    lock_guard<mutex> guard(buffer.lock);
+    buffer.events.push_back({name, detail, start, end});
+}
+
+void Trace::setThreadName(const char* name) {
+    if (!enabled()) {
+        return;
+    }
+    ThreadBuffer& buffer = threadBuffer();
+    lock_guard<mutex> guard(buffer.lock);
+    buffer.threadName = name;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// OUTPUT
+// Chrome trace-event format: one complete ("X") event per span with microsecond timestamps,
+// plus a thread_name metadata ("M") event per thread so the timelines are labelled
+//----------------------------------------------------------------------------------------------------------------------------
+
+static string escapeJson(const string& text) {
+    string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char)c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+void Trace::flush() {
+    if (!enabled() || tracePath.empty()) {
+        return;
+    }
+
+    TraceRegistry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    int pid = getpid();
+
+    // timestamps start at the first span, the viewer doesn't care about the steady clock's epoch
+    uint64_t origin = UINT64_MAX;
+    for (const shared_ptr<ThreadBuffer>& buffer : r.buffers) {
+        lock_guard<mutex> bufferGuard(buffer->lock);
+        for (const TraceEvent& event : buffer->events) {
+            origin = min(origin, event.start);
+        }
+    }
+
+    ostringstream out;
+    out << fixed << setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool first = true;
+    for (const shared_ptr<ThreadBuffer>& buffer : r.buffers) {
+        lock_guard<mutex> bufferGuard(buffer->lock);
+
+        out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+            << ",\"tid\":" << buffer->tid << ",\"args\":{\"name\":\"" << escapeJson(buffer->threadName) << "\"}}";
+        first = false;
+
+        for (const TraceEvent& event : buffer->events) {
+            out << ",\n{\"name\":\"" << escapeJson(event.name) << "\",\"cat\":\"minigit\",\"ph\":\"X\",\"ts\":"
+                << (event.start - origin) / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0
+                << ",\"pid\":" << pid << ",\"tid\":" << buffer->tid;
+            if (!event.detail.empty()) {
+                out << ",\"args\":{\"detail\":\"" << escapeJson(event.detail) << "\"}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+
+    ofstream file(tracePath, ios::trunc);
+    file << out.str();
+    if (!file) {
+        cerr << "Could not write trace to " << tracePath << endl;
+    }
+}
@@ -0,0 +1,204 @@
+#include "Transfer.h"
+#include "Manifest.h"
+#include "BulkIO.h"
+#include "FileUtils.h"
+#include "Trace.h"
+#include "Layout.h"
+#include "CommitRecord.h"
+#include "Worktree.h"
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// TIPS
+//----------------------------------------------------------------------------------------------------------------------------
+
+string Transfer::findTip(const filesystem::path& commitsDir) {
+    string tip = readMetadataFile(commitsDir / "TIP.txt");
+    return tip.empty() ? "NA" : tip;
+}
+
+string Transfer::parentOf(const filesystem::path& commitsDir, const string& id) {
+    CommitRecord record;
+    if (!record.read(Layout::commitDir(commitsDir, id))) {
+        throw runtime_error("commit " + id + " can't be read (see minigit fsck)");
+    }
+    // a record in the wrong folder could send the walk round in circles
+    if (record.id() != id) {
+        throw runtime_error("commit " + id + "'s record names " + string(record.id()) + " (see minigit fsck)");
+    }
+    return string(record.parent());
+}
+
+// walks back from `from` through the parents, stops after `stop` or at the first commit
+static vector<string> walkBack(const filesystem::path& commitsDir, const string& from, const string& stop) {
+    vector<string> ids;
+    for (string id = from; id != "NA" && !id.empty() && id != stop; id = Transfer::parentOf(commitsDir, id)) {
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+bool Transfer::inHistory(const filesystem::path& commitsDir, const string& tip, const string& id) {
+    for (string c = tip; c != "NA" && !c.empty(); c = parentOf(commitsDir, c)) {
+        if (c == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// ONE COMMIT
+//----------------------------------------------------------------------------------------------------------------------------
+
+static void transferCommit(const filesystem::path& fromCommits, const filesystem::path& toCommits, const string& id,
+                           const string& prev, bool& sameFilesystem, TransferResult& result) {
+    TRACE_SPAN_DETAIL("Transfer::commit", id);
+
+    filesystem::path source = Layout::commitDir(fromCommits, id);
+    filesystem::path incoming = toCommits / (".incoming-" + id);
+    filesystem::remove_all(incoming);
+    filesystem::create_directories(incoming / "Data");
+
+    // commit.bin, Manifest.txt, ChangedPaths.bloom ... are small, copied so the two repositories never share a file
+    // that could be rewritten in place. Only fast-forwards are sent, so the record's parent is already right here
+    for (auto& entry : filesystem::directory_iterator(source)) {
+        string name = entry.path().filename().string();
+        if (name == "Data" || !entry.is_regular_file()) {
+            continue;
+        }
+        filesystem::copy_file(entry.path(), incoming / name, filesystem::copy_options::overwrite_existing);
+    }
+
+    // unchanged files can come from the receiver's copy of the previous commit
+    Manifest current, previous;
+    bool compare = prev != "NA" && current.load(source / "Manifest.txt") &&
+                   previous.load(Layout::commitDir(toCommits, prev) / "Manifest.txt");
+
+    vector<CopyJob> jobs;
+    filesystem::path data = source / "Data";
+
+    for (auto& entry : filesystem::recursive_directory_iterator(data)) {
+        filesystem::path relative = filesystem::relative(entry.path(), data);
+        filesystem::path dest = incoming / "Data" / relative;
+
+        if (entry.is_directory()) {
+            filesystem::create_directories(dest);
+            continue;
+        }
+
+        error_code ec;
+        if (sameFilesystem) {
+            filesystem::create_hard_link(entry.path(), dest, ec);
+            if (!ec) {
+                result.linked++;
+                continue;
+            }
+            sameFilesystem = false;     // cross device (or links not allowed), don't try again
+        }
+
+        if (compare) {
+            string key = relative.generic_string();
+            const ManifestEntry* mine = current.find(key);
+            const ManifestEntry* theirs = previous.find(key);
+
+            if (mine && theirs && mine->hash == theirs->hash && mine->size == theirs->size) {
+                filesystem::create_hard_link(Layout::commitDir(toCommits, prev) / "Data" / relative, dest, ec);
+                if (!ec) {
+                    result.linked++;
+                    continue;
+                }
+            }
+        }
+
+        jobs.push_back({entry.path(), dest});
+        result.bytesCopied += entry.file_size();
+    }
+
+    vector<string> errors = BulkIO::get().copyFiles(jobs);
+    for (size_t i = 0; i < errors.size(); i++) {
+        if (!errors[i].empty()) {
+            throw runtime_error("could not copy '" + jobs[i].source.string() + "': " + errors[i]);
+        }
+    }
+    result.copied += jobs.size();
+
+    // a leftover folder of this name can only be from a transfer that crashed before publishing, nothing points at it
+    filesystem::path dest = Layout::commitDir(toCommits, id);
+    filesystem::remove_all(dest);
+    filesystem::create_directories(dest.parent_path());
+    filesystem::rename(incoming, dest);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// PUBLISH
+// An empty receiver gets TAIL.txt (and its first checked out commit) before TIP.txt, the list loads from TIP.txt
+//----------------------------------------------------------------------------------------------------------------------------
+
+void Transfer::publish(const filesystem::path& commitsDir, const string& oldTip, const vector<string>& ids) {
+    if (oldTip == "NA") {
+        writeFileAtomically(commitsDir / "TAIL.txt", ids.front());
+        writeFileAtomically(commitsDir / "HEAD.txt", ids.back());
+    }
+    writeFileAtomically(commitsDir / "TIP.txt", ids.back());
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// SEND
+//----------------------------------------------------------------------------------------------------------------------------
+
+TransferResult Transfer::send(const filesystem::path& fromRoot, const filesystem::path& toRoot) {
+    TRACE_SPAN("Transfer::send");
+
+    // batch mode may still hold this process's pointer file writes, the walk below reads them from disk
+    flushMetadataWrites();
+
+    filesystem::path fromCommits = Worktree::mainVcsRoot(fromRoot / ".Minivcs") / "commits";
+    filesystem::path toCommits = Worktree::mainVcsRoot(toRoot / ".Minivcs") / "commits";
+    for (const filesystem::path& commits : {fromCommits, toCommits}) {
+        if (CommitRecord::isLegacy(commits)) {
+            throw runtime_error(commits.parent_path().parent_path().string() + " uses an older format, run minigit "
+                                "migrate-layout there first");
+        }
+    }
+
+    TransferResult result;
+    result.oldTip = result.newTip = findTip(toCommits);
+    string senderTip = findTip(fromCommits);
+
+    if (senderTip == "NA" || senderTip == result.oldTip) {
+        return result;
+    }
+
+    // ----------------------------------------- NEGOTIATE -----------------------------------------
+    vector<string> missing = walkBack(fromCommits, senderTip, result.oldTip);
+    bool reachedTip = result.oldTip == "NA" ||
+                      parentOf(fromCommits, missing.back()) == result.oldTip;
+
+    if (!reachedTip) {
+        if (inHistory(toCommits, result.oldTip, senderTip)) {
+            return result;      // the receiver already has everything and more
+        }
+        throw runtime_error("histories have diverged: " + result.oldTip + " is not in " + fromRoot.string() +
+                            " (only fast-forwards can be transferred)");
+    }
+    reverse(missing.begin(), missing.end());
+
+    // ----------------------------------------- TRANSFER -----------------------------------------
+    bool sameFilesystem = true;
+    for (size_t i = 0; i < missing.size(); i++) {
+        string prev = i == 0 ? result.oldTip : missing[i - 1];
+        transferCommit(fromCommits, toCommits, missing[i], prev, sameFilesystem, result);
+    }
+
+    // ----------------------------------------- PUBLISH -----------------------------------------
+    publish(toCommits, result.oldTip, missing);
+
+    result.newTip = missing.back();
+    result.commits = missing.size();
+    return result;
+}
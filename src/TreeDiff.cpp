@@ -0,0 +1,144 @@
+#include "TreeDiff.h"
+#include "RenameDetector.h"
+#include "Diff.h"
+#include "Repository.h"
+#include <iostream>
+#include <fstream>
+#include <unordered_set>
+#include <algorithm>
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------------------------------------------
+// COMPARE
+// Merge-walks the two sorted manifests into added / deleted / modified lists,
+// lets the RenameDetector pair up what it can, and reports the rest as plain A / D / M
+//----------------------------------------------------------------------------------------------------------------------------
+
+vector<FileChange> TreeDiff::compare(const Manifest& oldTree, const filesystem::path& oldRoot,
+                                     const Manifest& newTree, const filesystem::path& newRoot) {
+    vector<string> added, deleted, modified;
+
+    auto a = oldTree.getEntries().begin();
+    auto b = newTree.getEntries().begin();
+    auto aEnd = oldTree.getEntries().end();
+    auto bEnd = newTree.getEntries().end();
+
+    while (a != aEnd || b != bEnd) {
+        if (b == bEnd || (a != aEnd && a->first < b->first)) {
+            deleted.push_back(a->first);
+            ++a;
+        } else if (a == aEnd || b->first < a->first) {
+            added.push_back(b->first);
+            ++b;
+        } else {
+            if (a->second.hash != b->second.hash) {
+                modified.push_back(a->first);
+            }
+            ++a;
+            ++b;
+        }
+    }
+
+    vector<FileChange> changes;
+    unordered_set<string> pairedOld, pairedNew;
+
+    RenameDetector detector;
+    for (const RenamePair& p : detector.detect(oldTree, oldRoot, newTree, newRoot, deleted, added, modified)) {
+        changes.push_back({p.copy ? 'C' : 'R', p.oldPath, p.newPath, p.similarity});
+        if (!p.copy) {
+            pairedOld.insert(p.oldPath);
+        }
+        pairedNew.insert(p.newPath);
+    }
+
+    for (const string& m : modified) {
+        changes.push_back({'M', m, m, 0});
+    }
+    for (const string& d : deleted) {
+        if (!pairedOld.count(d)) {
+            changes.push_back({'D', d, "", 0});
+        }
+    }
+    for (const string& n : added) {
+        if (!pairedNew.count(n)) {
+            changes.push_back({'A', "", n, 0});
+        }
+    }
+
+    sort(changes.begin(), changes.end(), [](const FileChange& x, const FileChange& y) {
+        const string& xKey = x.newPath.empty() ? x.oldPath : x.newPath;
+        const string& yKey = y.newPath.empty() ? y.oldPath : y.newPath;
+        return xKey < yKey;
+    });
+
+    return changes;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// PRINT NAME STATUS
+// One line per change: "M  path", "R87 old -> new"
+//----------------------------------------------------------------------------------------------------------------------------
+
+void TreeDiff::printNameStatus(const vector<FileChange>& changes, ostream& out) {
+    for (const FileChange& c : changes) {
+        switch (c.status) {
+            case 'A':
+                out << GRN << "  A     " << c.newPath << END << "\n";
+                break;
+            case 'D':
+                out << RED << "  D     " << c.oldPath << END << "\n";
+                break;
+            case 'M':
+                out << YEL << "  M     " << c.newPath << END << "\n";
+                break;
+            default:
+                out << CYN << "  " << c.status << (c.similarity < 100 ? " " : "") << c.similarity << "  "
+                     << c.oldPath << " -> " << c.newPath << END << "\n";
+                break;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// PRINT PATCH
+// Name status header for every change, followed by a unified diff whenever content differs.
+// Files with a NUL byte in the first 8000 bytes are treated as binary and not printed line by line
+//----------------------------------------------------------------------------------------------------------------------------
+
+static bool isBinary(const filesystem::path& file) {
+    ifstream in(file, ios::binary);
+    char buffer[8000];
+    in.read(buffer, sizeof(buffer));
+    return find(buffer, buffer + in.gcount(), '\0') != buffer + in.gcount();
+}
+
+void TreeDiff::printPatch(const vector<FileChange>& changes,
+                          const filesystem::path& oldRoot, const filesystem::path& newRoot, ostream& out) {
+    for (const FileChange& c : changes) {
+        out << "diff -- " << (c.oldPath.empty() ? "/dev/null" : "a/" + c.oldPath)
+             << " " << (c.newPath.empty() ? "/dev/null" : "b/" + c.newPath) << "\n";
+
+        if (c.status == 'R' || c.status == 'C') {
+            out << (c.status == 'R' ? "rename" : "copy") << " from " << c.oldPath << "\n"
+                 << (c.status == 'R' ? "rename" : "copy") << " to " << c.newPath << "\n"
+                 << "similarity " << c.similarity << "%\n";
+            if (c.similarity == 100) {
+                continue;
+            }
+        }
+
+        filesystem::path oldFile = c.oldPath.empty() ? filesystem::path() : oldRoot / c.oldPath;
+        filesystem::path newFile = c.newPath.empty() ? filesystem::path() : newRoot / c.newPath;
+
+        if ((!oldFile.empty() && isBinary(oldFile)) || (!newFile.empty() && isBinary(newFile))) {
+            out << "Binary files differ\n";
+            continue;
+        }
+
+        vector<string> oldLines = oldFile.empty() ? vector<string>() : Diff::readLines(oldFile);
+        vector<string> newLines = newFile.empty() ? vector<string>() : Diff::readLines(newFile);
+
+        Diff::printUnified(oldLines, newLines, Diff::compute(oldLines, newLines), out);
+    }
+}
@@ -0,0 +1,558 @@
+#include "BulkIO.h"
+#include "Trace.h"
+#include "Stats.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
+using namespace std;
+
+/*
+io_uring without liburing: the three syscalls, the two shared rings and the SQE array are set up by hand.
+
+Submission: fill the next SQE, put its index in the SQ array, then publish the new SQ tail (release store,
+so the kernel sees a complete SQE). Completion: read CQEs between our CQ head and the kernel's tail
+(acquire load), then publish the new head so the kernel can reuse the slots.
+
+No more SQEs are handed out than the CQ ring has room for (pending + queued). An overflowing CQ either drops
+completions or makes the kernel hold them back, and either way the loops below would wait for one that never comes.
+*/
+
+static int ringSetup(unsigned entries, io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ringEnter(int fd, unsigned submit, unsigned waitFor, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, waitFor, flags, nullptr, 0);
+}
+
+static int ringRegister(int fd, unsigned opcode, void* arg, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+class Ring {
+private:
+    int fd;
+    unsigned entries;
+    unsigned cqEntries;
+
+    void* sqMap;
+    size_t sqMapSize;
+    void* cqMap;
+    size_t cqMapSize;
+    io_uring_sqe* sqes;
+    size_t sqesSize;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+
+    unsigned queued;    // SQEs filled since the last submit
+    unsigned pending;   // submitted, completion not popped yet
+
+public:
+    Ring() : fd(-1), entries(0), cqEntries(0), sqMap(MAP_FAILED), sqMapSize(0), cqMap(MAP_FAILED), cqMapSize(0),
+             sqes((io_uring_sqe*)MAP_FAILED), sqesSize(0), queued(0), pending(0) {}
+
+    ~Ring() {
+        close();
+    }
+
+    // closing the fd makes the kernel cancel whatever is still running in it
+    void close() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqMap != MAP_FAILED && cqMap != sqMap) munmap(cqMap, cqMapSize);
+        if (sqMap != MAP_FAILED) munmap(sqMap, sqMapSize);
+        if (fd >= 0) ::close(fd);
+
+        fd = -1;
+        sqes = (io_uring_sqe*)MAP_FAILED;
+        sqMap = cqMap = MAP_FAILED;
+        queued = pending = 0;
+    }
+
+    bool open(unsigned size) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        fd = ringSetup(size, &params);
+        if (fd < 0) {
+            return false;       // ENOSYS on old kernels, EPERM when disabled by sysctl or a seccomp filter
+        }
+        entries = params.sq_entries;
+        cqEntries = params.cq_entries;
+
+        sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sqMapSize = cqMapSize = max(sqMapSize, cqMapSize);
+        }
+
+        sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqMap == MAP_FAILED) {
+            return false;
+        }
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            cqMap = sqMap;
+        } else {
+            cqMap = mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqMap == MAP_FAILED) {
+                return false;
+            }
+        }
+
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = (io_uring_sqe*)mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+
+        char* sq = (char*)sqMap;
+        sqHead = (unsigned*)(sq + params.sq_off.head);
+        sqTail = (unsigned*)(sq + params.sq_off.tail);
+        sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+        sqArray = (unsigned*)(sq + params.sq_off.array);
+
+        char* cq = (char*)cqMap;
+        cqHead = (unsigned*)(cq + params.cq_off.head);
+        cqTail = (unsigned*)(cq + params.cq_off.tail);
+        cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+        return true;
+    }
+
+    // every opcode we queue has to be known to the running kernel, or it completes with -EINVAL
+    bool supports(const vector<int>& opcodes) {
+        size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        unique_ptr<char[]> buffer(new char[size]);
+        memset(buffer.get(), 0, size);
+        io_uring_probe* probe = (io_uring_probe*)buffer.get();
+
+        if (ringRegister(fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+            return false;
+        }
+        for (int op : opcodes) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    unsigned size() const {
+        return entries;
+    }
+
+    io_uring_sqe* next() {
+        unsigned tail = *sqTail + queued;
+        if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= entries || pending + queued >= cqEntries) {
+            return nullptr;
+        }
+        unsigned index = tail & *sqMask;
+        sqArray[index] = index;
+        queued++;
+
+        io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    // submits everything queued and waits until at least `waitFor` completions are ready
+    bool submit(unsigned waitFor) {
+        __atomic_store_n(sqTail, *sqTail + queued, __ATOMIC_RELEASE);
+        unsigned toSubmit = queued;
+        queued = 0;
+
+        while (toSubmit > 0 || waitFor > 0) {
+            int done = ringEnter(fd, toSubmit, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0);
+            if (done < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            pending += min((unsigned)done, toSubmit);
+            toSubmit -= min((unsigned)done, toSubmit);
+            if (toSubmit == 0) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    // waits for at least one completion without submitting anything
+    bool wait() {
+        while (ringEnter(fd, 0, 1, IORING_ENTER_GETEVENTS) < 0) {
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    unsigned inFlight() const {
+        return pending;
+    }
+
+    bool pop(io_uring_cqe& out) {
+        unsigned head = *cqHead;
+        if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        out = cqes[head & *cqMask];
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        pending -= min(pending, 1u);
+        return true;
+    }
+};
+
+//----------------------------------------------------------------------------------------------------------------------------
+// COPY STATE MACHINE
+// Each slot copies one file with one operation in flight at a time:
+//     STATX (mode) -> OPEN source -> OPEN dest -> READ -> WRITE -> READ ... -> CLOSE source -> CLOSE dest
+// Up to SLOTS files are in different steps at once and every loop iteration submits all their next steps together
+//----------------------------------------------------------------------------------------------------------------------------
+
+enum CopyStep { IDLE, STAT_SOURCE, OPEN_SOURCE, OPEN_DEST, READ_CHUNK, WRITE_CHUNK, CLOSE_SOURCE, CLOSE_DEST };
+
+struct CopySlot {
+    CopyStep step;
+    size_t job;
+    int sourceFd;
+    int destFd;
+    uint64_t offset;        // next read offset in the source
+    size_t filled;          // bytes in the buffer
+    size_t written;         // of those, already written
+    struct statx info;
+    unique_ptr<char[]> buffer;
+};
+
+class UringIO : public BulkIO {
+private:
+    static const unsigned SLOTS = 64;
+    static const size_t CHUNK = 256 * 1024;
+
+    Ring ring;
+    bool broken = false;        // the ring failed once, everything after goes to the thread pool
+
+    void queueStep(CopySlot& slot, unsigned index, const vector<CopyJob>& jobs);
+
+    // when the ring breaks mid-batch: collects every completion still owed (handle sees each one) and closes the
+    // ring. Until then the kernel may still write into our buffers or close fds, so nothing they refer to can be
+    // freed or closed before this returns. False if the kernel wouldn't even report them, the ring is closed anyway
+    template <typename Handle>
+    bool shutDown(Handle handle) {
+        bool drained = true;
+        io_uring_cqe cqe;
+        while (ring.inFlight() > 0) {
+            while (ring.pop(cqe)) {
+                handle(cqe);
+            }
+            if (ring.inFlight() > 0 && !ring.wait()) {
+                drained = false;
+                break;
+            }
+        }
+        ring.close();
+        broken = true;
+        return drained;
+    }
+
+public:
+    bool start() {
+        return ring.open(SLOTS * 2) && ring.supports({IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ,
+                                                     IORING_OP_WRITE, IORING_OP_CLOSE});
+    }
+
+    const char* name() const override {
+        return "io_uring";
+    }
+
+    vector<string> copyFiles(const vector<CopyJob>& jobs) override;
+    vector<FileStat> statFiles(const vector<filesystem::path>& paths) override;
+};
+
+void UringIO::queueStep(CopySlot& slot, unsigned index, const vector<CopyJob>& jobs) {
+    io_uring_sqe* sqe = ring.next();     // never null: at most one SQE per slot and the ring has twice as many
+    sqe->user_data = index;
+
+    const CopyJob& job = jobs[slot.job];
+
+    switch (slot.step) {
+        case STAT_SOURCE:
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)job.source.c_str();
+            sqe->len = STATX_MODE;
+            sqe->off = (uint64_t)&slot.info;
+            break;
+        case OPEN_SOURCE:
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)job.source.c_str();
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            break;
+        case OPEN_DEST:
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)job.dest.c_str();
+            sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+            sqe->len = slot.info.stx_mode & 07777;
+            break;
+        case READ_CHUNK:
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = slot.sourceFd;
+            sqe->addr = (uint64_t)slot.buffer.get();
+            sqe->len = CHUNK;
+            sqe->off = slot.offset;
+            break;
+        case WRITE_CHUNK:
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = slot.destFd;
+            sqe->addr = (uint64_t)(slot.buffer.get() + slot.written);
+            sqe->len = slot.filled - slot.written;
+            sqe->off = slot.offset - slot.filled + slot.written;
+            break;
+        case CLOSE_SOURCE:
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = slot.sourceFd;
+            break;
+        case CLOSE_DEST:
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = slot.destFd;
+            break;
+        case IDLE:
+            break;
+    }
+}
+
+vector<string> UringIO::copyFiles(const vector<CopyJob>& jobs) {
+    TRACE_SPAN_DETAIL("UringIO::copyFiles", to_string(jobs.size()) + " files");
+    if (broken) {
+        return ThreadPoolIO().copyFiles(jobs);
+    }
+    vector<string> errors(jobs.size());
+    vector<CopySlot> slots(SLOTS);
+    size_t nextJob = 0;
+    unsigned active = 0;
+
+    for (CopySlot& slot : slots) {
+        slot.step = IDLE;
+    }
+
+    // a failed slot closes whatever it opened right away (the rare path, no need to queue it)
+    auto fail = [&](CopySlot& slot, int error) {
+        errors[slot.job] = strerror(error);
+        if (slot.sourceFd >= 0) close(slot.sourceFd);
+        if (slot.destFd >= 0) close(slot.destFd);
+        slot.step = IDLE;
+        active--;
+    };
+
+    while (nextJob < jobs.size() || active > 0) {
+        for (unsigned i = 0; i < SLOTS && nextJob < jobs.size(); i++) {
+            CopySlot& slot = slots[i];
+            if (slot.step != IDLE) {
+                continue;
+            }
+            if (!slot.buffer) {
+                slot.buffer.reset(new char[CHUNK]);
+            }
+            slot.job = nextJob++;
+            slot.step = STAT_SOURCE;
+            slot.sourceFd = slot.destFd = -1;
+            slot.offset = slot.filled = slot.written = 0;
+            active++;
+            queueStep(slot, i, jobs);
+        }
+
+        if (!ring.submit(1)) {
+            // the ring itself broke: let what's in flight finish (an open that completes still hands us an fd, a
+            // close still takes one), then copy those files and everything not started the portable way
+            bool drained = shutDown([&](const io_uring_cqe& cqe) {
+                CopySlot& slot = slots[cqe.user_data];
+                if (cqe.res < 0) {
+                    return;
+                }
+                if (slot.step == OPEN_SOURCE) slot.sourceFd = cqe.res;
+                if (slot.step == OPEN_DEST) slot.destFd = cqe.res;
+                if (slot.step == CLOSE_SOURCE) slot.sourceFd = -1;
+                if (slot.step == CLOSE_DEST) slot.destFd = -1;
+            });
+
+            vector<CopyJob> rest;
+            vector<size_t> owners;
+            for (CopySlot& slot : slots) {
+                if (slot.step != IDLE) {
+                    if (drained && slot.sourceFd >= 0) close(slot.sourceFd);
+                    if (drained && slot.destFd >= 0) close(slot.destFd);
+                    rest.push_back(jobs[slot.job]);
+                    owners.push_back(slot.job);
+                }
+            }
+            if (!drained) {
+                // something may still land in the slots or close their fds, leaving both alone is the only safe thing
+                new vector<CopySlot>(move(slots));
+            }
+            for (size_t j = nextJob; j < jobs.size(); j++) {
+                rest.push_back(jobs[j]);
+                owners.push_back(j);
+            }
+
+            vector<string> restErrors = ThreadPoolIO().copyFiles(rest);
+            for (size_t j = 0; j < rest.size(); j++) {
+                errors[owners[j]] = restErrors[j];
+            }
+            return errors;
+        }
+
+        io_uring_cqe cqe;
+        while (ring.pop(cqe)) {
+            CopySlot& slot = slots[cqe.user_data];
+            int result = cqe.res;
+
+            if (result < 0) {
+                fail(slot, -result);
+                continue;
+            }
+
+            switch (slot.step) {
+                case STAT_SOURCE:
+                    slot.step = OPEN_SOURCE;
+                    break;
+                case OPEN_SOURCE:
+                    slot.sourceFd = result;
+                    slot.step = OPEN_DEST;
+                    break;
+                case OPEN_DEST:
+                    slot.destFd = result;
+                    slot.step = READ_CHUNK;
+                    break;
+                case READ_CHUNK:
+                    if (result == 0) {
+                        slot.step = CLOSE_SOURCE;
+                    } else {
+                        slot.offset += result;
+                        slot.filled = result;
+                        slot.written = 0;
+                        slot.step = WRITE_CHUNK;
+                    }
+                    break;
+                case WRITE_CHUNK:
+                    slot.written += result;
+                    if (slot.written == slot.filled) {
+                        slot.step = READ_CHUNK;
+                    } else if (result == 0) {
+                        fail(slot, EIO);
+                        continue;
+                    }
+                    break;
+                case CLOSE_SOURCE:
+                    slot.sourceFd = -1;
+                    slot.step = CLOSE_DEST;
+                    break;
+                case CLOSE_DEST:
+                    slot.destFd = -1;
+                    slot.step = IDLE;
+                    active--;
+                    Stats::add(STAT_FILES_COPIED);
+                    Stats::add(STAT_FILES_OPENED, 2);
+                    Stats::add(STAT_BYTES_COPIED, slot.offset);
+                    continue;
+                case IDLE:
+                    continue;
+            }
+            queueStep(slot, cqe.user_data, jobs);
+        }
+    }
+
+    return errors;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// STAT
+// One STATX per path, as many in flight as the ring holds
+//----------------------------------------------------------------------------------------------------------------------------
+
+vector<FileStat> UringIO::statFiles(const vector<filesystem::path>& paths) {
+    TRACE_SPAN_DETAIL("UringIO::statFiles", to_string(paths.size()) + " files");
+    if (broken) {
+        return ThreadPoolIO().statFiles(paths);
+    }
+    vector<FileStat> stats(paths.size());
+    vector<struct statx> results(paths.size());
+    Stats::add(STAT_FILES_STATED, paths.size());
+    size_t next = 0;
+    size_t inFlight = 0;
+
+    while (next < paths.size() || inFlight > 0) {
+        // next() stops handing out SQEs once the completions owed would fill the CQ ring
+        io_uring_sqe* sqe;
+        while (next < paths.size() && (sqe = ring.next())) {
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)paths[next].c_str();
+            sqe->len = STATX_SIZE | STATX_MTIME;
+            sqe->off = (uint64_t)&results[next];
+            sqe->user_data = next;
+            next++;
+            inFlight++;
+        }
+
+        if (!ring.submit(1)) {
+            // statx results still on their way would land in `results`
+            if (!shutDown([](const io_uring_cqe&) {})) {
+                new vector<struct statx>(move(results));
+            }
+            return ThreadPoolIO().statFiles(paths);
+        }
+
+        io_uring_cqe cqe;
+        while (ring.pop(cqe)) {
+            FileStat& stat = stats[cqe.user_data];
+            const struct statx& info = results[cqe.user_data];
+
+            stat.ok = cqe.res == 0;
+            stat.size = 0;
+            if (stat.ok) {
+                stat.size = info.stx_size;
+                stat.mtime = fileTimeFromUnix(info.stx_mtime.tv_sec, info.stx_mtime.tv_nsec);
+            }
+            inFlight--;
+        }
+    }
+
+    return stats;
+}
+
+BulkIO* createUringIO() {
+    unique_ptr<UringIO> io(new UringIO());
+    if (!io->start()) {
+        return nullptr;
+    }
+    return io.release();
+}
+
+#else
+
+// no io_uring on this platform, BulkIO::get() falls back to the thread pool
+BulkIO* createUringIO() {
+    return nullptr;
+}
+
+#endif
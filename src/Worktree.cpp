@@ -0,0 +1,155 @@
+#include "Worktree.h"
+#include "Repository.h"
+#include "FileUtils.h"
+#include "Trace.h"
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+static const char* SHARED_FOLDERS[] = {"commits", "objects", "stash", "cache"};
+
+//----------------------------------------------------------------------------------------------------------------------------
+// LOOKUP
+//----------------------------------------------------------------------------------------------------------------------------
+
+bool Worktree::isLinked(const filesystem::path& vcsRoot) {
+    return filesystem::exists(vcsRoot / "worktree.txt");
+}
+
+filesystem::path Worktree::mainVcsRoot(const filesystem::path& vcsRoot) {
+    ifstream in(vcsRoot / "worktree.txt");
+    string line;
+    while (getline(in, line)) {
+        if (line.rfind("MAIN:", 0) == 0) {
+            return filesystem::path(line.substr(5)) / ".Minivcs";
+        }
+    }
+    return vcsRoot;
+}
+
+static vector<string> registered(const filesystem::path& mainVcs) {
+    vector<string> roots;
+    ifstream in(mainVcs / "worktrees.txt");
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty()) {
+            roots.push_back(line);
+        }
+    }
+    return roots;
+}
+
+static void saveRegistered(const filesystem::path& mainVcs, const vector<string>& roots) {
+    string contents;
+    for (const string& root : roots) {
+        contents += root + "\n";
+    }
+    writeFileAtomically(mainVcs / "worktrees.txt", contents);
+}
+
+vector<WorktreeInfo> Worktree::list(const filesystem::path& vcsRoot) {
+    filesystem::path mainVcs = mainVcsRoot(vcsRoot);
+    vector<WorktreeInfo> worktrees;
+    worktrees.push_back({mainVcs.parent_path(), readMetadataFile(Repository::headFileFor(mainVcs)), true, false});
+
+    for (const string& root : registered(mainVcs)) {
+        filesystem::path linkedVcs = filesystem::path(root) / ".Minivcs";
+        bool missing = !isLinked(linkedVcs);
+        worktrees.push_back({root, missing ? "NA" : readMetadataFile(linkedVcs / "HEAD.txt"), false, missing});
+    }
+    return worktrees;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// ADD
+// The symlinks are a convenience, everything finds the shared parts through worktree.txt. Where they can't be made
+// (windows without the symlink privilege) the worktree goes without any
+//----------------------------------------------------------------------------------------------------------------------------
+
+static void linkShared(const filesystem::path& mainVcs, const filesystem::path& linkedVcs) {
+    error_code ec;
+    for (const char* folder : SHARED_FOLDERS) {
+        filesystem::create_directory_symlink(mainVcs / folder, linkedVcs / folder, ec);
+        if (ec) {
+            break;
+        }
+    }
+    if (!ec) {
+        filesystem::create_symlink(mainVcs / "lock", linkedVcs / "lock", ec);
+    }
+    if (!ec) {
+        return;
+    }
+
+    // all or none, a half linked folder would look like a second store
+    error_code ignored;
+    for (const char* folder : SHARED_FOLDERS) {
+        filesystem::remove(linkedVcs / folder, ignored);
+    }
+    filesystem::remove(linkedVcs / "lock", ignored);
+}
+
+void Worktree::add(const filesystem::path& vcsRoot, const filesystem::path& dest, const string& commitID) {
+    TRACE_SPAN_DETAIL("Worktree::add", dest.string());
+    filesystem::path mainVcs = mainVcsRoot(vcsRoot);
+    filesystem::path root = filesystem::absolute(dest).lexically_normal();
+    if (!root.has_filename()) {
+        root = root.parent_path();
+    }
+
+    if (filesystem::exists(root) && (!filesystem::is_directory(root) || !filesystem::is_empty(root))) {
+        throw runtime_error("'" + root.string() + "' already exists and is not empty");
+    }
+    bool created = !filesystem::exists(root);
+
+    try {
+        filesystem::path linkedVcs = root / ".Minivcs";
+        filesystem::create_directories(linkedVcs / "staging_area");
+
+        // the shared folders have to exist before they can be linked to
+        for (const char* folder : SHARED_FOLDERS) {
+            filesystem::create_directories(mainVcs / folder);
+        }
+        ofstream(mainVcs / "lock", ios::app);
+        linkShared(mainVcs, linkedVcs);
+
+        writeFileAtomically(linkedVcs / "HEAD.txt", commitID);
+        writeFileAtomically(linkedVcs / "worktree.txt", "MAIN:" + mainVcs.parent_path().string() + "\n");
+
+        vector<string> roots = registered(mainVcs);
+        roots.push_back(root.string());
+        saveRegistered(mainVcs, roots);
+    } catch (const exception& e) {
+        error_code ec;
+        filesystem::remove_all(created ? root : root / ".Minivcs", ec);
+        throw runtime_error(string("could not create the worktree: ") + e.what());
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------
+// REMOVE
+// remove_all deletes the symlinks themselves, never what they point to
+//----------------------------------------------------------------------------------------------------------------------------
+
+void Worktree::remove(const filesystem::path& vcsRoot, const filesystem::path& dest) {
+    filesystem::path mainVcs = mainVcsRoot(vcsRoot);
+    string root = filesystem::absolute(dest).lexically_normal().string();
+    while (root.size() > 1 && root.back() == '/') {
+        root.pop_back();
+    }
+
+    vector<string> roots = registered(mainVcs);
+    auto found = find(roots.begin(), roots.end(), root);
+    if (found == roots.end()) {
+        throw runtime_error("'" + root + "' is not a linked worktree of this repository");
+    }
+
+    if (isLinked(filesystem::path(root) / ".Minivcs")) {
+        filesystem::remove_all(root);
+    }
+
+    roots.erase(found);
+    saveRegistered(mainVcs, roots);
+}
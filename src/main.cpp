@@ -3,32 +3,48 @@
 #include <string>
 #include <fstream>
 #include "Repository.h"
-#include "CommitManager.h"
-#include "Restore.h"
+#include "Commands.h"
+#include "RepoLock.h"
+#include "MiniGit.h"
+#include "Daemon.h"
+#include "Stats.h"
+#include <atomic>
+#include <new>
+#include <cstdlib>
 
 using namespace std;
 
-int main(int argc, char* argv[])
+#ifndef NDEBUG
+// debug builds count every heap allocation for --stats (heap_allocations)
+static atomic<uint64_t> heapAllocations(0);
+
+void* operator new(size_t size) {
+    heapAllocations.fetch_add(1, memory_order_relaxed);
+    if (void* memory = malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+#endif
+
+static int run(const vector<string>& args, bool useDaemon)
 {
     Repository repo;
 
-    if (argc < 2) {
-        cout << "Usage: minigit <command> [args]\n";
-        cout << "Commands:\n";
-        cout << "  init              - Initialize repository\n";
-        cout << "  add <files>       - Add files to staging\n";
-        cout << "  addall            - Add all files\n";
-        cout << "  commit <message>  - Create a commit\n";
-        cout << "  log               - Show commit history\n";
-        cout << "  revert <commitID> - Revert to a commit (creates new commit)\n";
-        cout << "  undo              - Undo to previous commit\n";
-        cout << "  redo              - Redo to next commit\n";
-        cout << "  status            - Show restore status\n";
-        cout << "  history           - Show commit history with current position\n";
+    if (args.empty()) {
+        printUsage(cout);
         return 0;
     }
 
-    string cmd = argv[1];
+    string cmd = args[0];
 
     // =====================================
     // INIT
@@ -39,135 +55,72 @@ int main(int argc, char* argv[])
         return 0;
     }
 
-    // Check if repository is initialized for all other commands
-    if (!repo.isInitialized() && cmd != "init") {
-        cerr << "fatal: not a Minivcs repository\n";
-        cerr << "Hint: Use 'minigit init' to create a repository\n";
-        return 1;
-    }
-
-    // Create manager and restore AFTER checking initialization
-    CommitManager manager;
-    Restore restore(&repo);
-
     // =====================================
-    // ADD FILES
+    // CLONE (creates the repository it runs in)
     // =====================================
-    if (cmd == "add") {
-        if (argc < 3) {
-            cout << "Usage: minigit add <file1> <file2> ...\n";
-            return 0;
-        }
-
-        vector<string> files;
-        for (int i = 2; i < argc; i++)
-            files.push_back(argv[i]);
-
-        repo.add(files);
-        return 0;
+    if (cmd == "clone") {
+        return runClone(args);
     }
 
-    // =====================================
-    // ADD ALL
-    // =====================================
-    if (cmd == "addall") {
-        repo.addAll();
-        return 0;
+    // Check if repository is initialized for all other commands
+    if (!checkRepository(repo, cmd)) {
+        return 1;
     }
 
     // =====================================
-    // COMMIT
+    // DAEMON (keep the session loaded and serve other minigit processes)
     // =====================================
-    if (cmd == "commit") {
-        if (argc < 3) {
-            cout << "Usage: minigit commit <message>\n";
-            return 0;
-        }
-
-        // Combine everything after "commit" into a message
-        string msg;
-        for (int i = 2; i < argc; i++) {
-            msg += argv[i];
-            if (i < argc - 1) msg += " ";
+    if (cmd == "daemon") {
+        if (args.size() >= 2 && args[1] == "stop") {
+            return Daemon::stop();
         }
-
-        manager.addCommit(msg);
-
-        // Get the new commit ID from HEAD.txt
-        string newCommitID = repo.getHead();
-
-        // Record the commit in restore system
-        restore.recordCommit(newCommitID);
-
-        repo.clearStaging();
-        cout << "Commit created: " << newCommitID << "\n";
-        return 0;
+        return Daemon::serve();
     }
 
     // =====================================
-    // LOG
+    // BATCH (many commands from stdin, one process, one lock)
     // =====================================
-    if (cmd == "log") {
-        manager.printLog();
-        return 0;
+    if (cmd == "batch") {
+        RepoLock lock(repo.getVcsRoot(), RepoLock::Exclusive);
+        Session session;
+        session.load();
+        int exitCode = runBatch(session, cin);
+        autoCollect(session);
+        return exitCode;
     }
 
-    // =====================================
-    // REVERT (creates a new commit with old data)
-    // =====================================
-    if (cmd == "revert") {
-        if (argc < 3) {
-            cout << "Usage: minigit revert <commitID>\n";
-            return 0;
-        }
-
-        string id = argv[2];
-        manager.revert(id);
-
-        // Get the new revert commit ID
-        string newCommitID = repo.getHead();
-
-        // Record the new revert commit
-        restore.recordCommit(newCommitID);
-
-        return 0;
+    // If a daemon is running it already has everything loaded, let it do the work
+    int exitCode = 0;
+    if (useDaemon && Daemon::forward(args, exitCode)) {
+        return exitCode;
     }
 
-    // =====================================
-    // UNDO (checkout to previous commit)
-    // =====================================
-    if (cmd == "undo") {
-        restore.undo();
-        return 0;
-    }
+    // Everything else goes through the library API, which picks the lock and loads the session
+    return MiniGit(repo.getRoot()).execute(args, cout, cerr);
+}
 
-    // =====================================
-    // REDO (checkout to next commit)
-    // =====================================
-    if (cmd == "redo") {
-        restore.redo();
-        return 0;
+int main(int argc, char* argv[])
+{
+    // --stats (or --stats=json) anywhere on the command line prints how much work the command did.
+    // The counters live in this process, so the command isn't handed to a daemon
+    vector<string> args;
+    string stats;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--stats" || arg == "--stats=json") {
+            stats = arg;
+        } else {
+            args.push_back(arg);
+        }
     }
 
-    // =====================================
-    // STATUS (Restore Status)
-    // =====================================
-    if (cmd == "status") {
-        restore.printStatus();
-        return 0;
-    }
+    int exitCode = run(args, stats.empty());
 
-    // =====================================
-    // HISTORY (Show commit history with current position)
-    // =====================================
-    if (cmd == "history") {
-        restore.viewHistory(manager.getHead());
-        return 0;
+    if (!stats.empty()) {
+#ifndef NDEBUG
+        Stats::add(STAT_HEAP_ALLOCATIONS, heapAllocations.load());
+#endif
+        Stats::print(cerr, stats == "--stats=json");
     }
-
-    // =====================================
-    // DEFAULT (unknown)
-    // =====================================
-    cout << "Unknown command: " << cmd << "\n";
-    return 0;
-}
\ No newline at end of file
+    return exitCode;
+}
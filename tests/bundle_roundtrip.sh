@@ -0,0 +1,49 @@
+#!/bin/sh
+# a bundle carries history from one repository to another. A damaged one (a flipped byte, a bad commit count) has to
+# be refused without leaving .incoming-* staging folders behind
+set -e
+
+minigit="$1"
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+export MINIGIT_NO_DAEMON=1
+export LC_ALL=C
+
+mkdir "$scratch/from" "$scratch/to"
+cd "$scratch/from"
+"$minigit" init > /dev/null
+echo payload-one > a.txt
+"$minigit" add a.txt > /dev/null
+"$minigit" commit first > /dev/null
+mkdir sub
+echo payload-two > sub/b.txt
+"$minigit" add sub/b.txt > /dev/null
+"$minigit" commit second > /dev/null
+"$minigit" bundle create "$scratch/good.bundle" > /dev/null
+
+# bundles are gzip when minigit has zlib, the reader takes plain ones too
+gzip -dcf "$scratch/good.bundle" > "$scratch/plain.bundle"
+sed 's/payload-two/payload-twp/' "$scratch/plain.bundle" > "$scratch/flipped.bundle"
+sed 's/^COMMITS .*/COMMITS 99999999999999/' "$scratch/plain.bundle" > "$scratch/huge.bundle"
+sed 's/^COMMITS .*/COMMITS 3/' "$scratch/plain.bundle" > "$scratch/short.bundle"
+if cmp -s "$scratch/plain.bundle" "$scratch/flipped.bundle"; then
+    echo "no content to flip in the bundle"
+    exit 1
+fi
+
+cd "$scratch/to"
+"$minigit" init > /dev/null
+for damaged in flipped huge short; do
+    if "$minigit" bundle unbundle "$scratch/$damaged.bundle" > /dev/null 2>&1; then
+        echo "the $damaged bundle was accepted"
+        exit 1
+    fi
+    if ls -a .Minivcs/commits | grep -q '^\.incoming-'; then
+        echo "the $damaged bundle left a staging folder behind"
+        exit 1
+    fi
+done
+
+"$minigit" bundle unbundle "$scratch/good.bundle" > /dev/null
+test "$("$minigit" log)" = "$(cd "$scratch/from" && "$minigit" log)"
+"$minigit" bundle unbundle "$scratch/good.bundle" | grep -q 'Already up to date'
@@ -0,0 +1,27 @@
+#!/bin/sh
+# commit-graph.txt is only a cache: a damaged one has to be rebuilt, never break commands. Messages over several
+# lines must not split a commit's graph line
+set -e
+
+minigit="$1"
+repo=$(mktemp -d)
+trap 'rm -rf "$repo"' EXIT
+cd "$repo"
+export MINIGIT_NO_DAEMON=1
+graph=.Minivcs/commits/commit-graph.txt
+
+"$minigit" init > /dev/null
+echo one > a.txt
+"$minigit" add a.txt > /dev/null
+"$minigit" commit "$(printf 'first line\nid  with  spaces \\ backslash')" > /dev/null
+"$minigit" log > /dev/null
+
+# header plus one line for the one commit
+test "$(wc -l < "$graph")" -eq 4
+"$minigit" log | grep -q 'id  with  spaces \\ backslash'
+
+for count in xyz 0 -3 99999999999999999999; do
+    sed -i "s/^COUNT:.*/COUNT:$count/" "$graph"
+    "$minigit" log | grep -q 'first line'
+    grep -q '^COUNT:1$' "$graph"
+done
@@ -0,0 +1,31 @@
+#!/bin/sh
+# With a current commit graph, read-only commands run without the repository lock and must not write anything,
+# not even the caches (path filters, Manifest.txt, stat and blame caches, restore state) they would normally leave
+set -e
+
+minigit="$1"
+repo=$(mktemp -d)
+trap 'rm -rf "$repo"' EXIT
+cd "$repo"
+export MINIGIT_NO_DAEMON=1
+
+"$minigit" init > /dev/null
+echo one > a.txt
+"$minigit" add a.txt > /dev/null
+"$minigit" commit first > /dev/null
+echo two >> a.txt
+"$minigit" add a.txt > /dev/null
+"$minigit" commit second > /dev/null
+"$minigit" log > /dev/null
+
+rm -rf .Minivcs/commits/*/*/ChangedPaths.bloom .Minivcs/restore_state.txt .Minivcs/restore_journal.txt \
+       .Minivcs/stat_cache.txt .Minivcs/cache/blame
+before=$(find .Minivcs | sort | xargs ls -ld --time-style=+%s.%N)
+
+"$minigit" log -- a.txt | grep -q second
+"$minigit" status > /dev/null
+"$minigit" blame a.txt > /dev/null
+"$minigit" diff > /dev/null
+
+after=$(find .Minivcs | sort | xargs ls -ld --time-style=+%s.%N)
+test "$before" = "$after"
@@ -0,0 +1,27 @@
+#!/bin/sh
+# A batch only journals its commits (there is no restore_state.txt yet), undo afterwards has to replay that journal
+# instead of starting over from HEAD
+set -e
+
+minigit="$1"
+repo=$(mktemp -d)
+trap 'rm -rf "$repo"' EXIT
+cd "$repo"
+
+"$minigit" init > /dev/null
+echo one > a.txt
+echo two > b.txt
+printf 'add a.txt\ncommit -m one\nadd b.txt\ncommit -m two\n' | "$minigit" batch > /dev/null
+
+output=$("$minigit" undo 2>&1)
+echo "$output"
+case "$output" in
+    *"Cannot undo"*) exit 1 ;;
+esac
+
+# and back again
+output=$("$minigit" redo 2>&1)
+echo "$output"
+case "$output" in
+    *"Cannot redo"*) exit 1 ;;
+esac
@@ -0,0 +1,36 @@
+#!/bin/sh
+# A linked worktree made where symlinks aren't allowed has no commits/objects/stash/cache/lock links, it has to reach
+# the main worktree's through worktree.txt
+set -e
+
+minigit="$1"
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+export MINIGIT_NO_DAEMON=1
+
+mkdir "$scratch/main"
+cd "$scratch/main"
+"$minigit" init > /dev/null
+echo one > a.txt
+"$minigit" add a.txt > /dev/null
+"$minigit" commit first > /dev/null
+
+"$minigit" worktree add "$scratch/linked" HEAD > /dev/null
+rm -f "$scratch/linked/.Minivcs/commits" "$scratch/linked/.Minivcs/objects" "$scratch/linked/.Minivcs/stash" \
+      "$scratch/linked/.Minivcs/cache" "$scratch/linked/.Minivcs/lock"
+
+cd "$scratch/linked"
+test "$(cat a.txt)" = one
+echo two >> a.txt
+"$minigit" add a.txt > /dev/null
+"$minigit" commit second > /dev/null
+"$minigit" blame a.txt > /dev/null
+echo three >> a.txt
+"$minigit" stash > /dev/null
+"$minigit" stash pop > /dev/null
+"$minigit" fsck
+
+# the commit went into the shared history, the main worktree sees it
+cd "$scratch/main"
+"$minigit" log | grep -q second
+test ! -e "$scratch/linked/.Minivcs/commits"